@@ -0,0 +1,89 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <utility>
+
+// An axis-aligned bounding box, stored as one interval per axis. Bounding boxes let
+// acceleration structures reject whole groups of objects with a single cheap test.
+class aabb {
+  public:
+    interval x = {}; // Extent along the x axis
+    interval y = {}; // Extent along the y axis
+    interval z = {}; // Extent along the z axis
+
+    // Default constructor: an empty box (every interval is empty), which contains nothing
+    // and leaves any box it is merged with unchanged.
+    aabb() {}
+
+    // Creates a box from its three per-axis intervals
+    aabb(const interval& x, const interval& y, const interval& z) : x(x), y(y), z(z) {}
+
+    // Creates the box spanned by two corner points (in any order)
+    aabb(const point3& a, const point3& b) {
+        x = (a[0] <= b[0]) ? interval(a[0], b[0]) : interval(b[0], a[0]);
+        y = (a[1] <= b[1]) ? interval(a[1], b[1]) : interval(b[1], a[1]);
+        z = (a[2] <= b[2]) ? interval(a[2], b[2]) : interval(b[2], a[2]);
+    }
+
+    // Creates the smallest box enclosing both `box0` and `box1`
+    aabb(const aabb& box0, const aabb& box1) : x(box0.x, box1.x), y(box0.y, box1.y), z(box0.z, box1.z) {}
+
+    // Returns the interval of axis `n` (0 = x, 1 = y, 2 = z)
+    const interval& axis_interval(int n) const {
+        if (n == 1) return y;
+        if (n == 2) return z;
+        return x;
+    }
+
+    // Returns the index of the axis along which the box is largest
+    int longest_axis() const {
+        if (x.size() > y.size())
+            return x.size() > z.size() ? 0 : 2;
+        return y.size() > z.size() ? 1 : 2;
+    }
+
+    // Returns the box's center point
+    point3 centroid() const {
+        return point3(0.5 * (x.min + x.max), 0.5 * (y.min + y.max), 0.5 * (z.min + z.max));
+    }
+
+    // Returns the box's surface area, the quantity the surface area heuristic is built on.
+    // An empty box has zero area.
+    double surface_area() const {
+        double dx = x.size(), dy = y.size(), dz = z.size();
+        if (dx < 0 || dy < 0 || dz < 0)
+            return 0;
+        return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+
+    // Slab test: returns true if ray `r` passes through the box somewhere inside `ray_t`.
+    // `inv_dir` holds 1 / r.direction() per component and is computed once per ray by the caller.
+    bool hit(const ray& r, const vec3& inv_dir, interval ray_t) const {
+        const point3& origin = r.origin();
+
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& slab = axis_interval(axis);
+
+            // Distances along the ray to the two planes bounding this axis
+            auto t0 = (slab.min - origin[axis]) * inv_dir[axis];
+            auto t1 = (slab.max - origin[axis]) * inv_dir[axis];
+            if (t0 > t1)
+                std::swap(t0, t1);
+
+            // Narrow the range to the overlap with this slab; an empty overlap is a miss
+            if (t0 > ray_t.min) ray_t.min = t0;
+            if (t1 < ray_t.max) ray_t.max = t1;
+            if (ray_t.max <= ray_t.min)
+                return false;
+        }
+        return true;
+    }
+
+    // Two special static boxes: `empty` contains nothing, `universe` contains everything
+    static const aabb empty, universe;
+};
+
+const aabb aabb::empty    = aabb(interval::empty,    interval::empty,    interval::empty);
+const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Camera animation for batch rendering. An animation is a list of keyframes, each fixing
+// the camera position, the point it looks at and the vertical field of view at one frame
+// number; the frames in between are interpolated. Positions and focus points follow a
+// Catmull-Rom spline through the keys (so the camera moves without kinks at a key), the
+// field of view changes linearly.
+//
+// Text format, one statement per line, '#' starts a comment:
+//
+//     frames 48                     # Number of frames (default: last key frame + 1)
+//     key 0  13 2 3   0 0 0  20     # key <frame> <position x y z> <focus point x y z> <vertical fov>
+//     key 47 3 2 13   0 0 0  30
+
+// The camera pose at one frame.
+struct camera_keyframe {
+    double frame = 0; // Frame number of the key
+    point3 position = point3(0, 0, 0); // camera::camera_position
+    point3 focus_point = point3(0, 0, -1); // camera::focus_point
+    double vertical_fov = 90; // camera::vertical_fov, in degrees
+};
+
+struct camera_animation {
+    std::vector<camera_keyframe> keys = {}; // Keyframes sorted by frame number
+    int frame_count = 0; // Number of frames to render, starting at frame 0
+
+    // Pose of the camera at `frame`. Frames before the first or after the last key hold
+    // that key's pose.
+    camera_keyframe pose_at(double frame) const {
+        if (keys.empty())
+            return camera_keyframe();
+        if (frame <= keys.front().frame)
+            return keys.front();
+        if (frame >= keys.back().frame)
+            return keys.back();
+
+        // The segment [k1, k2] holding the frame, with its outer neighbours for the spline
+        size_t k2 = static_cast<size_t>(std::upper_bound(keys.begin(), keys.end(), frame, [](double f, const camera_keyframe& key) { return f < key.frame; }) - keys.begin());
+        size_t k1 = k2 - 1;
+        size_t k0 = k1 > 0 ? k1 - 1 : k1;
+        size_t k3 = k2 + 1 < keys.size() ? k2 + 1 : k2;
+        double u = (frame - keys[k1].frame) / (keys[k2].frame - keys[k1].frame);
+
+        camera_keyframe pose;
+        pose.frame = frame;
+        pose.position = catmull_rom(keys[k0].position, keys[k1].position, keys[k2].position, keys[k3].position, u);
+        pose.focus_point = catmull_rom(keys[k0].focus_point, keys[k1].focus_point, keys[k2].focus_point, keys[k3].focus_point, u);
+        pose.vertical_fov = keys[k1].vertical_fov + u * (keys[k2].vertical_fov - keys[k1].vertical_fov);
+        return pose;
+    }
+
+    // Uniform Catmull-Rom spline through p1 (u = 0) and p2 (u = 1).
+    static point3 catmull_rom(const point3& p0, const point3& p1, const point3& p2, const point3& p3, double u) {
+        real t = real(u), t2 = t * t, t3 = t2 * t;
+        return real(0.5) * ((2 * p1) + (p2 - p0) * t + (2 * p0 - 5 * p1 + 4 * p2 - p3) * t2 + (3 * p1 - p0 - 3 * p2 + p3) * t3);
+    }
+};
+
+// Reads an animation from the text file `path` (see the format above). Returns false with
+// a message on std::cerr if the file cannot be read or holds an error.
+inline bool load_animation(const std::string& path, camera_animation& animation) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Error: Could not read " << path << ".\n";
+        return false;
+    }
+
+    animation = camera_animation();
+    std::string line;
+    int line_number = 0;
+    auto fail = [&](const std::string& message) {
+        std::cerr << "Error: " << path << ":" << line_number << ": " << message << ".\n";
+        return false;
+    };
+
+    while (std::getline(in, line)) {
+        ++line_number;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string statement;
+        if (!(words >> statement))
+            continue; // Blank or comment-only line
+
+        if (statement == "frames") {
+            if (!(words >> animation.frame_count) || animation.frame_count <= 0)
+                return fail("expected 'frames <count>'");
+        } else if (statement == "key") {
+            double frame, px, py, pz, fx, fy, fz, fov;
+            if (!(words >> frame >> px >> py >> pz >> fx >> fy >> fz >> fov))
+                return fail("expected 'key frame px py pz fx fy fz fov'");
+            if (!animation.keys.empty() && frame <= animation.keys.back().frame)
+                return fail("keys must be listed in increasing frame order");
+            animation.keys.push_back({frame, point3(px, py, pz), point3(fx, fy, fz), fov});
+        } else {
+            return fail("unknown statement '" + statement + "'");
+        }
+    }
+
+    if (animation.keys.empty()) {
+        std::cerr << "Error: " << path << " has no keys.\n";
+        return false;
+    }
+    if (animation.frame_count == 0)
+        animation.frame_count = static_cast<int>(animation.keys.back().frame) + 1;
+    return true;
+}
+
+// Output path of frame `frame`: the last run of '#' in `pattern` becomes the zero-padded
+// frame number ("out/frame_####.png" -> "out/frame_0007.png"). Without one, "_<frame>" with
+// four digits goes in front of the extension.
+inline std::string frame_output_path(const std::string& pattern, int frame) {
+    size_t last = pattern.rfind('#');
+    size_t slash = pattern.find_last_of('/');
+    if (last == std::string::npos || (slash != std::string::npos && last < slash)) {
+        size_t dot = pattern.rfind('.');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            dot = pattern.size();
+        return frame_output_path(pattern.substr(0, dot) + "_####" + pattern.substr(dot), frame);
+    }
+
+    size_t first = last;
+    while (first > 0 && pattern[first - 1] == '#')
+        --first;
+    char digits[32];
+    std::snprintf(digits, sizeof(digits), "%0*d", static_cast<int>(last - first + 1), frame);
+    return pattern.substr(0, first) + digits + pattern.substr(last + 1);
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// A monotonic arena: allocations bump a pointer through large blocks taken from the heap,
+// nothing is freed one by one, and reset() rewinds the whole arena at once. Memory that
+// lives exactly as long as one frame (or one build) goes here, so repeating the work
+// reuses the same memory instead of going back to the allocator every time.
+//
+// After a reset the arena keeps its memory; if the last round spilled into more than one
+// block, they are merged into one block as large as all of them, so the next round of the
+// same size fits without touching the heap. Only trivially destructible objects may be
+// placed in an arena, since nothing runs their destructors.
+class memory_arena {
+  public:
+    // An arena whose first block holds at least `block_size` bytes (taken on first use).
+    explicit memory_arena(size_t block_size = 64 * 1024) : block_size(std::max<size_t>(block_size, 64)) {}
+
+    memory_arena(const memory_arena&) = delete;
+    memory_arena& operator=(const memory_arena&) = delete;
+    memory_arena(memory_arena&&) = default;
+    memory_arena& operator=(memory_arena&&) = default;
+
+    // Returns `bytes` bytes aligned to `alignment` (a power of two), valid until the next
+    // reset() or release().
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        if (!blocks.empty()) {
+            block& current = blocks.back();
+            size_t start = aligned(current.data.get(), used, alignment);
+            if (start + bytes <= current.size) {
+                used = start + bytes;
+                return current.data.get() + start;
+            }
+        }
+
+        // A new block, at least twice the last one, so a growing round needs few of them
+        size_t size = std::max(bytes + alignment, blocks.empty() ? block_size : 2 * blocks.back().size);
+        blocks.push_back({std::unique_ptr<unsigned char[]>(new unsigned char[size]), size});
+        reserved += size;
+        size_t start = aligned(blocks.back().data.get(), 0, alignment);
+        used = start + bytes;
+        return blocks.back().data.get() + start;
+    }
+
+    // `count` value-initialized objects of type T (zeros for plain structs and numbers).
+    template <typename T>
+    T* make_array(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena objects are never destroyed");
+        T* objects = static_cast<T*>(allocate(std::max<size_t>(1, count) * sizeof(T), alignof(T)));
+        std::uninitialized_value_construct_n(objects, count);
+        return objects;
+    }
+
+    // Forgets every allocation but keeps the memory for the next round.
+    void reset() {
+        if (blocks.size() > 1) {
+            blocks.clear();
+            blocks.push_back({std::unique_ptr<unsigned char[]>(new unsigned char[reserved]), reserved});
+        }
+        used = 0;
+    }
+
+    // Gives all memory back to the heap.
+    void release() {
+        blocks.clear();
+        reserved = 0;
+        used = 0;
+    }
+
+    // Bytes held from the heap.
+    size_t bytes_reserved() const { return reserved; }
+
+  private:
+    struct block {
+        std::unique_ptr<unsigned char[]> data = {};
+        size_t size = 0;
+    };
+
+    size_t block_size = 0; // Size of the first block
+    std::vector<block> blocks = {}; // Blocks in the order they were taken; allocations come from the last one
+    size_t used = 0; // Bytes used of the last block
+    size_t reserved = 0; // Total size of the blocks
+
+    // Offset within `base` of the first address at or after `offset` aligned to `alignment`
+    static size_t aligned(const unsigned char* base, size_t offset, size_t alignment) {
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(base) + offset;
+        return offset + ((alignment - address % alignment) % alignment);
+    }
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include "image_writer.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Encodes and writes images on a thread of its own, so a batch render can trace frame N+1
+// while frame N is being written. Frames are written in the order they were submitted.
+// At most `max_pending` frames wait in the queue; submit() blocks beyond that, which
+// bounds the memory held by frames the disk has not caught up with.
+class async_image_writer {
+public:
+    explicit async_image_writer(size_t max_pending = 2) : max_pending(std::max<size_t>(1, max_pending)) {
+        thread = std::thread([this] { write_loop(); });
+    }
+
+    async_image_writer(const async_image_writer&) = delete;
+    async_image_writer& operator=(const async_image_writer&) = delete;
+
+    ~async_image_writer() { finish(); }
+
+    // Queues `rgb` (width * height * 3 bytes, see image_writer) to be written to `path`.
+    void submit(const std::string& path, int width, int height, std::vector<unsigned char> rgb) {
+        std::unique_lock<std::mutex> lock(mutex);
+        queue_space.wait(lock, [&] { return queue.size() < max_pending; });
+        queue.push_back({path, width, height, std::move(rgb)});
+        queue_ready.notify_one();
+    }
+
+    // Waits until every queued frame has been written and stops the thread. Returns false
+    // if any frame could not be written.
+    bool finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        queue_ready.notify_one();
+        if (thread.joinable())
+            thread.join();
+        return !failed;
+    }
+
+private:
+    struct frame {
+        std::string path = "";
+        int width = 0;
+        int height = 0;
+        std::vector<unsigned char> rgb = {};
+    };
+
+    size_t max_pending = 2;
+    std::thread thread = {};
+    std::mutex mutex = {};
+    std::condition_variable queue_ready = {}; // Signalled when a frame is queued or the writer stops
+    std::condition_variable queue_space = {}; // Signalled when a frame leaves the queue
+    std::deque<frame> queue = {};
+    bool stopping = false;
+    bool failed = false; // Written by the writer thread, read after it has been joined
+
+    void write_loop() {
+        while (true) {
+            frame next;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queue_ready.wait(lock, [&] { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return; // Stopping with nothing left to write
+                next = std::move(queue.front());
+                queue.pop_front();
+            }
+            queue_space.notify_one();
+
+            if (!make_image_writer(next.path)->write(next.path, next.width, next.height, next.rgb)) {
+                std::cerr << "\nError: Could not write " << next.path << ".\n";
+                failed = true;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,479 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "hittable.hpp"
+#include "hittable_list.hpp"
+#include "sphere_batch.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// One node of a flattened bounding volume hierarchy. Nodes are stored in depth-first
+// order, so an interior node's first child is always the very next node and only the
+// second child needs an explicit index. A whole traversal then walks forward through
+// one contiguous array instead of chasing pointers across the heap.
+struct bvh_flat_node {
+    aabb box = {}; // Box enclosing everything below this node
+    int offset = 0; // Leaf: index of its first primitive. Interior: index of the second child
+    int count = 0; // Leaf: number of primitives. Interior: always 0
+    int axis = 0; // Interior: split axis, used to visit the nearer child first
+    bool spheres_only = false; // Leaf: every primitive is a sphere, tested with the SIMD sphere_batch kernel
+};
+
+// Builds a flattened BVH over a set of bounding boxes using the surface area heuristic
+// (SAH) evaluated over a fixed number of bins per axis. The builder only looks at the
+// boxes, so any primitive store can use it. On return `order` lists the box indices in
+// the order the leaves reference them.
+//
+// `leaf_width` is the number of primitives a leaf tests for the price of one, e.g. the
+// SIMD width of the sphere kernel. The SAH charges a leaf per group of that many
+// primitives, which favours full SIMD leaves over splitting them further.
+class bvh_builder {
+public:
+    // Depth below which SAH splits give way to median splits. Median splits halve the range,
+    // and ranges hold fewer than 2^31 primitives, so they add at most 31 more levels.
+    static constexpr int median_split_depth = 32;
+
+    // Deepest leaf any tree can have (the root is at depth 0). A traversal stack of this
+    // many entries never overflows: every entry waits for one ancestor of the current node.
+    static constexpr int max_depth = median_split_depth + 31;
+
+    bvh_builder(const std::vector<aabb>& boxes, int max_leaf_size, int leaf_width = 1)
+      : boxes(boxes), max_leaf_size(std::max(1, max_leaf_size)), leaf_width(std::max(1, leaf_width)) {
+        centroids.reserve(boxes.size());
+        for (const auto& box : boxes)
+            centroids.push_back(box.centroid());
+    }
+
+    std::vector<bvh_flat_node> build(std::vector<int>& order) {
+        order.resize(boxes.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = static_cast<int>(i);
+
+        nodes.clear();
+        nodes.reserve(2 * boxes.size());
+        if (!boxes.empty())
+            build_range(order, 0, static_cast<int>(order.size()), 0);
+        return std::move(nodes);
+    }
+
+private:
+    static constexpr int bin_count = 16; // SAH candidate splits are evaluated at bin boundaries
+    static constexpr double traversal_cost = 0.125; // Cost of visiting a node, relative to one primitive test
+
+    const std::vector<aabb>& boxes;
+    std::vector<point3> centroids = {};
+    std::vector<bvh_flat_node> nodes = {};
+    int max_leaf_size = 4;
+    int leaf_width = 1;
+
+    // SAH cost of testing `count` primitives in one leaf
+    double leaf_cost(int count) const {
+        return static_cast<double>((count + leaf_width - 1) / leaf_width);
+    }
+
+    // Builds the subtree over order[begin, end) and returns the index of its root node
+    int build_range(std::vector<int>& order, int begin, int end, int depth) {
+        int node_index = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+
+        // Bounds of the primitives and of their centroids
+        aabb bounds, centroid_bounds;
+        for (int i = begin; i < end; ++i) {
+            bounds = aabb(bounds, boxes[order[i]]);
+            centroid_bounds = aabb(centroid_bounds, aabb(centroids[order[i]], centroids[order[i]]));
+        }
+        nodes[node_index].box = bounds;
+
+        int count = end - begin;
+        if (count == 1) {
+            make_leaf(node_index, begin, count);
+            return node_index;
+        }
+
+        // Look for the cheapest binned SAH split over all three axes
+        int best_axis = -1;
+        int best_split = 0;
+        double best_cost = infinity;
+        for (int axis = 0; axis < 3 && depth < median_split_depth; ++axis) {
+            const interval& extent = centroid_bounds.axis_interval(axis);
+            if (extent.size() <= 0)
+                continue; // All centroids coincide along this axis
+
+            // Drop every primitive into a bin by its centroid
+            int bin_counts[bin_count] = {};
+            aabb bin_boxes[bin_count];
+            for (int i = begin; i < end; ++i) {
+                int bin = bin_of(centroids[order[i]][axis], extent);
+                bin_counts[bin]++;
+                bin_boxes[bin] = aabb(bin_boxes[bin], boxes[order[i]]);
+            }
+
+            // Sweep from the right to get the area and count right of every boundary
+            double right_area[bin_count] = {};
+            int right_count[bin_count] = {};
+            aabb right_box;
+            int right_total = 0;
+            for (int bin = bin_count - 1; bin > 0; --bin) {
+                right_box = aabb(right_box, bin_boxes[bin]);
+                right_total += bin_counts[bin];
+                right_area[bin] = right_box.surface_area();
+                right_count[bin] = right_total;
+            }
+
+            // Sweep from the left and evaluate the SAH at every boundary
+            aabb left_box;
+            int left_total = 0;
+            for (int split = 1; split < bin_count; ++split) {
+                left_box = aabb(left_box, bin_boxes[split - 1]);
+                left_total += bin_counts[split - 1];
+                if (left_total == 0 || right_count[split] == 0)
+                    continue;
+
+                double cost = leaf_cost(left_total) * left_box.surface_area() + leaf_cost(right_count[split]) * right_area[split];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = split;
+                }
+            }
+        }
+
+        // Compare the best split with keeping everything in one leaf. Both costs are
+        // relative to the node's own surface area.
+        double area = bounds.surface_area();
+        double split_cost = (area > 0) ? traversal_cost + best_cost / area : infinity;
+
+        int mid = begin + count / 2;
+        if (best_axis >= 0) {
+            if (count <= max_leaf_size && leaf_cost(count) <= split_cost) {
+                make_leaf(node_index, begin, count);
+                return node_index;
+            }
+
+            // Partition the primitives on the chosen bin boundary
+            const interval& extent = centroid_bounds.axis_interval(best_axis);
+            auto first_right = std::partition(order.begin() + begin, order.begin() + end, [&](int index) {
+                return bin_of(centroids[index][best_axis], extent) < best_split;
+            });
+            mid = static_cast<int>(first_right - order.begin());
+        } else {
+            // No usable SAH split (coincident centroids or a deep tree): split at the median
+            if (count <= max_leaf_size) {
+                make_leaf(node_index, begin, count);
+                return node_index;
+            }
+            best_axis = centroid_bounds.longest_axis();
+            std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](int a, int b) {
+                return centroids[a][best_axis] < centroids[b][best_axis];
+            });
+        }
+
+        // The first child follows this node directly; only the second child's index is stored
+        build_range(order, begin, mid, depth + 1);
+        int second_child = build_range(order, mid, end, depth + 1);
+        nodes[node_index].offset = second_child;
+        nodes[node_index].axis = best_axis;
+        return node_index;
+    }
+
+    void make_leaf(int node_index, int begin, int count) {
+        nodes[node_index].offset = begin;
+        nodes[node_index].count = count;
+    }
+
+    // Maps a centroid coordinate to its SAH bin
+    static int bin_of(double coordinate, const interval& extent) {
+        int bin = static_cast<int>(bin_count * (coordinate - extent.min) / extent.size());
+        return std::clamp(bin, 0, bin_count - 1);
+    }
+};
+
+// Returns 1 / direction per component, replacing zero components by a huge finite value
+// so slab tests never see infinities (the build uses -ffinite-math-only).
+inline vec3 inverse_direction(const vec3& direction) {
+    vec3 inv_dir;
+    for (int axis = 0; axis < 3; ++axis) {
+        real d = direction[axis];
+        inv_dir[axis] = (std::fabs(d) > real(1e-30)) ? 1 / d : std::copysign(real(1e30), d);
+    }
+    return inv_dir;
+}
+
+// Box between `start` (at time 0) and `end` (at time 1) at `time`, corner by corner.
+inline aabb interpolate_box(const aabb& start, const aabb& end, real time) {
+    auto lerp = [time](const interval& a, const interval& b) { return interval(a.min + time * (b.min - a.min), a.max + time * (b.max - a.max)); };
+    return aabb(lerp(start.x, end.x), lerp(start.y, end.y), lerp(start.z, end.z));
+}
+
+// bvh_node is a bounding volume hierarchy over the objects of a hittable_list.
+// It is a hittable itself, so it can replace the list wherever a scene is expected,
+// turning the per-ray cost from linear in the number of objects to roughly logarithmic.
+//
+// Scenes with moving spheres get a temporal tree. The topology is built over the boxes the
+// spheres sweep during the shutter interval, but every node keeps two boxes: one around
+// its contents at time 0 (bvh_flat_node::box) and one at time 1 (end_boxes). A ray tests
+// the box interpolated to its own time. Every sphere moves along a straight line, so the
+// interpolated box still holds all of them at that time, and it is about as tight as a
+// static box: fast spheres no longer make the boxes around them span their whole path.
+// Other objects (instances) keep their box over the whole interval at both ends. Trees
+// without motion keep one box per node and the static walk.
+class bvh_node : public hittable {
+public:
+    // Builds the hierarchy over every object in `list`. Leaves hold at most `max_leaf_size`
+    // objects; when the list holds only spheres, leaves are sized for the SIMD sphere kernel.
+    bvh_node(const hittable_list& list, int max_leaf_size = 8) {
+        // Spheres are copied into a batch; anything else (including spheres the batch has no
+        // material slot left for) stays an object of its own
+        sphere_batch list_spheres;
+        std::vector<shared_ptr<hittable>> others;
+        std::vector<bvh_item> items;
+        items.reserve(list.objects.size());
+        for (const auto& object : list.objects) {
+            auto s = dynamic_cast<const sphere*>(object.get());
+            if (s && list_spheres.add(*s)) {
+                items.push_back({true, list_spheres.size() - 1});
+            } else {
+                others.push_back(object);
+                items.push_back({false, others.size() - 1});
+            }
+        }
+        build(list_spheres, others, items, max_leaf_size);
+    }
+
+    // Builds the hierarchy straight over the spheres of `batch` plus `others`, without a
+    // sphere object per sphere. A tree of spheres alone keeps nothing but the nodes and one
+    // reordered batch.
+    bvh_node(const sphere_batch& batch, const std::vector<shared_ptr<hittable>>& others = {}, int max_leaf_size = 8) {
+        std::vector<bvh_item> items;
+        items.reserve(batch.size() + others.size());
+        for (size_t i = 0; i < batch.size(); ++i)
+            items.push_back({true, i});
+        for (size_t i = 0; i < others.size(); ++i)
+            items.push_back({false, i});
+        build(batch, others, items, max_leaf_size);
+    }
+
+    // Finds the closest hit by walking the flattened tree with an explicit stack,
+    // visiting the child nearer to the ray origin first so the search interval shrinks early.
+    // Only `t` values are compared on the way; the caller builds the record of the winner.
+    bool intersect(const ray& r, interval ray_t, hit_candidate& candidate) const override {
+        if (nodes.empty())
+            return false;
+        return end_boxes.empty() ? closest_hit<false>(r, ray_t, candidate) : closest_hit<true>(r, ray_t, candidate);
+    }
+
+    // Any-hit version of intersect() for shadow rays: the same walk, but the interval never
+    // shrinks and the first primitive hit ends the search.
+    bool occluded(const ray& r, interval ray_t) const override {
+        if (nodes.empty())
+            return false;
+        return end_boxes.empty() ? any_hit<false>(r, ray_t) : any_hit<true>(r, ray_t);
+    }
+
+    // Returns the box enclosing the whole hierarchy (over the whole shutter interval).
+    aabb bounding_box() const override {
+        if (nodes.empty())
+            return aabb();
+        return end_boxes.empty() ? nodes[0].box : aabb(nodes[0].box, end_boxes[0]);
+    }
+
+    // True if the tree holds moving spheres and interpolates its boxes.
+    bool has_motion() const { return !end_boxes.empty(); }
+
+    // Bytes held by the tree: its nodes, spheres and object pointers (not what the objects
+    // themselves hold).
+    size_t memory_bytes() const {
+        return nodes.capacity() * sizeof(bvh_flat_node) + end_boxes.capacity() * sizeof(aabb) + spheres.memory_bytes() +
+               primitives.capacity() * sizeof(const hittable*) + owners.capacity() * sizeof(shared_ptr<hittable>);
+    }
+
+private:
+    // One object the tree is built over: sphere `index` of a batch, or object `index` of a list
+    struct bvh_item {
+        bool is_sphere = false;
+        size_t index = 0;
+    };
+
+    std::vector<const hittable*> primitives = {}; // Objects in leaf order, as plain pointers (empty for a tree of spheres alone)
+    std::vector<shared_ptr<hittable>> owners = {}; // Keeps `primitives` alive; not used while tracing
+    sphere_batch spheres = {}; // Structure-of-arrays copy of the spheres in leaf order, indexed like `primitives`
+    std::vector<bvh_flat_node> nodes = {}; // Flattened tree in depth-first order, root first
+    std::vector<aabb> end_boxes = {}; // With moving spheres: the box of every node at time 1 (empty: nothing moves)
+
+    // Entries of the traversal stacks: one per ancestor of the deepest leaf the builder makes
+    static constexpr int traversal_stack_size = bvh_builder::max_depth;
+    static_assert(traversal_stack_size <= 64, "the traversal stack lives in registers and L1; keep the tree depth bounded");
+
+    // Slab test of node `node_index` against `r`, with the node's box at the ray's time if
+    // the tree moves.
+    template <bool moving>
+    bool hits_node(int node_index, const ray& r, const vec3& inv_dir, interval ray_t) const {
+        RT_STAT(stats.box_tests++);
+        if constexpr (moving)
+            return interpolate_box(nodes[node_index].box, end_boxes[node_index], r.time()).hit(r, inv_dir, ray_t);
+        else
+            return nodes[node_index].box.hit(r, inv_dir, ray_t);
+    }
+
+    // The walk of intersect(), with moving or static node boxes
+    template <bool moving>
+    bool closest_hit(const ray& r, interval ray_t, hit_candidate& candidate) const {
+        vec3 inv_dir = inverse_direction(r.direction());
+        bool direction_negative[3] = {inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0};
+
+        bool hit_anything = false; // Boolean to track if any object was hit.
+        auto closest_so_far = ray_t.max; // Tracks the closest hit distance.
+
+        int stack[traversal_stack_size]; // Nodes still to visit
+        int stack_size = 0;
+        int node_index = 0;
+        while (true) {
+            const bvh_flat_node& node = nodes[node_index];
+            if (hits_node<moving>(node_index, r, inv_dir, interval(ray_t.min, closest_so_far))) {
+                if (node.spheres_only) {
+                    // Leaf of spheres: one batched test over the whole range
+                    if (spheres.intersect_range(r, interval(ray_t.min, closest_so_far), candidate, node.offset, node.count)) {
+                        hit_anything = true;
+                        closest_so_far = candidate.t;
+                    }
+                } else if (node.count > 0) {
+                    // Leaf: test its objects, narrowing the range with every hit
+                    for (int i = node.offset; i < node.offset + node.count; ++i) {
+                        if (primitives[i]->intersect(r, interval(ray_t.min, closest_so_far), candidate)) {
+                            hit_anything = true;
+                            closest_so_far = candidate.t;
+                        }
+                    }
+                } else {
+                    // Interior: descend into the nearer child and remember the other one
+                    if (direction_negative[node.axis]) {
+                        stack[stack_size++] = node_index + 1;
+                        node_index = node.offset;
+                    } else {
+                        stack[stack_size++] = node.offset;
+                        node_index = node_index + 1;
+                    }
+                    continue;
+                }
+            }
+
+            if (stack_size == 0)
+                break;
+            node_index = stack[--stack_size];
+        }
+
+        return hit_anything;
+    }
+
+    // The walk of occluded(), with moving or static node boxes
+    template <bool moving>
+    bool any_hit(const ray& r, interval ray_t) const {
+        vec3 inv_dir = inverse_direction(r.direction());
+        bool direction_negative[3] = {inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0};
+
+        int stack[traversal_stack_size];
+        int stack_size = 0;
+        int node_index = 0;
+        while (true) {
+            const bvh_flat_node& node = nodes[node_index];
+            if (hits_node<moving>(node_index, r, inv_dir, ray_t)) {
+                if (node.spheres_only) {
+                    if (spheres.occluded_range(r, ray_t, node.offset, node.count))
+                        return true;
+                } else if (node.count > 0) {
+                    for (int i = node.offset; i < node.offset + node.count; ++i)
+                        if (primitives[i]->occluded(r, ray_t))
+                            return true;
+                } else {
+                    // Nearer child first: blockers close to the origin end the search sooner
+                    if (direction_negative[node.axis]) {
+                        stack[stack_size++] = node_index + 1;
+                        node_index = node.offset;
+                    } else {
+                        stack[stack_size++] = node.offset;
+                        node_index = node_index + 1;
+                    }
+                    continue;
+                }
+            }
+
+            if (stack_size == 0)
+                break;
+            node_index = stack[--stack_size];
+        }
+        return false;
+    }
+
+    // Builds the tree over `items`, spheres of `source` or objects of `others`
+    void build(const sphere_batch& source, const std::vector<shared_ptr<hittable>>& others, const std::vector<bvh_item>& items, int max_leaf_size) {
+        std::vector<aabb> boxes;
+        boxes.reserve(items.size());
+        for (const bvh_item& item : items)
+            boxes.push_back(item.is_sphere ? source.box(item.index) : others[item.index]->bounding_box());
+
+        bool all_spheres = others.empty();
+        std::vector<int> order;
+        nodes = bvh_builder(boxes, max_leaf_size, all_spheres ? sphere_batch::lane_count() : 1).build(order);
+        boxes = std::vector<aabb>();
+
+        // Store the objects in leaf order so every leaf covers one contiguous range.
+        // Spheres go into a batch whose indices line up with `primitives`, so a leaf made
+        // only of spheres is a single SIMD loop over that range.
+        spheres = sphere_batch::with_materials_of(source);
+        if (!all_spheres) {
+            owners.reserve(order.size());
+            primitives.reserve(order.size());
+        }
+        for (int index : order) {
+            const bvh_item& item = items[index];
+            if (item.is_sphere) {
+                spheres.append(source, item.index);
+            } else {
+                spheres.add_placeholder();
+            }
+            if (!all_spheres) {
+                owners.push_back(item.is_sphere ? nullptr : others[item.index]);
+                primitives.push_back(owners.back().get());
+            }
+        }
+
+        for (auto& node : nodes) {
+            if (node.count == 0)
+                continue;
+            node.spheres_only = all_spheres || std::all_of(order.begin() + node.offset, order.begin() + node.offset + node.count, [&](int i) { return items[i].is_sphere; });
+        }
+
+        if (source.has_motion())
+            fit_motion_boxes(source, others, items, order);
+    }
+
+    // Replaces the swept node boxes by the boxes at time 0 and stores the boxes at time 1 in
+    // `end_boxes`. Children always come after their parent, so one backward sweep finishes
+    // both children before their parent.
+    void fit_motion_boxes(const sphere_batch& source, const std::vector<shared_ptr<hittable>>& others, const std::vector<bvh_item>& items, const std::vector<int>& order) {
+        auto item_box = [&](int index, real time) {
+            const bvh_item& item = items[index];
+            return item.is_sphere ? source.box_at(item.index, time) : others[item.index]->bounding_box();
+        };
+
+        end_boxes.assign(nodes.size(), aabb());
+        for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; --i) {
+            bvh_flat_node& node = nodes[i];
+            aabb start, end;
+            if (node.count > 0) {
+                for (int k = node.offset; k < node.offset + node.count; ++k) {
+                    start = aabb(start, item_box(order[k], 0));
+                    end = aabb(end, item_box(order[k], 1));
+                }
+            } else {
+                start = aabb(nodes[i + 1].box, nodes[node.offset].box);
+                end = aabb(end_boxes[i + 1], end_boxes[node.offset]);
+            }
+            node.box = start;
+            end_boxes[i] = end;
+        }
+    }
+};
+
+#endif
@@ -1,8 +1,27 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include "arena.hpp"
+#include "async_writer.hpp"
+#include "content_hash.hpp"
+#include "denoiser.hpp"
+#include "framebuffer.hpp"
 #include "hittable.hpp"
+#include "light.hpp"
 #include "material.hpp"
+#include "partial_image.hpp"
+#include "pixel_estimate.hpp"
+#include "preview.hpp"
+#include "render_kernel.hpp"
+#include "sampler.hpp"
+#include "thread_pool.hpp"
+#include "tonemap.hpp"
+#include "wavefront.hpp"
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <utility>
 
 class camera {
 public:
@@ -10,7 +29,8 @@ public:
     double aspect_ratio = 1.0; // Image width divided by height
     int image_width = 100; // Width of the image in pixels
     int samples_per_pixel = 10; // Number of random samples per pixel for anti-aliasing
-    int max_depth = 10; // Maximum recursion depth for ray bouncing
+    int max_depth = 10; // Maximum number of bounces per path
+    int roulette_depth = 0; // Bounces after which Russian roulette may end a path early (0 disables it)
 
     double vertical_fov = 90; // Vertical field of view (in degrees)
     point3 camera_position = point3(0, 0, 0); // Camera position in 3D space
@@ -20,82 +40,130 @@ public:
     double lens_aperture = 0; // Aperture controlling depth of field (defocus blur)
     double focus_distance = 10; // Distance to the focal plane (sharp focus)
 
-    // Renders the scene using the provided world of hittable objects
-    void render(const hittable& scene) {
-        initialize();
-        
-        // Start measuring time
-        auto start_time = std::chrono::high_resolution_clock::now();
-        auto last_update_time = start_time; // Track the last time we updated the log
-
-        std::ofstream output_file("output/image.ppm"); // Open file for output
-
-        if (!output_file) { // Check if the file opened successfully
-            std::cerr << "Error: Could not open output/image.ppm for writing.\n";
-            return;
-        }
-
-        // Write PPM file header
-        output_file << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-
-        // Variables for time estimation
-        int rows_remaining = image_height; // Track rows left to process
-
-        // Loop over each row (scanline) from top to bottom
-        for (int row = 0; row < image_height; ++row) {
-            // Process the current row
-            for (int col = 0; col < image_width; ++col) {
-                color accumulated_color(0, 0, 0); // Initialize color for this pixel
-
-                // Anti-aliasing: Take multiple samples per pixel
-                for (int sample = 0; sample < samples_per_pixel; ++sample) {
-                    ray pixel_ray = generate_ray(col, row); // Generate a ray for this pixel
-                    accumulated_color += trace_ray(pixel_ray, max_depth, scene); // Accumulate color
-                }
-
-                // Write the averaged color to the output file
-                write_color(output_file, scale_color * accumulated_color);
-            }
-
-            // Check if one second has passed since the last update
-            auto current_time = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double> elapsed_since_last_update = current_time - last_update_time;
-
-            if (elapsed_since_last_update.count() >= 1.0) { // Update only once per second at most
-                // Calculate time per row and estimate remaining time
-                std::chrono::duration<double, std::milli> elapsed = current_time - start_time;
-                double avg_time_per_row = elapsed.count() / (row + 1); // Average time per row
-                double remaining_time_ms = avg_time_per_row * (rows_remaining - 1); // Remaining time in ms
-
-                // Format the estimated time remaining
-                int remaining_seconds = static_cast<int>(remaining_time_ms / 1000) % 60;
-                int remaining_minutes = static_cast<int>(remaining_time_ms / (1000 * 60));
-
-                // Log progress with estimated time remaining
-                std::clog << "\rScanlines remaining: " << (image_height - row - 1) << " | Estimated time left: " << remaining_minutes << "m " << remaining_seconds << "s" << std::flush;
-
-                // Update the timestamp for the next log update
-                last_update_time = current_time;
-            }
-
-            rows_remaining--; // Decrement remaining rows
-        }
-
-        output_file.close(); // Close the output file
-        std::clog << "\rDone.                                                                                   \n"; // Log completion
-
-        // Measure and print the total render time
-        auto end_time = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double, std::milli> render_time = end_time - start_time;
-
-        std::cout << "\nImage saved as output/image.ppm\n";
-        std::cout << "Render time: " << std::fixed << std::setprecision(2) << render_time.count() << " ms\n";
+    // Motion blur. Every camera ray gets a time between shutter_open and shutter_close, on the
+    // scale moving spheres are described on (at their start center at time 0, at their end
+    // center at time 1), so each pixel averages what it sees while the shutter is open.
+    // Equal values freeze the scene at that moment. Static scenes render the same either way.
+    // Both must lie in [0, 1]: the BVH bounds moving spheres only in between (render() fails
+    // otherwise).
+    double shutter_open = 0; // Time the shutter opens
+    double shutter_close = 1; // Time the shutter closes
+
+    // Lighting. The sky lights every scene; emissive spheres listed in `lights` (see light.hpp)
+    // are also sampled directly at every diffuse hit, combined with the paths that hit them
+    // by multiple importance sampling.
+    double sky_brightness = 1; // Scale of the sky gradient (0: a black sky, lit by the lights alone)
+    const light_list* lights = nullptr; // Lights of the scene (null or empty: no direct light sampling)
+    bool next_event = true; // Sample the lights directly (off: only paths that happen to hit a light see it)
+
+    int thread_count = 0; // Number of render threads (0 uses every hardware thread)
+    int tile_size = 16; // Width and height of the square tiles the image is split into
+    pixel_order traversal = pixel_order::hilbert; // Order of the pixels within a tile and of the tiles in the image (see pixel_order.hpp)
+    std::uint64_t seed = 0; // Seed for the per-sample random streams; same seed, same image
+    sample_pattern sampler = sample_pattern::random; // Where pixel and lens samples go (see sampler.hpp)
+
+    std::string output_path = "output/image.ppm"; // Image file to write; ".png" selects PNG, anything else binary PPM
+    async_image_writer* image_queue = nullptr; // When set, the image is handed to it to be written while the next render runs
+    bool verbose = true; // Log progress, the output path and the render time
+    std::string stats_path = ""; // Builds with RT_STATS: JSON file for the render counters ("" logs them to stderr)
+    bool wavefront = false; // Trace each tile as a wavefront of paths, shaded in batches per material kind (same samples; see camera_wavefront.hpp)
+
+    // Adaptive sampling (off while adaptive_threshold is 0; see camera_adaptive.hpp).
+    // Pixels are sampled in passes and stop once their estimated on-screen error is below
+    // the threshold; samples_per_pixel becomes the per-pixel maximum.
+    double adaptive_threshold = 0; // Target display-space error per pixel, e.g. 0.005 (about 1/255 on screen)
+    int adaptive_pass_samples = 4; // Samples added to every unconverged pixel per pass
+    int adaptive_min_samples = 8; // Samples every pixel takes before its error estimate is trusted
+    std::uint64_t sample_budget = 0; // Maximum number of samples of the whole render (0: no cap; the first pass always completes)
+    bool progressive_output = false; // Write the partial image to output_path after every pass
+
+    // Deadline mode (off while time_budget is 0). The image is sampled in passes as above, with
+    // every pass sized from the throughput of the one before so the last one ends by the
+    // deadline; a pass that runs over leaves the tiles it has not started with the samples
+    // of the earlier passes. The first pass (one sample per pixel, two with an error
+    // threshold) always completes, so no pixel is left unrendered. Combines with
+    // adaptive_threshold and sample_budget; samples_per_pixel stays the per-pixel maximum.
+    double time_budget = 0; // Seconds from the start of render() until sampling stops (writing the image comes after)
+
+    // Distributed rendering (off while partial_path is empty). The camera renders only rows
+    // [row_begin, row_end) and sample indices [sample_begin, sample_end) of every pixel, and
+    // writes the linear sums of those samples to partial_path instead of an image; see
+    // partial_image.hpp for merging the parts of a frame.
+    std::string partial_path = ""; // Partial framebuffer file to write
+    int row_begin = 0; // First row to render
+    int row_end = 0; // One past the last row to render (0: the image height)
+    int sample_begin = 0; // First sample index of every pixel
+    int sample_end = 0; // One past the last sample index (0: samples_per_pixel)
+
+    // Checkpointing (off while checkpoint_path is empty; see camera_checkpoint.hpp). The
+    // linear sums of every pixel are saved with their sample count to checkpoint_path (a
+    // partial framebuffer of the whole frame) every checkpoint_samples samples per pixel.
+    // A render that finds a checkpoint of the same frame there (same size and
+    // render_key(), so the same scene_key and view) resumes from it and only traces the
+    // samples it lacks, so raising samples_per_pixel later costs only the new samples.
+    std::string checkpoint_path = ""; // Checkpoint file to resume from and save to
+    int checkpoint_samples = 0; // Samples per pixel between checkpoints (0: one checkpoint at the end)
+
+    // Render cache (off while cache_dir is empty; see camera_checkpoint.hpp). Plain
+    // renders of the whole frame keep their linear sums in cache_dir, in a file named
+    // after render_key(): a hash of scene_key, the seed and every setting that changes the
+    // traced samples. A later render with the same key returns the cached image if the
+    // entry has all its samples, and traces only the missing ones (then saves the extended
+    // sums) if it has fewer. Tonemapping comes after the cache, so one entry serves every
+    // display setting. Adaptive, timed, partial, checkpointed and denoised renders bypass
+    // the cache.
+    std::string cache_dir = ""; // Directory of the cache entries (created if missing)
+    std::uint64_t scene_key = 0; // Hash of the scene's contents, e.g. scene_description::content_key() (must be set; checkpoints compare it too)
+
+    tonemap_settings tonemap = {}; // Display pass that turns the linear image into 8-bit RGB (see tonemap.hpp)
+
+    // Denoising (see denoiser.hpp). The camera records the albedo, normal and depth of every
+    // pixel's first hits while rendering and filters the finished image with them.
+    bool denoise = false; // Denoise the image before it is written
+    denoiser_settings denoiser = {}; // Strength of the filter
+    std::string features_path = ""; // Also write the feature buffers as <features_path>_{albedo,normal,depth}.pfm
+
+    // Live preview (off while both paths are empty; see preview.hpp and
+    // camera_preview.hpp). Finished tiles are published as an 8-bit snapshot every
+    // preview_interval seconds, after every adaptive pass or checkpoint step, and once
+    // more with the final image.
+    std::string preview_path = ""; // Image file replaced atomically by every snapshot
+    std::string preview_shm = ""; // POSIX shared-memory name (e.g. "/raytracer") that receives every snapshot
+    double preview_interval = 1.0; // Seconds between snapshots while tiles are being rendered
+
+    // Key of the image render() makes with the current settings (see cache_dir), also stored
+    // in partial framebuffers and checkpoints (partial_image_header::frame_key). Left out are
+    // samples_per_pixel, so an entry can be extended, and the settings that only change how
+    // the work is scheduled (threads, tiles, pixel order, wavefront) or displayed (tonemap).
+    std::uint64_t render_key() const {
+        content_hash hash;
+        hash.add(cache_version).add(sizeof(real)).add(scene_key).add(seed);
+        hash.add(aspect_ratio).add(image_width).add(max_depth).add(roulette_depth);
+        hash.add(vertical_fov).add(camera_position).add(focus_point).add(up_direction);
+        hash.add(lens_aperture).add(focus_distance).add(shutter_open).add(shutter_close);
+        hash.add(sky_brightness).add(sampler).add(next_event && lights && !lights->empty());
+        return hash.value();
     }
 
+    // Renders the scene using the provided world of hittable objects. Returns false, after a
+    // message on std::cerr, if the settings conflict or the image, partial framebuffer,
+    // checkpoint, feature buffers or preview could not be written. A render cache entry that
+    // cannot be saved only warns (the image is still written), and an image handed to
+    // image_queue reports its failure there.
+    bool render(const hittable& scene);
+
 private:
+    // Version of the images render_key() describes. Bump it when a change to the renderer
+    // changes the samples it traces, so entries made by older builds are not reused.
+    static constexpr std::uint32_t cache_version = 1;
+
     // Private member variables
     int image_height = {}; // Height of the image (derived from width and aspect ratio)
-    double scale_color = {}; // Scaling factor for averaging pixel samples
+    int first_row = {}; // Rows [first_row, last_row) are rendered
+    int last_row = {};
+    int first_sample = {}; // Sample indices [first_sample, last_sample) are traced for every pixel
+    int last_sample = {};
+    real scale_color = {}; // Scaling factor for averaging pixel samples (1 for partial and checkpointed frames, which keep the sums)
     point3 upper_left_pixel = {}; // World space location of the upper-left corner of the image
     vec3 horizontal_pixel_step = {}; // Vector step to move one pixel to the right
     vec3 vertical_pixel_step = {}; // Vector step to move one pixel down
@@ -104,6 +172,43 @@ private:
     vec3 camera_basis_w = {}; // Camera coordinate system basis vectors
     vec3 aperture_disk_u = {}; // Aperture disk basis vectors for lens blur
     vec3 aperture_disk_v = {}; // Aperture disk basis vectors for lens blur
+    std::unique_ptr<thread_pool> workers = {}; // Render threads, kept alive across renders
+    framebuffer render_image = {}; // The image being rendered, reused by the next render of the same size
+    std::vector<tile> tiles = {}; // Tiles of the rows to render, kept while tiles_key is unchanged
+    std::vector<pixel_offset> tile_pixels = {}; // Pixels of a whole tile in traversal order; clipped tiles skip the ones they lack
+    std::array<int, 5> tiles_key = {}; // first_row, last_row, tile_size, image_width and traversal the tiles were made for
+    std::unique_ptr<preview_stream> preview = {}; // Live preview outputs of the current render (null: none)
+    memory_arena frame_arena = memory_arena(1 << 20); // Scratch memory of one render (tile flags, adaptive estimates), rewound by the next
+    framebuffer preview_image = {}; // Latest mean of every pixel the preview has seen (black until its tile finishes)
+    const std::vector<double>* preview_sums = nullptr; // Sums of earlier checkpoint steps, added to the finished tiles
+    real preview_scale = 1; // Turns a finished tile's values (plus preview_sums) into means
+    std::chrono::steady_clock::time_point last_preview = {}; // When the last snapshot was published
+
+    // The tile loops of one render_kernel instantiation (see render_kernel.hpp)
+    struct kernel_table {
+        void (camera::*depth_first_tile)(const tile&, const hittable&, framebuffer&, feature_buffers*) const = nullptr; // render_tile
+        void (camera::*wavefront_tile)(const tile&, const hittable&, framebuffer&, feature_buffers*) const = nullptr; // render_tile_wavefront
+        void (camera::*adaptive_tile)(const tile&, const hittable&, framebuffer&, pixel_estimate*, int, std::uint64_t&, std::uint64_t&) const = nullptr; // render_tile_adaptive
+    };
+    const kernel_table* kernels = nullptr; // Kernels matching the settings, chosen by initialize()
+
+    // The kernel tables of every render_kernel, indexed as render_kernel_at counts them
+    template <size_t... index>
+    static const kernel_table* make_kernel_tables(std::index_sequence<index...>) {
+        static const kernel_table tables[] = {kernel_table{
+            &camera::render_tile<render_kernel_at<int(index)>>,
+            &camera::render_tile_wavefront<render_kernel_at<int(index)>>,
+            &camera::render_tile_adaptive<render_kernel_at<int(index)>>,
+        }...};
+        return tables;
+    }
+
+    // Picks the kernels for the current settings: the branches on them are compiled out of
+    // every ray and bounce of the render.
+    void select_kernels() {
+        static const kernel_table* tables = make_kernel_tables(std::make_index_sequence<render_kernel_count>());
+        kernels = &tables[render_kernel_index(lens_aperture > 0, next_event && lights && !lights->empty(), roulette_depth > 0)];
+    }
 
     // Initializes the camera properties and viewport
     void initialize() {
@@ -111,7 +216,15 @@ private:
         image_height = static_cast<int>(image_width / aspect_ratio);
         image_height = std::max(1, image_height); // Ensure height is at least 1 pixel
 
-        scale_color = 1.0 / samples_per_pixel; // Scale factor for color averaging
+        // The part of the frame to render: all of it unless a partial framebuffer was asked for
+        bool partial = !partial_path.empty();
+        first_row = partial ? std::clamp(row_begin, 0, image_height) : 0;
+        last_row = partial && row_end > 0 ? std::clamp(row_end, first_row, image_height) : image_height;
+        first_sample = partial ? std::clamp(sample_begin, 0, samples_per_pixel) : 0;
+        last_sample = partial && sample_end > 0 ? std::clamp(sample_end, first_sample, samples_per_pixel) : samples_per_pixel;
+
+        // Scale factor for color averaging; partial, checkpointed and cached frames keep the sums
+        scale_color = partial || !checkpoint_path.empty() || uses_cache() ? 1.0 : 1.0 / samples_per_pixel;
 
         // Calculate field of view in radians and the viewport dimensions
         double theta = degrees_to_radians(vertical_fov);
@@ -139,57 +252,283 @@ private:
         double aperture_radius = focus_distance * std::tan(degrees_to_radians(lens_aperture / 2));
         aperture_disk_u = aperture_radius * camera_basis_u;
         aperture_disk_v = aperture_radius * camera_basis_v;
+
+        select_kernels();
     }
 
-    // Generates a ray for a specific pixel (col, row) with optional lens blur
-    ray generate_ray(int col, int row) const {
-        // Random offset for anti-aliasing
-        vec3 pixel_offset = sample_unit_square();
+    // The render modes, defined in the headers included at the end of this file
+
+    // camera_render.hpp: the tiles of a frame and the threads that render them
+    void render_samples(const hittable& scene, const std::vector<tile>& tiles, framebuffer& image, feature_buffers* features, std::chrono::high_resolution_clock::time_point start_time, const std::string& label);
+    template <typename tile_function>
+    void run_tiles(const std::vector<tile>& tiles, const framebuffer& image, std::chrono::high_resolution_clock::time_point start_time, const std::string& label, tile_function render_region);
+#ifdef RT_STATS
+    void report_stats() const;
+#endif
+
+    // camera_preview.hpp: snapshots of the render in progress
+    bool open_preview(bool partial);
+    void copy_finished_tiles(const std::vector<tile>& tiles, const framebuffer& image, const std::atomic<bool>* finished, bool* copied);
+    void publish_preview(bool final);
+
+    // camera_adaptive.hpp: adaptive sampling and time budgets
+    bool render_adaptive(const hittable& scene, const std::vector<tile>& tiles, framebuffer& image, std::chrono::steady_clock::time_point deadline);
+    template <typename kernel>
+    void render_tile_adaptive(const tile& region, const hittable& scene, framebuffer& image, pixel_estimate* estimates, int samples_this_pass, std::uint64_t& taken, std::uint64_t& active) const;
+
+    // camera_checkpoint.hpp: partial frames, checkpoints and the render cache
+    bool uses_cache() const;
+    std::string cache_entry() const;
+    partial_image make_partial(const framebuffer& image) const;
+    bool render_checkpointed(const hittable& scene, const std::vector<tile>& tiles, framebuffer& image, const std::string& path, bool cached);
+
+    // camera_wavefront.hpp: tiles traced as wavefronts of paths
+    template <typename kernel>
+    void render_tile_wavefront(const tile& region, const hittable& scene, framebuffer& image, feature_buffers* features) const;
+    template <typename kernel, typename material_type>
+    void scatter_queue(wavefront_buffers& buffers, const hittable& scene, material_kind kind, int bounce) const;
+
+    // Renders every pixel of one tile into the framebuffer, and the first-hit features of
+    // every pixel into `features` unless it is null
+    template <typename kernel>
+    void render_tile(const tile& region, const hittable& scene, framebuffer& image, feature_buffers* features) const {
+        for (pixel_offset offset : tile_pixels) {
+            int col = region.x0 + offset.x, row = region.y0 + offset.y;
+            if (col >= region.x1 || row >= region.y1)
+                continue; // Outside a tile clipped by the image border
+            color accumulated_color(0, 0, 0); // Initialize color for this pixel
+            pixel_features first_hits; // Feature sums of this pixel's camera rays
+            std::uint64_t pixel_index = static_cast<std::uint64_t>(row) * image_width + col;
+
+            // Anti-aliasing: Take multiple samples per pixel
+            for (int sample = first_sample; sample < last_sample; ++sample) {
+                // Every sample gets its own generator, so the result is independent of scheduling
+                rng gen = rng::for_sample(seed, pixel_index, sample);
+                ray pixel_ray = camera_ray<kernel>(col, row, sample, gen); // Generate a ray for this pixel
+                accumulated_color += trace_ray<kernel>(pixel_ray, max_depth, scene, gen, features ? &first_hits : nullptr); // Accumulate color
+            }
+
+            // Store the averaged color
+            image.at(col, row) = scale_color * accumulated_color;
+            if (features) {
+                first_hits.scale(real(1.0 / (last_sample - first_sample)));
+                features->at(col, row) = first_hits;
+            }
+        }
+    }
+
+    // generate_ray() timed as the camera_rays phase in builds with RT_STATS
+    template <typename kernel>
+    ray camera_ray(int col, int row, int sample, rng& gen) const {
+        RT_STAT_TIMER(stats_phase::camera_rays);
+        return generate_ray<kernel>(col, row, sample, gen);
+    }
+
+    // Generates the ray of sample `sample` of pixel (col, row), with lens blur if the kernel has
+    // depth of field
+    template <typename kernel>
+    ray generate_ray(int col, int row, int sample, rng& gen) const {
+        // Pattern points of this sample: dimension 0 for the pixel, 1 for the lens
+        double pixel_u, pixel_v, lens_u = 0, lens_v = 0;
+        if (sampler == sample_pattern::random) {
+            pixel_u = gen.next_double();
+            pixel_v = gen.next_double();
+        } else {
+            std::uint64_t pixel_seed = mix64(seed + mix64(static_cast<std::uint64_t>(row) * image_width + col));
+            pattern_sample(sampler, pixel_seed, static_cast<std::uint32_t>(sample), 0, pixel_u, pixel_v);
+            pattern_sample(sampler, pixel_seed, static_cast<std::uint32_t>(sample), 1, lens_u, lens_v);
+        }
+
+        // Offset for anti-aliasing
+        vec3 pixel_offset = sample_unit_square(pixel_u, pixel_v);
 
         // Calculate the target location in the scene for the current pixel
         point3 target_pixel = upper_left_pixel + (col + pixel_offset.x()) * horizontal_pixel_step + (row + pixel_offset.y()) * vertical_pixel_step;
 
         // Calculate the ray's origin (accounting for lens blur)
-        point3 ray_origin = (lens_aperture > 0) ? sample_aperture_disk() : camera_position;
+        point3 ray_origin = camera_position;
+        if constexpr (kernel::depth_of_field)
+            ray_origin = sampler == sample_pattern::random ? sample_aperture_disk(gen) : aperture_point(disk_from_square(real(lens_u), real(lens_v)));
 
-        // Ray direction from origin to target pixel
-        vec3 ray_direction = target_pixel - ray_origin;
+        // Ray direction from origin to target pixel, normalized once here so intersection
+        // tests can take the direction's length as 1
+        vec3 ray_direction = unit_vector(target_pixel - ray_origin);
+
+        return ray(ray_origin, ray_direction, shutter_time(col, row, sample)); // Return the generated ray
+    }
 
-        return ray(ray_origin, ray_direction); // Return the generated ray
+    // Time of sample `sample` of pixel (col, row) within the shutter interval. Sample patterns
+    // spread the times of a pixel evenly with their third dimension; independent samples take
+    // theirs from a hash of the pixel and the sample instead of the sample's generator, so
+    // the generator's sequence, and the image of a static scene, stay as they were.
+    real shutter_time(int col, int row, int sample) const {
+        if (shutter_close == shutter_open)
+            return real(shutter_open);
+
+        std::uint64_t pixel_seed = mix64(seed + mix64(static_cast<std::uint64_t>(row) * image_width + col));
+        double u, v;
+        if (sampler == sample_pattern::random)
+            u = (mix64(pixel_seed ^ mix64(~static_cast<std::uint64_t>(sample))) >> 11) * 0x1.0p-53;
+        else
+            pattern_sample(sampler, pixel_seed, static_cast<std::uint32_t>(sample), 2, u, v);
+        return real(shutter_open + u * (shutter_close - shutter_open));
     }
 
-    // Samples a random point within a unit square for anti-aliasing
-    vec3 sample_unit_square() const {
-        return vec3(random_double() - 0.5, random_double() - 0.5, 0);
+    // Offset within the pixel, centered on it, of the point (u, v) of the unit square
+    vec3 sample_unit_square(double u, double v) const {
+        return vec3(u - 0.5, v - 0.5, 0);
     }
 
     // Samples a random point within the aperture disk for depth of field simulation
-    point3 sample_aperture_disk() const {
-        vec3 random_point = random_in_unit_disk();
-        return camera_position + random_point.x() * aperture_disk_u + random_point.y() * aperture_disk_v;
+    point3 sample_aperture_disk(rng& gen) const {
+        return aperture_point(random_in_unit_disk(gen));
     }
 
-    // Traces a ray through the scene, returning the color based on intersections
-    color trace_ray(const ray& r, int depth, const hittable& scene) const {
-        if (depth <= 0) // Stop recursion if max depth is reached
-            return color(0, 0, 0); // Return black (no more light)
+    // Point of the lens at `disk_point` of the unit disk
+    point3 aperture_point(const vec3& disk_point) const {
+        return camera_position + disk_point.x() * aperture_disk_u + disk_point.y() * aperture_disk_v;
+    }
+
+    // Traces a path through the scene and returns the light it carries back to the camera.
+    // The path is followed in a loop rather than by recursion: `throughput` is the product of
+    // the attenuations met so far, and the light found along the way (emitters hit, lights
+    // sampled at diffuse hits, the background seen at the end) is scaled by it. The first hit
+    // (or miss) is added to `first_hit` unless it is null.
+    template <typename kernel>
+    color trace_ray(const ray& r, int depth, const hittable& scene, rng& gen, pixel_features* first_hit = nullptr) const {
+        ray current = r; // Ray of the current path segment
+        color throughput(1, 1, 1); // Fraction of light that survives the bounces so far
+        color radiance(0, 0, 0); // Light gathered so far
+        real bsdf_pdf = 0; // Density the last bounce chose `current` with, if lights were also sampled there (0: not)
+        hit_record record = {}; // Record of the intersection, reused for every bounce
+
+        for (int bounce = 0; bounce < depth; ++bounce) {
+            // A path that escapes the scene sees the background
+            bool hit = intersect(scene, current, bounce, record);
+            if (first_hit && bounce == 0)
+                first_hit->add(hit ? &record : nullptr);
+            if (!hit) {
+                RT_STAT(stats.end_path(bounce));
+                return radiance + throughput * background(current);
+            }
+            if (record.mat->kind == material_kind::diffuse_light)
+                radiance += throughput * emission(current, record, bsdf_pdf);
 
-        hit_record record = {}; // Record of the intersection
+            // Light arriving directly from the lights, sampled before the material draws its
+            // own numbers (the wavefront renderer keeps the same order)
+            bool sample_lights = sample_lights_at<kernel>(record);
+            if (sample_lights)
+                radiance += throughput * direct_light(record, *static_cast<const lambertian*>(record.mat), current.time(), scene, gen);
 
-        // Check for intersection with the scene
-        if (scene.hit(r, interval(0.001, infinity), record)) {
             ray scattered; // Scattered ray after intersection
             color attenuation; // How much the material attenuates light
-            if (record.mat->scatter(r, record, attenuation, scattered))
-                return attenuation * trace_ray(scattered, depth - 1, scene); // Recursively trace
-            return color(0, 0, 0); // Return black if no scattering
+            bool scatters;
+            {
+                RT_STAT_TIMER(stats_phase::scatter);
+                RT_STAT(stats.scatters[static_cast<int>(record.mat->kind)]++);
+                scatters = visit_material(*record.mat, [&](const auto& mat) { return mat.scatter(current, record, attenuation, scattered, gen); });
+            }
+            if (!scatters) {
+                RT_STAT(stats.absorbed++; stats.end_path(bounce + 1));
+                return radiance; // Absorbed: no more light along this path
+            }
+            throughput = throughput * attenuation;
+            bsdf_pdf = sample_lights ? lambertian::pdf(record, scattered.direction()) : 0;
+            current = scattered;
+
+            if (!survives_roulette<kernel>(bounce, throughput, gen))
+                return radiance;
         }
 
-        // If no hit, compute background color (gradient from white to blue)
-        vec3 unit_direction = unit_vector(r.direction());
-        double t = 0.5 * (unit_direction.y() + 1.0);
-        return (1.0 - t) * color(1.0, 1.0, 1.0) + t * color(0.5, 0.7, 1.0);
+        RT_STAT(stats.end_path(depth));
+        return radiance; // Maximum depth reached: no more light
+    }
+
+    // True if next-event estimation samples the lights at `record`. Only diffuse surfaces
+    // sample them: a mirror or glass reflects light from a single direction, which a light
+    // sample never hits. Kernels without next_event never sample them.
+    template <typename kernel>
+    bool sample_lights_at(const hit_record& record) const {
+        return kernel::next_event && record.mat->kind == material_kind::lambertian;
+    }
+
+    // Radiance of the emitter hit in `record` toward `r`, weighed against the chance that the
+    // light sample at the previous bounce found the same point. `bsdf_pdf` is the density
+    // the previous bounce scattered `r` with, or 0 if it did not sample the lights; then the
+    // hit is the only way this light reaches the path and counts in full.
+    color emission(const ray& r, const hit_record& record, real bsdf_pdf) const {
+        color emitted = static_cast<const diffuse_light*>(record.mat)->emitted(record);
+        if (bsdf_pdf <= 0)
+            return emitted;
+        return emitted * power_heuristic(bsdf_pdf, lights->pdf(r.origin(), record.p, r.time()));
+    }
+
+    // Next-event estimation at a diffuse hit made at `time`: samples a point on one light and
+    // returns the light it sends to the camera through this hit if the shadow ray reaches it,
+    // weighed against the chance that the scattered ray finds the same point.
+    color direct_light(const hit_record& record, const lambertian& mat, real time, const hittable& scene, rng& gen) const {
+        light_sample sample;
+        if (!lights->sample(record.p, time, gen, sample) || dot(record.normal, sample.direction) <= 0)
+            return color(0, 0, 0);
+
+        // The shadow ray stops just short of the light, which would otherwise block itself
+        ray shadow_ray(record.p, sample.direction, time);
+        if (occluded(scene, shadow_ray, sample.distance - real(0.001)))
+            return color(0, 0, 0);
+
+        real weight = power_heuristic(sample.pdf, lambertian::pdf(record, sample.direction));
+        return mat.evaluate(record, sample.direction) * sample.radiance * (weight / sample.pdf);
+    }
+
+    // Finds the closest hit of `r`, which is the ray of bounce `bounce` of its path.
+    // Only a wrapper around scene.hit() that builds with RT_STATS count and time.
+    bool intersect(const hittable& scene, const ray& r, [[maybe_unused]] int bounce, hit_record& record) const {
+        RT_STAT_TIMER(stats_phase::intersect);
+        RT_STAT(stats.rays++; (bounce == 0 ? stats.primary_rays : stats.secondary_rays)++);
+        bool hit = scene.hit(r, interval(0.001, infinity), record);
+        RT_STAT(stats.misses += hit ? 0 : 1);
+        return hit;
+    }
+
+    // Returns true if anything blocks the shadow ray `r` before `distance`. Builds with
+    // RT_STATS count it and time it as intersection work.
+    bool occluded(const hittable& scene, const ray& r, real distance) const {
+        RT_STAT_TIMER(stats_phase::intersect);
+        bool blocked = distance > real(0.001) && scene.occluded(r, interval(0.001, distance));
+        RT_STAT(stats.shadow_rays++; stats.shadowed += blocked ? 1 : 0);
+        return blocked;
+    }
+
+    // Color of the sky seen along `r` (gradient from white to blue, scaled by sky_brightness)
+    color background(const ray& r) const {
+        real t = real(0.5) * (r.direction().y() + 1); // The direction is a unit vector
+        return real(sky_brightness) * ((1 - t) * color(1.0, 1.0, 1.0) + t * color(0.5, 0.7, 1.0));
+    }
+
+    // Russian roulette: past `roulette_depth` bounces, ends dim paths at random and boosts
+    // the survivors by the same factor, which keeps the estimate unbiased. Returns false if
+    // the path ends here; always true for kernels without russian_roulette.
+    template <typename kernel>
+    bool survives_roulette(int bounce, color& throughput, rng& gen) const {
+        if constexpr (!kernel::russian_roulette)
+            return true;
+        if (bounce + 1 < roulette_depth)
+            return true;
+        real survival = std::fmin(real(0.95), std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z())));
+        if (gen.next_double() >= survival) {
+            RT_STAT(stats.roulette_kills++; stats.end_path(bounce + 1));
+            return false;
+        }
+        throughput /= survival;
+        return true;
     }
 };
 
-#endif
\ No newline at end of file
+// The render modes (see the declarations above)
+#include "camera_render.hpp"
+#include "camera_preview.hpp"
+#include "camera_adaptive.hpp"
+#include "camera_checkpoint.hpp"
+#include "camera_wavefront.hpp"
+
+#endif
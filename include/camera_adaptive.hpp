@@ -0,0 +1,137 @@
+#ifndef CAMERA_ADAPTIVE_H
+#define CAMERA_ADAPTIVE_H
+
+#include "camera.hpp"
+#include "image_writer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Progressive rendering: adaptive sampling and time budgets (camera::adaptive_threshold,
+// camera::time_budget). Both sample the frame in passes and keep a running estimate of every
+// pixel (see pixel_estimate.hpp) instead of summing a fixed number of samples.
+
+// Adaptive sampling: renders in passes of `adaptive_pass_samples` samples per pixel and
+// stops sampling a pixel once it has `adaptive_min_samples` samples and its
+// display_error() drops below `adaptive_threshold`, or once it has `samples_per_pixel`
+// samples. `sample_budget` caps the total number of samples (0: no cap; the first pass
+// exceeds a budget below its one or two samples per pixel), and with a `time_budget`
+// sampling stops at `deadline`: every pass after the first is shrunk to the samples the
+// time left affords at the measured rate. Every pass writes the current means into
+// `image`, and with `progressive_output` also to the output file. Returns false if a write
+// failed.
+inline bool camera::render_adaptive(const hittable& scene, const std::vector<tile>& tiles, framebuffer& image, std::chrono::steady_clock::time_point deadline) {
+    size_t pixel_count = static_cast<size_t>(image_width) * image_height;
+    pixel_estimate* estimates = frame_arena.make_array<pixel_estimate>(pixel_count);
+    bool thresholded = adaptive_threshold > 0;
+    bool timed = time_budget > 0;
+    int pass_samples = thresholded ? std::max(2, adaptive_pass_samples) : std::max(1, adaptive_pass_samples); // The error estimate needs two samples
+    std::uint64_t samples_taken = 0;
+    std::uint64_t active_pixels = pixel_count;
+    double seconds_per_sample = 0; // Wall-clock cost of one sample in the last pass, on all threads together
+    bool out_of_time = false;
+
+    for (int pass = 1; active_pixels > 0; ++pass) {
+        // A timed render covers the image with as few samples as it can first
+        int samples_this_pass = timed && pass == 1 ? (thresholded ? 2 : 1) : pass_samples;
+
+        // Shrink the last passes so the total stays inside the budget. The first pass keeps
+        // the samples every pixel needs (one, or two for the error estimate), so a budget
+        // below that still leaves no pixel unrendered.
+        if (sample_budget > 0) {
+            std::uint64_t left = sample_budget > samples_taken ? sample_budget - samples_taken : 0;
+            int least = pass == 1 ? (thresholded ? 2 : 1) : 0;
+            samples_this_pass = static_cast<int>(std::max<std::uint64_t>(least, std::min<std::uint64_t>(samples_this_pass, left / active_pixels)));
+            if (samples_this_pass == 0)
+                break;
+        }
+
+        // ... and inside the time left, at the rate of the last pass
+        if (timed && pass > 1) {
+            double seconds_left = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+            double affordable = seconds_left > 0 ? seconds_left / seconds_per_sample : 0;
+            samples_this_pass = static_cast<int>(std::min<double>(samples_this_pass, affordable / double(active_pixels)));
+            if (samples_this_pass == 0) {
+                out_of_time = true;
+                break;
+            }
+        }
+
+        // Past the deadline, tiles not started yet keep their earlier samples (never in
+        // the first pass, which every pixel needs)
+        std::atomic<std::uint64_t> pass_taken(0), pass_active(0), tiles_skipped(0);
+        auto pass_start = std::chrono::high_resolution_clock::now();
+        run_tiles(tiles, image, pass_start, "Pass " + std::to_string(pass) + ": ", [&](const tile& region) {
+            if (timed && pass > 1 && std::chrono::steady_clock::now() >= deadline) {
+                tiles_skipped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            std::uint64_t taken = 0, active = 0;
+            (this->*kernels->adaptive_tile)(region, scene, image, estimates, samples_this_pass, taken, active);
+            pass_taken.fetch_add(taken, std::memory_order_relaxed);
+            pass_active.fetch_add(active, std::memory_order_relaxed);
+        });
+        std::chrono::duration<double> pass_time = std::chrono::high_resolution_clock::now() - pass_start;
+
+        samples_taken += pass_taken.load();
+        active_pixels = pass_active.load();
+        seconds_per_sample = pass_time.count() / double(std::max<std::uint64_t>(1, pass_taken.load()));
+        out_of_time = tiles_skipped.load() > 0;
+        if (verbose)
+            std::clog << "\rPass " << pass << ": " << active_pixels << " pixels still sampling"
+                      << (out_of_time ? " (out of time)" : "") << "                                        \n";
+        if (out_of_time)
+            break; // The image is complete; the next pass would only start late
+
+        // Progressive output: the partial image after every pass
+        if (active_pixels > 0)
+            publish_preview(false);
+        if (progressive_output && active_pixels > 0 && !make_image_writer(output_path)->write(output_path, image_width, image_height, tonemap_to_rgb8(image, tonemap))) {
+            std::cerr << "Error: Could not write " << output_path << ".\n";
+            return false;
+        }
+    }
+
+    std::uint64_t fixed_samples = static_cast<std::uint64_t>(samples_per_pixel) * pixel_count;
+    if (verbose && thresholded)
+        std::cout << "Adaptive sampling: " << samples_taken << " samples (" << std::fixed << std::setprecision(1)
+                  << 100.0 * double(samples_taken) / double(fixed_samples) << "% of " << fixed_samples << ")\n";
+    if (verbose && timed)
+        std::cout << "Time budget: " << std::fixed << std::setprecision(1) << double(samples_taken) / double(pixel_count)
+                  << " samples per pixel on average" << (out_of_time ? ", stopped by the deadline" : ", finished before the deadline") << "\n";
+    return true;
+}
+
+// One adaptive pass over a tile: adds up to `samples_this_pass` samples to every pixel of
+// `region` that has not converged and writes its mean into `image`. Adds the samples
+// taken to `taken` and the pixels still sampling to `active`.
+template <typename kernel>
+void camera::render_tile_adaptive(const tile& region, const hittable& scene, framebuffer& image, pixel_estimate* estimates, int samples_this_pass, std::uint64_t& taken, std::uint64_t& active) const {
+    for (pixel_offset offset : tile_pixels) {
+        int col = region.x0 + offset.x, row = region.y0 + offset.y;
+        if (col >= region.x1 || row >= region.y1)
+            continue; // Outside a tile clipped by the image border
+        std::uint64_t pixel_index = static_cast<std::uint64_t>(row) * image_width + col;
+        pixel_estimate& estimate = estimates[pixel_index];
+        if (estimate.converged)
+            continue;
+
+        // Sample indices continue where the last pass stopped, so every sample
+        // of a pixel uses its own generator exactly as in the fixed mode
+        int end = std::min(estimate.samples + samples_this_pass, samples_per_pixel);
+        for (int sample = estimate.samples; sample < end; ++sample) {
+            rng gen = rng::for_sample(seed, pixel_index, sample);
+            estimate.add(trace_ray<kernel>(camera_ray<kernel>(col, row, sample, gen), max_depth, scene, gen));
+            ++taken;
+        }
+
+        estimate.converged = estimate.samples >= samples_per_pixel ||
+                             (estimate.samples >= adaptive_min_samples && estimate.display_error() < adaptive_threshold);
+        active += estimate.converged ? 0 : 1;
+        image.at(col, row) = estimate.mean();
+    }
+}
+
+#endif
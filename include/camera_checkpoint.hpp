@@ -0,0 +1,148 @@
+#ifndef CAMERA_CHECKPOINT_H
+#define CAMERA_CHECKPOINT_H
+
+#include "camera.hpp"
+#include "partial_image.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// Renders that keep the linear sums of their samples (see partial_image.hpp): partial frames
+// for merge_partials, checkpoints that a later render resumes, and the render cache, whose
+// entries are checkpoints named after camera::render_key().
+
+// True if render() goes through the render cache: there is one, and the render is a plain
+// render of the whole frame.
+inline bool camera::uses_cache() const {
+    return !cache_dir.empty() && partial_path.empty() && checkpoint_path.empty() && adaptive_threshold <= 0 && time_budget <= 0 &&
+           !denoise && features_path.empty();
+}
+
+// The render cache entry of this render, named after render_key(), or "" if the render
+// bypasses the cache. Creates the cache directory if it is missing.
+inline std::string camera::cache_entry() const {
+    if (!uses_cache()) {
+        if (!cache_dir.empty() && verbose)
+            std::clog << "Render cache skipped: only plain renders of the whole frame are cached\n";
+        return "";
+    }
+    std::error_code error;
+    std::filesystem::create_directories(cache_dir, error); // A directory that cannot be made fails at the first save
+    std::ostringstream name;
+    name << cache_dir << "/" << std::hex << std::setw(16) << std::setfill('0') << render_key() << ".rtpf";
+    return name.str();
+}
+
+// The rendered band of `image` as a partial framebuffer (image holds sums, see scale_color).
+inline partial_image camera::make_partial(const framebuffer& image) const {
+    partial_image part;
+    std::memcpy(part.header.magic, partial_image_magic, sizeof(part.header.magic));
+    part.header.version = partial_image_version;
+    part.header.width = image_width;
+    part.header.height = image_height;
+    part.header.row_begin = first_row;
+    part.header.row_end = last_row;
+    part.header.sample_begin = first_sample;
+    part.header.sample_end = last_sample;
+    part.header.frame_samples = samples_per_pixel;
+    part.header.seed = seed;
+    part.header.frame_key = render_key();
+    part.sums.reserve(static_cast<size_t>(last_row - first_row) * image_width * 3);
+    for (int row = first_row; row < last_row; ++row) {
+        for (int col = 0; col < image_width; ++col) {
+            const color& sum = image.at(col, row);
+            part.sums.insert(part.sums.end(), {double(sum.x()), double(sum.y()), double(sum.z())});
+        }
+    }
+    return part;
+}
+
+// Checkpointed rendering: resumes from `path` if it holds an earlier render of this frame,
+// then traces the missing samples in steps of checkpoint_samples, saving the sums after
+// every step. Leaves the mean of every pixel in `image`. Returns false if the checkpoint
+// could not be read or written.
+//
+// A render cache entry (`cached`) is extended the same way in a single step. An entry
+// that cannot be used, or holds more samples than asked for, is rendered over and left
+// as it is; an entry that cannot be saved only costs the next render its samples.
+inline bool camera::render_checkpointed(const hittable& scene, const std::vector<tile>& tiles, framebuffer& image, const std::string& path, bool cached) {
+    std::vector<double> sums(image.pixels.size() * 3, 0.0);
+    int done = 0;
+    bool save = true;
+    if (std::ifstream(path, std::ios::binary).peek() != std::char_traits<char>::eof()) {
+        partial_image saved;
+        bool readable = saved.read(path);
+        if (!readable && !cached)
+            return false;
+        const partial_image_header& h = saved.header;
+        if (!readable || h.width != image_width || h.height != image_height || h.row_begin != 0 || h.row_end != image_height || h.sample_begin != 0 || h.seed != seed || h.frame_key != render_key()) {
+            if (!cached) {
+                std::cerr << "Error: " << path << " is a checkpoint of a different frame.\n";
+                return false;
+            }
+            std::cerr << "Warning: Ignoring the render cache entry " << path << ".\n";
+        } else if (cached && h.sample_end > samples_per_pixel) {
+            save = false;
+            if (verbose)
+                std::clog << "Render cache: " << path << " holds more samples (" << h.sample_end << ") than asked for; rendering without it\n";
+        } else {
+            sums = std::move(saved.sums);
+            done = h.sample_end;
+            if (preview) {
+                real scale = real(1.0 / done); // The preview starts from the resumed image
+                for (size_t i = 0; i < image.pixels.size(); ++i)
+                    preview_image.pixels[i] = scale * color(sums[3 * i], sums[3 * i + 1], sums[3 * i + 2]);
+            }
+            if (verbose && cached)
+                std::clog << "Render cache: " << path << " holds " << done << " of " << samples_per_pixel << " samples per pixel\n";
+            else if (verbose)
+                std::clog << "Resuming from " << path << " with " << done << " samples per pixel\n";
+        }
+    }
+
+    int step = checkpoint_samples > 0 && !cached ? checkpoint_samples : samples_per_pixel;
+    while (done < samples_per_pixel) {
+        first_sample = done;
+        last_sample = std::min(done + step, samples_per_pixel);
+        preview_sums = &sums; // Finished tiles of this step show all the samples so far
+        preview_scale = real(1.0 / last_sample);
+        render_samples(scene, tiles, image, nullptr, std::chrono::high_resolution_clock::now(),
+                       "Samples " + std::to_string(first_sample) + "-" + std::to_string(last_sample) + ": ");
+
+        // Add this step's sums and save them; the rename keeps the old checkpoint intact until the new one is complete
+        for (size_t i = 0; i < image.pixels.size(); ++i)
+            for (int c = 0; c < 3; ++c)
+                sums[3 * i + c] += image.pixels[i][c];
+        done = last_sample;
+
+        first_sample = 0;
+        publish_preview(false);
+        if (!save)
+            continue;
+        partial_image checkpoint = make_partial(image);
+        checkpoint.sums = sums;
+        std::string temporary_path = path + (cached ? "." + std::to_string(getpid()) : "") + ".tmp"; // Renders sharing a cache save apart
+        if (!checkpoint.write(temporary_path) || std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+            std::remove(temporary_path.c_str());
+            std::cerr << "\n" << (cached ? "Warning" : "Error") << ": Could not write " << path << ".\n";
+            if (!cached)
+                return false;
+            save = false;
+        }
+    }
+    preview_sums = nullptr;
+
+    // Same scaling as render_tile and merge_partials
+    real scale = real(1.0 / done);
+    for (size_t i = 0; i < image.pixels.size(); ++i)
+        image.pixels[i] = scale * color(sums[3 * i], sums[3 * i + 1], sums[3 * i + 2]);
+    return true;
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef CAMERA_PREVIEW_H
+#define CAMERA_PREVIEW_H
+
+#include "camera.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+// Live preview of camera::render() (see preview.hpp for the outputs). run_tiles() wakes up
+// every preview_interval seconds while the workers trace tiles, copies the tiles they have
+// finished into the preview image and publishes it as the next snapshot.
+
+// Opens the preview outputs before the first ray of a render is traced, or keeps the last
+// render's ones if they are the same; pixels of unfinished tiles then keep showing the
+// previous frame of an animation. Without outputs the preview is off. Returns false if an
+// output could not be opened.
+inline bool camera::open_preview(bool partial) {
+    if (preview_path.empty() && preview_shm.empty()) {
+        preview.reset();
+        return true;
+    }
+    if (!preview || !preview->opened_as(preview_path, preview_shm, image_width, image_height)) {
+        preview = std::make_unique<preview_stream>();
+        if (!preview->open(preview_path, preview_shm, image_width, image_height)) {
+            preview.reset();
+            return false;
+        }
+        preview_image = framebuffer(image_width, image_height);
+    }
+    preview_sums = nullptr;
+    preview_scale = partial ? real(1.0 / std::max(1, last_sample - first_sample)) : real(1); // Partial frames hold sums
+    last_preview = std::chrono::steady_clock::now();
+    return true;
+}
+
+// Copies the tiles flagged in `finished` that are not `copied` yet from `image` into the
+// preview image, as means (see preview_scale and preview_sums).
+inline void camera::copy_finished_tiles(const std::vector<tile>& tiles, const framebuffer& image, const std::atomic<bool>* finished, bool* copied) {
+    for (size_t t = 0; t < tiles.size(); ++t) {
+        if (copied[t] || !finished[t].load(std::memory_order_acquire))
+            continue;
+        copied[t] = true;
+        for (int row = tiles[t].y0; row < tiles[t].y1; ++row) {
+            for (int col = tiles[t].x0; col < tiles[t].x1; ++col) {
+                size_t i = static_cast<size_t>(row) * image_width + col;
+                color value = image.pixels[i];
+                if (preview_sums)
+                    value += color((*preview_sums)[3 * i], (*preview_sums)[3 * i + 1], (*preview_sums)[3 * i + 2]);
+                preview_image.pixels[i] = preview_scale * value;
+            }
+        }
+    }
+}
+
+// Publishes the preview image as the next snapshot. A preview that fails to write is
+// switched off; the render itself goes on.
+inline void camera::publish_preview(bool final) {
+    if (!preview)
+        return;
+    if (!preview->publish(tonemap_to_rgb8(preview_image, tonemap), final))
+        preview.reset();
+    last_preview = std::chrono::steady_clock::now();
+}
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef CAMERA_RENDER_H
+#define CAMERA_RENDER_H
+
+#include "camera.hpp"
+#include "image_writer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// The frame loop of camera::render(): checks the settings, hands the tiles of the frame to
+// the render mode they ask for (camera_adaptive.hpp, camera_checkpoint.hpp or the plain
+// depth-first or wavefront tiles) and writes the image, the partial framebuffer or the
+// denoised image. run_tiles() is the scheduler every mode shares.
+
+inline bool camera::render(const hittable& scene) {
+    initialize();
+    
+    // Start measuring time
+    auto start_time = std::chrono::high_resolution_clock::now();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(time_budget));
+    bool progressive = adaptive_threshold > 0 || time_budget > 0; // Sampled in passes by render_adaptive
+
+    // Check every setting before anything touches the filesystem.
+    // Moving spheres and the boxes that bound them are only described from time 0 to 1
+    if (!(shutter_open >= 0 && shutter_open <= 1 && shutter_close >= 0 && shutter_close <= 1)) {
+        std::cerr << "Error: Shutter times " << shutter_open << ":" << shutter_close << " lie outside 0:1.\n";
+        return false;
+    }
+    bool partial = !partial_path.empty();
+    bool checkpointed = !checkpoint_path.empty();
+    if ((partial || checkpointed) && progressive) {
+        std::cerr << "Error: Adaptive sampling and time budgets cannot render partial or checkpointed frames.\n";
+        return false;
+    }
+    if (partial && checkpointed) {
+        std::cerr << "Error: A partial frame cannot be checkpointed.\n";
+        return false;
+    }
+    bool collect_features = denoise || !features_path.empty();
+    if (collect_features && (partial || checkpointed || progressive)) {
+        std::cerr << "Error: Denoising and feature buffers need a plain render of the whole frame.\n";
+        return false;
+    }
+    if (uses_cache() && scene_key == 0) {
+        std::cerr << "Error: The render cache needs the content key of the scene (camera::scene_key).\n";
+        return false;
+    }
+
+    // Check up front that the output file can be written, so a long render is not wasted.
+    // Opened for appending, so an existing file (an earlier part, say) stays intact until
+    // the render replaces it.
+    const std::string& target_path = partial ? partial_path : output_path;
+    if (!std::ofstream(target_path, std::ios::binary | std::ios::app)) {
+        std::cerr << "Error: Could not open " << target_path << " for writing.\n";
+        return false;
+    }
+
+    // Plain renders of the whole frame resume from, and save to, their cache entry
+    std::string cache_path = cache_entry();
+
+    // Open the preview before the first ray is traced
+    if (!open_preview(partial))
+        return false;
+
+    // Split the rows to render into tiles and keep a pool of workers around to render them.
+    // The framebuffer, the tiles, the workers and the scratch arena stay with the camera,
+    // so rendering the next frame of an animation allocates nothing. Every tile overwrites
+    // its pixels.
+    frame_arena.reset();
+    if (render_image.width != image_width || render_image.height != image_height)
+        render_image = framebuffer(image_width, image_height);
+    framebuffer& image = render_image;
+    int order = static_cast<int>(traversal);
+    if (tiles.empty() || tiles_key != std::array<int, 5>{first_row, last_row, tile_size, image_width, order}) {
+        tiles = make_tiles(image_width, first_row, last_row, tile_size, traversal);
+        tile_pixels = make_pixel_order(traversal, tile_size, tile_size);
+        tiles_key = {first_row, last_row, tile_size, image_width, order};
+    }
+    if (!workers || (thread_count > 0 && workers->size() != thread_count))
+        workers = std::make_unique<thread_pool>(thread_count);
+
+    if (progressive) {
+        if (!render_adaptive(scene, tiles, image, deadline))
+            return false;
+    } else if (checkpointed || !cache_path.empty()) {
+        if (!render_checkpointed(scene, tiles, image, checkpointed ? checkpoint_path : cache_path, !checkpointed))
+            return false;
+    } else {
+        feature_buffers features = collect_features ? feature_buffers(image_width, image_height) : feature_buffers();
+        render_samples(scene, tiles, image, collect_features ? &features : nullptr, start_time, "");
+        if (!features_path.empty() && !write_feature_buffers(features, features_path))
+            return false;
+        if (denoise) {
+            auto denoise_start = std::chrono::high_resolution_clock::now();
+            denoise_image(image, features, denoiser, *workers);
+            std::chrono::duration<double, std::milli> denoise_time = std::chrono::high_resolution_clock::now() - denoise_start;
+            if (verbose)
+                std::clog << "\rDenoised in " << std::fixed << std::setprecision(2) << denoise_time.count() << " ms"
+                          << "                                                            \n";
+        }
+    }
+
+    // Quantize the finished image into one byte buffer and encode the file in one pass,
+    // or keep the linear sums of the band for merging
+    {
+        RT_STAT_TIMER(stats_phase::output);
+        std::vector<unsigned char> rgb = partial ? std::vector<unsigned char>() : tonemap_to_rgb8(image, tonemap);
+
+        // The last snapshot is the written image (a partial frame shows the means of its band)
+        if (preview)
+            preview->publish(partial ? tonemap_to_rgb8(preview_image, tonemap) : rgb, true);
+
+        if (image_queue && !partial) {
+            image_queue->submit(output_path, image_width, image_height, std::move(rgb)); // Encoded and written in the background
+        } else {
+            bool written = partial ? make_partial(image).write(partial_path) : make_image_writer(output_path)->write(output_path, image_width, image_height, rgb);
+            if (!written) {
+                std::cerr << "\nError: Could not write " << target_path << ".\n";
+                return false;
+            }
+        }
+    }
+
+    if (verbose)
+        std::clog << "\rDone.                                                                                   \n"; // Log completion
+
+#ifdef RT_STATS
+    report_stats();
+#endif
+
+    // Measure and print the total render time
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> render_time = end_time - start_time;
+
+    if (!verbose)
+        return true;
+    std::cout << "\n" << (partial ? "Partial framebuffer" : "Image") << (image_queue && !partial ? " queued as " : " saved as ") << target_path << "\n";
+    std::cout << "Render time: " << std::fixed << std::setprecision(2) << render_time.count() << " ms\n";
+    return true;
+}
+
+// Traces samples [first_sample, last_sample) of every pixel of `tiles` into `image`. Each
+// worker renders whole tiles into the shared framebuffer; tiles never overlap.
+inline void camera::render_samples(const hittable& scene, const std::vector<tile>& tiles, framebuffer& image, feature_buffers* features, std::chrono::high_resolution_clock::time_point start_time, const std::string& label) {
+    run_tiles(tiles, image, start_time, label, [&](const tile& region) {
+        (this->*(wavefront ? kernels->wavefront_tile : kernels->depth_first_tile))(region, scene, image, features);
+    });
+}
+
+// Runs `render_region` on every tile with the worker pool and logs progress at most
+// once per second, prefixed by `label`, until every tile has finished.
+// `render_region` writes its tile into `image`, which the live preview picks up from there.
+template <typename tile_function>
+void camera::run_tiles(const std::vector<tile>& tiles, const framebuffer& image, std::chrono::high_resolution_clock::time_point start_time, const std::string& label, tile_function render_region) {
+    // Workers flag every tile they finish; the preview copies flagged tiles from this thread
+    std::atomic<bool>* finished = frame_arena.make_array<std::atomic<bool>>(tiles.size());
+    bool* copied = frame_arena.make_array<bool>(tiles.size());
+
+    // The job captures one pointer, which std::function stores without allocating
+    std::atomic<int> tiles_done(0);
+    auto run_tile = [&](int tile_index) {
+        render_region(tiles[tile_index]);
+        finished[tile_index].store(true, std::memory_order_release);
+        tiles_done.fetch_add(1, std::memory_order_relaxed);
+    };
+    workers->start(static_cast<int>(tiles.size()), [job = &run_tile](int tile_index, int) { (*job)(tile_index); });
+
+    int tile_count = static_cast<int>(tiles.size());
+    auto wake_interval = std::chrono::duration<double>(preview ? std::clamp(preview_interval, 0.01, 1.0) : 1.0);
+    while (!workers->wait_for(wake_interval)) {
+        if (preview && std::chrono::steady_clock::now() - last_preview >= std::chrono::duration<double>(preview_interval)) {
+            copy_finished_tiles(tiles, image, finished, copied);
+            publish_preview(false);
+        }
+
+        int done = tiles_done.load(std::memory_order_relaxed);
+        if (done == 0 || !verbose)
+            continue;
+
+        // Calculate time per tile and estimate remaining time
+        auto current_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> elapsed = current_time - start_time;
+        double avg_time_per_tile = elapsed.count() / done; // Average time per tile
+        double remaining_time_ms = avg_time_per_tile * (tile_count - done); // Remaining time in ms
+
+        // Format the estimated time remaining
+        int remaining_seconds = static_cast<int>(remaining_time_ms / 1000) % 60;
+        int remaining_minutes = static_cast<int>(remaining_time_ms / (1000 * 60));
+
+        // Log progress with estimated time remaining
+        std::clog << "\r" << label << "Tiles remaining: " << (tile_count - done) << " | Estimated time left: " << remaining_minutes << "m " << remaining_seconds << "s" << std::flush;
+    }
+    if (preview)
+        copy_finished_tiles(tiles, image, finished, copied);
+}
+
+#ifdef RT_STATS
+// Merges the counters of every render thread and writes them to stats_path, or to the log.
+inline void camera::report_stats() const {
+    render_stats totals = render_stats::collect();
+    if (stats_path.empty()) {
+        std::clog << "Render stats:\n";
+        totals.write_json(std::clog);
+        return;
+    }
+    std::ofstream out(stats_path);
+    totals.write_json(out);
+    if (!out)
+        std::cerr << "Error: Could not write " << stats_path << ".\n";
+}
+#endif
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef CAMERA_WAVEFRONT_H
+#define CAMERA_WAVEFRONT_H
+
+#include "camera.hpp"
+#include "wavefront.hpp"
+
+#include <type_traits>
+#include <utility>
+
+// The wavefront tile loop (camera::wavefront): the samples of a tile are traced together,
+// one bounce at a time, with the hits of every bounce shaded in batches per material kind.
+
+// Wavefront version of render_tile: every sample of the tile is one path, and all paths
+// are advanced one bounce at a time (see wavefront.hpp). Each path keeps its own generator
+// and the samples are summed in the same order, so both trace the same samples, but the
+// images are not bit-identical: under -ffast-math the compiler rounds the scatter code it
+// inlines into each loop a little differently, and a path whose rounding differs may
+// refract, reflect or survive roulette differently from there on. A few noisy pixels per
+// frame differ by such samples; `make check` (src/kernel_check.cpp) holds the two to that.
+template <typename kernel>
+void camera::render_tile_wavefront(const tile& region, const hittable& scene, framebuffer& image, feature_buffers* features) const {
+    thread_local wavefront_buffers buffers;
+    int tile_width = region.x1 - region.x0;
+    int pixel_samples = last_sample - first_sample;
+    int sample_count = tile_width * (region.y1 - region.y0) * pixel_samples;
+
+    // Camera rays of every sample of the tile
+    buffers.paths.clear();
+    buffers.contributions.assign(sample_count, color(0, 0, 0));
+    for (pixel_offset offset : tile_pixels) {
+        int col = region.x0 + offset.x, row = region.y0 + offset.y;
+        if (col >= region.x1 || row >= region.y1)
+            continue; // Outside a tile clipped by the image border
+        std::uint64_t pixel_index = static_cast<std::uint64_t>(row) * image_width + col;
+        int first_slot = ((row - region.y0) * tile_width + (col - region.x0)) * pixel_samples;
+        for (int sample = first_sample; sample < last_sample; ++sample) {
+            path_state path;
+            path.gen = rng::for_sample(seed, pixel_index, sample);
+            path.r = camera_ray<kernel>(col, row, sample, path.gen);
+            path.slot = first_slot + (sample - first_sample);
+            buffers.paths.push_back(path);
+        }
+    }
+
+    for (int bounce = 0; bounce < max_depth && !buffers.paths.empty(); ++bounce) {
+        // Intersect every live ray; a path that escapes the scene sees the background
+        buffers.records.resize(buffers.paths.size());
+        for (size_t i = 0; i < buffers.paths.size(); ++i) {
+            path_state& path = buffers.paths[i];
+            bool hit = intersect(scene, path.r, bounce, buffers.records[i]);
+            if (features && bounce == 0) {
+                // Slots run pixel by pixel through the tile, pixel_samples per pixel
+                int pixel = path.slot / pixel_samples;
+                features->at(region.x0 + pixel % tile_width, region.y0 + pixel / tile_width).add(hit ? &buffers.records[i] : nullptr);
+            }
+            if (!hit) {
+                RT_STAT(stats.end_path(bounce));
+                buffers.records[i].mat = nullptr;
+                buffers.contributions[path.slot] += path.throughput * background(path.r);
+            } else if (buffers.records[i].mat->kind == material_kind::diffuse_light) {
+                buffers.contributions[path.slot] += path.throughput * emission(path.r, buffers.records[i], path.bsdf_pdf);
+            }
+        }
+
+        // Scatter the hits one material kind at a time; survivors move to next_paths
+        buffers.bin_by_material();
+        buffers.next_paths.clear();
+        scatter_queue<kernel, material>(buffers, scene, material_kind::other, bounce);
+        scatter_queue<kernel, lambertian>(buffers, scene, material_kind::lambertian, bounce);
+        scatter_queue<kernel, metal>(buffers, scene, material_kind::metal, bounce);
+        scatter_queue<kernel, dielectric>(buffers, scene, material_kind::dielectric, bounce);
+        scatter_queue<kernel, diffuse_light>(buffers, scene, material_kind::diffuse_light, bounce);
+        std::swap(buffers.paths, buffers.next_paths);
+    }
+    // Paths still alive after max_depth bounces carry no light; their contribution stays black
+    RT_STAT(stats.path_depths[std::min(max_depth, render_stats::max_tracked_depth - 1)] += buffers.paths.size());
+
+    // Sum every pixel's samples in sample order, like render_tile
+    for (int row = region.y0; row < region.y1; ++row) {
+        for (int col = region.x0; col < region.x1; ++col) {
+            int first_slot = ((row - region.y0) * tile_width + (col - region.x0)) * pixel_samples;
+            color accumulated_color(0, 0, 0);
+            for (int sample = 0; sample < pixel_samples; ++sample)
+                accumulated_color += buffers.contributions[first_slot + sample];
+            image.at(col, row) = scale_color * accumulated_color;
+            if (features)
+                features->at(col, row).scale(real(1.0 / pixel_samples));
+        }
+    }
+}
+
+// Scatters every hit of material kind `kind` queued for this bounce. `material_type` is
+// the concrete (final) class of that kind, so the loop calls its scatter() directly;
+// `material` itself is used for other kinds and keeps the virtual call. Diffuse hits
+// sample the lights first, like trace_ray does.
+template <typename kernel, typename material_type>
+void camera::scatter_queue(wavefront_buffers& buffers, const hittable& scene, material_kind kind, int bounce) const {
+    int k = static_cast<int>(kind);
+    RT_STAT_TIMER(stats_phase::scatter);
+    RT_STAT(stats.scatters[k] += buffers.queue_start[k + 1] - buffers.queue_start[k]);
+    for (int q = buffers.queue_start[k]; q < buffers.queue_start[k + 1]; ++q) {
+        int i = buffers.queue[q];
+        path_state& path = buffers.paths[i];
+        const hit_record& record = buffers.records[i];
+
+        const material_type* mat = static_cast<const material_type*>(record.mat);
+        bool sample_lights = false;
+        if constexpr (std::is_same_v<material_type, lambertian>) {
+            sample_lights = sample_lights_at<kernel>(record);
+            if (sample_lights)
+                buffers.contributions[path.slot] += path.throughput * direct_light(record, *mat, path.r.time(), scene, path.gen);
+        }
+
+        ray scattered;
+        color attenuation;
+        if (!mat->scatter(path.r, record, attenuation, scattered, path.gen)) {
+            RT_STAT(stats.absorbed++; stats.end_path(bounce + 1));
+            continue; // Absorbed: the contribution keeps the light gathered so far
+        }
+        path.throughput = path.throughput * attenuation;
+        path.bsdf_pdf = sample_lights ? lambertian::pdf(record, scattered.direction()) : 0;
+        path.r = scattered;
+
+        if (survives_roulette<kernel>(bounce, path.throughput, path.gen))
+            buffers.next_paths.push_back(path);
+    }
+}
+
+#endif
@@ -22,8 +22,8 @@ inline double linear_to_gamma(double linear_component)
     return 0;
 }
 
-// Function to output a color value to a stream, converting it to 8-bit values.
-void write_color(std::ostream& out, const color& pixel_color) {
+// Function to convert a color value to three 8-bit values, written to out[0..2].
+void write_color(unsigned char* out, const color& pixel_color) {
     // Extract RGB components from the color object.
     auto r = pixel_color.x();
     auto g = pixel_color.y();
@@ -38,16 +38,11 @@ void write_color(std::ostream& out, const color& pixel_color) {
     // Convert the normalized [0,1] range values to the [0,255] byte range.
     // We use an interval clamp to ensure values stay within [0,1] to avoid overflow.
     static const interval intensity(0.000, 0.999); // Clamp to slightly under 1 to avoid rounding issues.
-    
+
     // Convert each component to a byte value by scaling and clamping.
-    int rbyte = int(256 * intensity.clamp(r)); // Red component in the range [0,255]
-    int gbyte = int(256 * intensity.clamp(g)); // Green component in the range [0,255]
-    int bbyte = int(256 * intensity.clamp(b)); // Blue component in the range [0,255]
-
-    // Write out the RGB color components as integers separated by spaces.
-    // Each color channel value is written as an 8-bit integer, creating
-    // the final pixel color in a format suitable for PPM or similar image formats.
-    out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
+    out[0] = static_cast<unsigned char>(256 * intensity.clamp(r)); // Red component in the range [0,255]
+    out[1] = static_cast<unsigned char>(256 * intensity.clamp(g)); // Green component in the range [0,255]
+    out[2] = static_cast<unsigned char>(256 * intensity.clamp(b)); // Blue component in the range [0,255]
 }
 
 #endif 
@@ -0,0 +1,58 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include "rng.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// content_hash folds bytes into a 64-bit key, eight at a time through mix64(). Equal
+// inputs give equal keys on every run and machine of the same byte order, so keys can
+// name files that outlive the process (see camera::cache_dir). It is not cryptographic.
+class content_hash {
+public:
+    // Adds `size` bytes starting at `data`.
+    content_hash& add_bytes(const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        length += size;
+        for (; size >= 8; bytes += 8, size -= 8) {
+            std::uint64_t word;
+            std::memcpy(&word, bytes, 8);
+            fold(word);
+        }
+        if (size > 0) {
+            std::uint64_t word = 0;
+            std::memcpy(&word, bytes, size);
+            fold(word);
+        }
+        return *this;
+    }
+
+    // Adds the bytes of `value`, which must have no padding.
+    template <typename T>
+    content_hash& add(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "only plain values can be hashed as bytes");
+        return add_bytes(&value, sizeof(T));
+    }
+
+    // Adds the length of `values` and the bytes of every element.
+    template <typename T>
+    content_hash& add_array(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>, "only plain values can be hashed as bytes");
+        add(static_cast<std::uint64_t>(values.size()));
+        return add_bytes(values.data(), values.size() * sizeof(T));
+    }
+
+    // The key of everything added so far.
+    std::uint64_t value() const { return mix64(state ^ length); }
+
+private:
+    std::uint64_t state = 0x243f6a8885a308d3ull; // Running hash
+    std::uint64_t length = 0; // Bytes added, so inputs that differ only by trailing zeros differ
+
+    void fold(std::uint64_t word) { state = mix64(state ^ word) + 0x9e3779b97f4a7c15ull; }
+};
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "framebuffer.hpp"
+#include "image_writer.hpp"
+#include "material.hpp"
+#include "thread_pool.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Edge-avoiding à-trous wavelet denoiser (Dammertz et al., "Edge-Avoiding À-Trous Wavelet
+// Transform for fast Global Illumination Filtering", 2010). Every pass blurs the image with
+// a 5x5 B3-spline kernel whose taps lie 2^pass pixels apart, so four passes cover a 61
+// pixel wide footprint at 25 taps per pixel and pass. Each tap is weighted down by how much
+// its color and its first-hit features (albedo, normal, depth) differ from the center's,
+// which keeps the blur from crossing object edges, shading edges and color boundaries.
+// Noise removed this way lets a render stop at 4 to 8 samples per pixel.
+
+// Features of the first hit of a pixel's camera rays, averaged over its samples. They are
+// nearly noise free even at one sample per pixel, which makes them good guides for the
+// filter. Rays that miss the scene report black albedo, no normal and sky_depth.
+struct pixel_features {
+    static constexpr real sky_depth = 1e4; // Depth reported for the background
+
+    color albedo = color(0, 0, 0); // Reflectance of the surface (material::surface_albedo)
+    vec3 normal = vec3(0, 0, 0); // Surface normal, facing the camera
+    real depth = 0; // Distance along the ray from the lens
+
+    // Adds the first hit `rec` of a camera ray (or a miss when `rec` is null).
+    void add(const hit_record* rec) {
+        if (!rec) {
+            depth += sky_depth;
+            return;
+        }
+        albedo += rec->mat->surface_albedo();
+        normal += rec->normal;
+        depth += rec->t; // Unit direction: t is the distance
+    }
+
+    // Scales the sums of add() into means.
+    void scale(real factor) {
+        albedo *= factor;
+        normal *= factor;
+        depth *= factor;
+    }
+};
+
+// The features of every pixel of a render in row-major order, laid out like framebuffer.
+class feature_buffers {
+public:
+    feature_buffers() {}
+
+    // Creates empty features for an image of the given size.
+    feature_buffers(int width, int height) : width(width), height(height), pixels(static_cast<size_t>(width) * height) {}
+
+    // Access to the features of the pixel at column `col` of row `row`.
+    pixel_features& at(int col, int row) { return pixels[static_cast<size_t>(row) * width + col]; }
+    const pixel_features& at(int col, int row) const { return pixels[static_cast<size_t>(row) * width + col]; }
+
+    int width = 0; // Image width in pixels
+    int height = 0; // Image height in pixels
+    std::vector<pixel_features> pixels; // Features of every pixel, row by row from the top
+};
+
+// Writes the albedo, normal and depth buffers of `features` as PFM images next to each other,
+// named <prefix>_albedo.pfm, <prefix>_normal.pfm and <prefix>_depth.pfm. Returns false, after
+// a message on std::cerr, if one could not be written.
+inline bool write_feature_buffers(const feature_buffers& features, const std::string& prefix) {
+    size_t n = features.pixels.size();
+    std::vector<float> albedo(3 * n), normal(3 * n), depth(3 * n);
+    for (size_t i = 0; i < n; ++i) {
+        const pixel_features& f = features.pixels[i];
+        for (int c = 0; c < 3; ++c) {
+            albedo[3 * i + c] = static_cast<float>(f.albedo[c]);
+            normal[3 * i + c] = static_cast<float>(f.normal[c]);
+            depth[3 * i + c] = static_cast<float>(f.depth);
+        }
+    }
+    for (const auto& [name, pixels] : {std::make_pair("_albedo.pfm", &albedo), std::make_pair("_normal.pfm", &normal), std::make_pair("_depth.pfm", &depth)}) {
+        if (!write_pfm(prefix + name, features.width, features.height, *pixels)) {
+            std::cerr << "\nError: Could not write " << prefix + name << ".\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Strength of the denoiser. A tap whose difference from the center equals a sigma gets its
+// weight scaled by 1/e; larger sigmas blur more.
+struct denoiser_settings {
+    int iterations = 4; // Number of à-trous passes (pass i spaces its taps 2^i pixels apart)
+    float color_sigma = 0.5f; // Color difference (in gamma 2 space) of the first pass; halves every pass
+    float normal_sigma = 0.3f; // Difference between unit normals
+    float albedo_sigma = 0.1f; // Difference between albedos
+    float depth_sigma = 0.1f; // Relative depth difference, (d_q - d_p) / (d_q + d_p)
+};
+
+// Replaces the colors of `image` with their denoised values, guided by `features` (which
+// must be the same size). Rows are filtered in parallel on `workers`.
+inline void denoise_image(framebuffer& image, const feature_buffers& features, const denoiser_settings& settings, thread_pool& workers) {
+    const int w = image.width, h = image.height;
+    const size_t n = static_cast<size_t>(w) * h;
+
+    // Structure of arrays in single precision, so the inner loops run on full SIMD vectors
+    std::vector<float> color_planes[3], next_planes[3], guide_planes[3], albedo_planes[3], normal_planes[3], depth_plane(n);
+    for (int c = 0; c < 3; ++c) {
+        color_planes[c].resize(n);
+        next_planes[c].resize(n);
+        guide_planes[c].resize(n);
+        albedo_planes[c].resize(n);
+        normal_planes[c].resize(n);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const pixel_features& f = features.pixels[i];
+        real normal_length = f.normal.length();
+        for (int c = 0; c < 3; ++c) {
+            color_planes[c][i] = static_cast<float>(image.pixels[i][c]);
+            albedo_planes[c][i] = static_cast<float>(f.albedo[c]);
+            normal_planes[c][i] = normal_length > 0 ? static_cast<float>(f.normal[c] / normal_length) : 0.0f;
+        }
+        depth_plane[i] = static_cast<float>(f.depth);
+    }
+
+    // The B3-spline kernel: weights of the taps at offsets -2..2 (times 2^pass pixels)
+    static const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+    const float inv_normal = 1.0f / (settings.normal_sigma * settings.normal_sigma);
+    const float inv_albedo = 1.0f / (settings.albedo_sigma * settings.albedo_sigma);
+    const float inv_depth = 1.0f / (settings.depth_sigma * settings.depth_sigma);
+
+    for (int pass = 0; pass < settings.iterations; ++pass) {
+        // Edges are judged on the gamma-corrected colors, so dark regions are not under-filtered
+        for (int c = 0; c < 3; ++c)
+            for (size_t i = 0; i < n; ++i)
+                guide_planes[c][i] = std::sqrt(std::max(color_planes[c][i], 0.0f));
+
+        const int step = 1 << pass;
+        const float color_sigma = settings.color_sigma / static_cast<float>(step);
+        const float inv_color = 1.0f / (color_sigma * color_sigma);
+
+        workers.start(h, [&](int y, int) {
+            // Running sums of the row (reused by every row the thread filters)
+            thread_local std::vector<float> sums[4];
+            for (auto& s : sums)
+                s.assign(w, 0.0f);
+            float* sum_r = sums[0].data();
+            float* sum_g = sums[1].data();
+            float* sum_b = sums[2].data();
+            float* sum_w = sums[3].data();
+
+            const size_t p = static_cast<size_t>(y) * w;
+            for (int ky = 0; ky < 5; ++ky) {
+                const int yy = y + (ky - 2) * step;
+                if (yy < 0 || yy >= h)
+                    continue; // Taps outside the image are left out
+                for (int kx = 0; kx < 5; ++kx) {
+                    const int dx = (kx - 2) * step;
+                    const float k = kernel[ky] * kernel[kx];
+                    const int x_begin = std::max(0, -dx), x_end = std::min(w, w - dx);
+                    if (x_begin >= x_end)
+                        continue;
+
+                    // Center pixels p + x against taps q + x, where q is the same run of the tap's row shifted by dx
+                    const size_t pc = p + x_begin;
+                    const size_t q = static_cast<size_t>(yy) * w + x_begin + dx;
+                    const int count = x_end - x_begin;
+                    const float *gp_r = &guide_planes[0][pc], *gp_g = &guide_planes[1][pc], *gp_b = &guide_planes[2][pc];
+                    const float *gq_r = &guide_planes[0][q], *gq_g = &guide_planes[1][q], *gq_b = &guide_planes[2][q];
+                    const float *ap_r = &albedo_planes[0][pc], *ap_g = &albedo_planes[1][pc], *ap_b = &albedo_planes[2][pc];
+                    const float *aq_r = &albedo_planes[0][q], *aq_g = &albedo_planes[1][q], *aq_b = &albedo_planes[2][q];
+                    const float *np_x = &normal_planes[0][pc], *np_y = &normal_planes[1][pc], *np_z = &normal_planes[2][pc];
+                    const float *nq_x = &normal_planes[0][q], *nq_y = &normal_planes[1][q], *nq_z = &normal_planes[2][q];
+                    const float *dp = &depth_plane[pc], *dq = &depth_plane[q];
+                    const float *cq_r = &color_planes[0][q], *cq_g = &color_planes[1][q], *cq_b = &color_planes[2][q];
+                    float *out_r = sum_r + x_begin, *out_g = sum_g + x_begin, *out_b = sum_b + x_begin, *out_w = sum_w + x_begin;
+
+                    // The sums never overlap the planes; without the hint the compiler gives up on the
+                    // many run-time alias checks and leaves the loop scalar
+#pragma GCC ivdep
+                    for (int x = 0; x < count; ++x) {
+                        float gr = gq_r[x] - gp_r[x], gg = gq_g[x] - gp_g[x], gb = gq_b[x] - gp_b[x];
+                        float ar = aq_r[x] - ap_r[x], ag = aq_g[x] - ap_g[x], ab = aq_b[x] - ap_b[x];
+                        float nx = nq_x[x] - np_x[x], ny = nq_y[x] - np_y[x], nz = nq_z[x] - np_z[x];
+                        float dd = (dq[x] - dp[x]) / (dq[x] + dp[x] + 1e-6f);
+                        float e = (gr * gr + gg * gg + gb * gb) * inv_color + (ar * ar + ag * ag + ab * ab) * inv_albedo +
+                                  (nx * nx + ny * ny + nz * nz) * inv_normal + dd * dd * inv_depth;
+                        float weight = k * std::exp(-e);
+                        out_r[x] += weight * cq_r[x];
+                        out_g[x] += weight * cq_g[x];
+                        out_b[x] += weight * cq_b[x];
+                        out_w[x] += weight;
+                    }
+                }
+            }
+
+            // The center tap always counts, so the weight sum is never zero
+            for (int x = 0; x < w; ++x) {
+                float inv_w = 1.0f / sum_w[x];
+                next_planes[0][p + x] = sum_r[x] * inv_w;
+                next_planes[1][p + x] = sum_g[x] * inv_w;
+                next_planes[2][p + x] = sum_b[x] * inv_w;
+            }
+        });
+        workers.wait();
+
+        for (int c = 0; c < 3; ++c)
+            std::swap(color_planes[c], next_planes[c]);
+    }
+
+    for (size_t i = 0; i < n; ++i)
+        image.pixels[i] = color(color_planes[0][i], color_planes[1][i], color_planes[2][i]);
+}
+
+#endif
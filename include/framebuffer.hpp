@@ -0,0 +1,59 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "pixel_order.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// framebuffer holds the averaged color of every pixel of a render in row-major order.
+// Render threads write disjoint pixels into it (one tile each), and the whole image is
+// written out in one go once every tile has finished.
+class framebuffer {
+public:
+    framebuffer() {}
+
+    // Creates a black framebuffer of the given size.
+    framebuffer(int width, int height) : width(width), height(height), pixels(static_cast<size_t>(width) * height) {}
+
+    // Access to the pixel at column `col` of row `row`.
+    color& at(int col, int row) { return pixels[static_cast<size_t>(row) * width + col]; }
+    const color& at(int col, int row) const { return pixels[static_cast<size_t>(row) * width + col]; }
+
+    // Gamma-corrects and quantizes every pixel into one contiguous buffer of 8-bit RGB
+    // triplets, row by row from the top, ready to be handed to an image_writer.
+    std::vector<unsigned char> to_rgb8() const {
+        std::vector<unsigned char> bytes(pixels.size() * 3);
+        for (size_t i = 0; i < pixels.size(); ++i)
+            write_color(&bytes[3 * i], pixels[i]);
+        return bytes;
+    }
+
+    int width = 0; // Image width in pixels
+    int height = 0; // Image height in pixels
+    std::vector<color> pixels; // Pixel colors, row by row from the top
+};
+
+// A rectangular block of pixels [x0, x1) x [y0, y1) rendered as one unit of work.
+struct tile {
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+};
+
+// Splits rows [row_begin, row_end) of an image `width` pixels wide into tiles of at most
+// tile_size x tile_size pixels, ordered by `order` over the grid of tiles (row by row from
+// the top-left corner by default).
+inline std::vector<tile> make_tiles(int width, int row_begin, int row_end, int tile_size, pixel_order order = pixel_order::row_major) {
+    int columns = (width + tile_size - 1) / tile_size;
+    int rows = (row_end - row_begin + tile_size - 1) / tile_size;
+    std::vector<tile> tiles;
+    for (pixel_offset cell : make_pixel_order(order, columns, std::max(0, rows))) {
+        int x = cell.x * tile_size, y = row_begin + cell.y * tile_size;
+        tiles.push_back({x, y, std::min(x + tile_size, width), std::min(y + tile_size, row_end)});
+    }
+    return tiles;
+}
+
+#endif
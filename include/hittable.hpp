@@ -1,6 +1,9 @@
 #ifndef HITTABLE_H
 #define HITTABLE_H
 
+#include "aabb.hpp"
+#include "render_stats.hpp"
+
 // Forward declaration of the material class to avoid circular dependencies.
 class material;
 
@@ -15,11 +18,14 @@ class hit_record {
 
     // A pointer to the material of the object at the hit point, allowing the rendering system
     // to apply surface-specific properties such as reflection, refraction, or color.
-    shared_ptr<material> mat = {};
+    // It does not own the material: the objects of the scene keep their materials alive for
+    // the whole render, so a hit costs no reference counting and the record stays trivially
+    // copyable (hit loops copy it on every closer hit).
+    const material* mat = nullptr;
 
     // The ray parameter `t` at which the intersection occurs. `t` represents the distance along the ray
     // from its origin, with larger values indicating farther points.
-    double t = {};
+    real t = {};
 
     // A boolean indicating whether the surface normal is facing the ray origin (front face) or away from it.
     // This helps to distinguish between the two sides of a surface, enabling correct lighting calculations.
@@ -38,20 +44,76 @@ class hit_record {
     }
 };
 
+class hittable;
+
+// The closest intersection found so far while searching a scene, before its hit record is
+// built. Traversal only compares `t` values; the record (hit point, normal, material) is
+// filled in once, for the final winner, by the primitive stored in `object`. A hit found
+// inside an instance (see instance.hpp) also names the instance, which maps the ray into
+// the primitive's space and its record back out.
+struct hit_candidate {
+    real t = {}; // Ray parameter of the intersection
+    const hittable* object = nullptr; // Primitive that was hit, which builds its record in fill_hit_record()
+    size_t index = 0; // Which part of `object` was hit, e.g. the sphere of a sphere_batch
+    const hittable* instance = nullptr; // Instance the primitive was reached through (null: none)
+
+    // Records a hit of primitive `object`; primitives report hits through this, so a closer
+    // hit outside an instance clears the instance of an earlier one.
+    void set(real hit_t, const hittable* hit_object, size_t hit_index = 0) {
+        t = hit_t;
+        object = hit_object;
+        index = hit_index;
+        instance = nullptr;
+    }
+};
+
 // Abstract base class for any object that can be "hit" by a ray, e.g., a sphere or plane.
 // The `hittable` class provides a polymorphic interface that specific shapes can inherit from.
+//
+// Intersection happens in two phases. intersect() only finds the closest `t` (and which
+// primitive it belongs to), which is all a search over many candidates needs; the hit record
+// is then built by fill_hit_record() for the closest hit alone. Rays are expected to have
+// unit directions, so primitives can treat `t` as a distance and skip normalizing in their
+// quadratic.
 class hittable {
   public:
     // Virtual destructor to allow safe deletion of derived objects via base class pointers.
     virtual ~hittable() = default;
 
-    // The `hit` function is a pure virtual function that derived classes must implement.
-    // It checks if the given ray intersects with the object within a specified range of distances (`ray_t`).
-    // - `r` is the ray being cast.
+    // Finds the closest intersection of `r` with the object inside `ray_t`.
+    // - `r` is the ray being cast, with a unit direction.
     // - `ray_t` specifies the interval of `t` values to consider for intersections.
-    // - `rec` is an output parameter used to store hit information if an intersection occurs.
+    // - `candidate` receives the hit if there is one, and is left untouched otherwise, so a
+    //   container can pass the same candidate to each of its objects in turn.
     // The function returns true if the ray hits the object; otherwise, it returns false.
-    virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+    virtual bool intersect(const ray& r, interval ray_t, hit_candidate& candidate) const = 0;
+
+    // Builds the full hit record of `candidate`, an intersection this object reported from
+    // intersect() for ray `r`. Only primitives and instances ever own a candidate; containers
+    // such as hittable_list or bvh_node hand it on unchanged and never receive this call.
+    virtual void fill_hit_record([[maybe_unused]] const ray& r, [[maybe_unused]] const hit_candidate& candidate, [[maybe_unused]] hit_record& rec) const {}
+
+    // Finds the closest intersection of `r` inside `ray_t` and stores its details in `rec`.
+    // Returns true if the ray hits the object; otherwise, it returns false.
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const {
+        hit_candidate candidate = {};
+        if (!intersect(r, ray_t, candidate))
+            return false;
+        (candidate.instance ? candidate.instance : candidate.object)->fill_hit_record(r, candidate, rec);
+        return true;
+    }
+
+    // Returns true if `r` hits anything inside `ray_t`, e.g. whether a shadow ray is blocked
+    // on its way to a light. Unlike intersect(), any hit will do, so containers override it
+    // to stop at the first one instead of searching for the closest.
+    virtual bool occluded(const ray& r, interval ray_t) const {
+        hit_candidate candidate = {};
+        return intersect(r, ray_t, candidate);
+    }
+
+    // Returns an axis-aligned box that fully encloses the object.
+    // Acceleration structures such as `bvh_node` use it to skip objects a ray cannot reach.
+    virtual aabb bounding_box() const = 0;
 };
 
 #endif
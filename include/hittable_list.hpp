@@ -22,39 +22,57 @@ public:
 
     // Method to clear all objects from the list.
     // This is useful for resetting or reusing the list without creating a new instance.
-    void clear() { objects.clear(); }
+    void clear() {
+        objects.clear();
+        bbox = aabb();
+    }
 
     // Method to add a hittable object to the list.
     // Accepts a shared_ptr to an object derived from the hittable class.
+    // The list's bounding box grows to enclose every added object.
     void add(shared_ptr<hittable> object) {
         objects.push_back(object);
+        bbox = aabb(bbox, object->bounding_box());
     }
 
-    // Override the hit function inherited from the hittable class.
-    // This function checks if any object in the list is hit by a given ray 'r'.
+    // Override the intersect function inherited from the hittable class.
+    // This function finds the closest object in the list hit by a given ray 'r'.
     // Parameters:
     // - const ray& r: The ray being cast.
     // - interval ray_t: The range of t values (parameterized distance along the ray) to check.
-    // - hit_record& rec: Struct to store details of the closest hit point.
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        hit_record temp_rec = {}; // Temporary record to store each object's hit data.
+    // - hit_candidate& candidate: Receives the closest hit; its record is built only afterwards.
+    bool intersect(const ray& r, interval ray_t, hit_candidate& candidate) const override {
         bool hit_anything = false; // Boolean to track if any object was hit.
         auto closest_so_far = ray_t.max; // Tracks the closest hit distance.
 
         // Loop through all objects in the list.
         for (const auto& object : objects) {
             // Check if the current object is hit by the ray within the range (ray_t.min, closest_so_far).
-            // This range narrowing ensures we only consider the closest hit.
-            if (object->hit(r, interval(ray_t.min, closest_so_far), temp_rec)) {
+            // This range narrowing ensures we only consider the closest hit. A closer hit
+            // overwrites the candidate, which only holds a `t` and a pointer.
+            if (object->intersect(r, interval(ray_t.min, closest_so_far), candidate)) {
                 hit_anything = true;             // Mark that at least one hit was detected.
-                closest_so_far = temp_rec.t;     // Update the closest distance to the new hit.
-                rec = temp_rec;                  // Store this hit record as it is the closest so far.
+                closest_so_far = candidate.t;    // Update the closest distance to the new hit.
             }
         }
 
         // Return true if any object was hit, false otherwise.
         return hit_anything;
     }
+
+    // Returns true as soon as any object of the list is hit inside `ray_t`.
+    bool occluded(const ray& r, interval ray_t) const override {
+        for (const auto& object : objects)
+            if (object->occluded(r, ray_t))
+                return true;
+        return false;
+    }
+
+    // Returns the box enclosing every object in the list.
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    aabb bbox = {}; // Box enclosing every object added so far
 };
 
 #endif
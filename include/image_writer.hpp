@@ -0,0 +1,164 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Abstract base class for image file encoders. A writer receives the finished image as
+// one contiguous buffer of 8-bit RGB triplets (row by row from the top) and encodes the
+// whole file in a single pass.
+class image_writer {
+  public:
+    virtual ~image_writer() = default;
+
+    // Writes `rgb` (width * height * 3 bytes) to `path`. Returns false if the file could not be written.
+    virtual bool write(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb) const = 0;
+};
+
+// Binary PPM (P6): a short text header followed by the raw RGB bytes.
+class ppm_writer : public image_writer {
+  public:
+    bool write(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb) const override {
+        std::ofstream out(path, std::ios::binary);
+        if (!out)
+            return false;
+
+        // Write PPM file header, then every pixel in one block
+        out << "P6\n" << width << ' ' << height << "\n255\n";
+        out.write(reinterpret_cast<const char*>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+        return static_cast<bool>(out);
+    }
+};
+
+// PNG (8-bit RGB). The pixel data goes into "stored" (uncompressed) deflate blocks, which
+// every PNG reader understands and which costs no more than a copy to produce.
+class png_writer : public image_writer {
+  public:
+    bool write(const std::string& path, int width, int height, const std::vector<unsigned char>& rgb) const override {
+        std::ofstream out(path, std::ios::binary);
+        if (!out)
+            return false;
+
+        // Raw image data: every row is prefixed with filter type 0 (none)
+        size_t row_bytes = static_cast<size_t>(width) * 3;
+        std::vector<unsigned char> raw;
+        raw.reserve((row_bytes + 1) * height);
+        for (int row = 0; row < height; ++row) {
+            raw.push_back(0);
+            raw.insert(raw.end(), rgb.begin() + row * row_bytes, rgb.begin() + (row + 1) * row_bytes);
+        }
+
+        // zlib stream: header, stored deflate blocks of at most 65535 bytes, Adler-32 checksum
+        std::vector<unsigned char> zlib = {0x78, 0x01};
+        zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+        size_t offset = 0;
+        do {
+            size_t block = std::min<size_t>(65535, raw.size() - offset);
+            bool last = (offset + block == raw.size());
+            zlib.push_back(last ? 1 : 0);
+            append_le16(zlib, static_cast<std::uint16_t>(block));
+            append_le16(zlib, static_cast<std::uint16_t>(~block));
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + block);
+            offset += block;
+        } while (offset < raw.size());
+        append_be32(zlib, adler32(raw));
+
+        // Header chunk: size, 8 bits per channel, color type 2 (RGB), default methods
+        std::vector<unsigned char> header;
+        append_be32(header, static_cast<std::uint32_t>(width));
+        append_be32(header, static_cast<std::uint32_t>(height));
+        header.insert(header.end(), {8, 2, 0, 0, 0});
+
+        static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        out.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+        write_chunk(out, "IHDR", header);
+        write_chunk(out, "IDAT", zlib);
+        write_chunk(out, "IEND", {});
+        return static_cast<bool>(out);
+    }
+
+  private:
+    static void append_le16(std::vector<unsigned char>& bytes, std::uint16_t value) {
+        bytes.push_back(static_cast<unsigned char>(value & 0xff));
+        bytes.push_back(static_cast<unsigned char>(value >> 8));
+    }
+
+    static void append_be32(std::vector<unsigned char>& bytes, std::uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            bytes.push_back(static_cast<unsigned char>((value >> shift) & 0xff));
+    }
+
+    static std::uint32_t adler32(const std::vector<unsigned char>& bytes) {
+        std::uint32_t a = 1, b = 0;
+        for (unsigned char byte : bytes) {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    // CRC-32 over the chunk type and data, as the PNG chunk trailer requires
+    static std::uint32_t crc32(const char* type, const std::vector<unsigned char>& data) {
+        static const std::vector<std::uint32_t> table = [] {
+            std::vector<std::uint32_t> t(256);
+            for (std::uint32_t n = 0; n < 256; ++n) {
+                std::uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[n] = c;
+            }
+            return t;
+        }();
+
+        std::uint32_t crc = 0xffffffffu;
+        for (int i = 0; i < 4; ++i)
+            crc = table[(crc ^ static_cast<unsigned char>(type[i])) & 0xff] ^ (crc >> 8);
+        for (unsigned char byte : data)
+            crc = table[(crc ^ byte) & 0xff] ^ (crc >> 8);
+        return crc ^ 0xffffffffu;
+    }
+
+    static void write_chunk(std::ofstream& out, const char* type, const std::vector<unsigned char>& data) {
+        std::vector<unsigned char> length;
+        append_be32(length, static_cast<std::uint32_t>(data.size()));
+        std::vector<unsigned char> crc;
+        append_be32(crc, crc32(type, data));
+
+        out.write(reinterpret_cast<const char*>(length.data()), 4);
+        out.write(type, 4);
+        out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        out.write(reinterpret_cast<const char*>(crc.data()), 4);
+    }
+};
+
+// Writes linear floating-point RGB (width * height * 3 floats, row by row from the top) as a
+// PFM image, which HDR tools and external denoisers read directly. PFM stores its rows from
+// the bottom up; the negative scale marks little-endian data. Returns false if the file
+// could not be written.
+inline bool write_pfm(const std::string& path, int width, int height, const std::vector<float>& rgb) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        return false;
+    out << "PF\n" << width << ' ' << height << "\n-1.0\n";
+    size_t row_floats = static_cast<size_t>(width) * 3;
+    for (int row = height - 1; row >= 0; --row)
+        out.write(reinterpret_cast<const char*>(rgb.data() + row * row_floats), static_cast<std::streamsize>(row_floats * sizeof(float)));
+    return static_cast<bool>(out);
+}
+
+// Picks the writer matching the file extension of `path`: ".png" gives PNG, anything else binary PPM.
+inline std::unique_ptr<image_writer> make_image_writer(const std::string& path) {
+    auto ends_with = [&](const std::string& suffix) {
+        return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+
+    if (ends_with(".png") || ends_with(".PNG"))
+        return std::make_unique<png_writer>();
+    return std::make_unique<ppm_writer>();
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "hittable.hpp"
+
+// An instance places a shared object (typically the BVH of a group of spheres) in the scene
+// with a transform of its own: a uniform scale, a rotation about the y axis and a
+// translation, applied in that order. The object is stored once however often it is
+// placed, so a scene of a thousand copies of a thousand spheres costs the memory of one
+// copy plus a thousand small instances.
+//
+// Rays are mapped into the object's space instead of the object into world space. The
+// rotation keeps the direction a unit vector and the scale only changes distances, so `t`
+// converts with one multiplication each way. Instances must not contain instances: a
+// candidate remembers only one of them.
+class instance : public hittable {
+  public:
+    // Places `object` scaled by `scale` (> 0), rotated by `rotation_y` degrees about the
+    // y axis and moved by `translation`.
+    instance(shared_ptr<const hittable> object, const vec3& translation, real scale = 1, real rotation_y = 0)
+      : object(object), translation(translation), scale(scale), inverse_scale(1 / scale) {
+        real radians = real(degrees_to_radians(rotation_y));
+        sin_theta = std::sin(radians);
+        cos_theta = std::cos(radians);
+
+        // World box: the corners of the object's box, transformed
+        aabb local = object->bounding_box();
+        for (int corner = 0; corner < 8; ++corner) {
+            point3 p(corner & 1 ? local.x.max : local.x.min, corner & 2 ? local.y.max : local.y.min, corner & 4 ? local.z.max : local.z.min);
+            point3 world = to_world(p);
+            bbox = corner == 0 ? aabb(world, world) : aabb(bbox, aabb(world, world));
+        }
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_candidate& candidate) const override {
+        hit_candidate local = {};
+        if (!object->intersect(to_local(r), interval(ray_t.min * inverse_scale, ray_t.max * inverse_scale), local))
+            return false;
+        candidate = local;
+        candidate.t = local.t * scale;
+        candidate.instance = this;
+        return true;
+    }
+
+    // Builds the record in the object's space with the primitive that was hit, then moves
+    // the hit point and normal back to world space. The rotation leaves the angle between
+    // ray and normal alone, so front_face carries over.
+    void fill_hit_record(const ray& r, const hit_candidate& candidate, hit_record& rec) const override {
+        hit_candidate local = candidate;
+        local.t = candidate.t * inverse_scale;
+        local.instance = nullptr;
+        local.object->fill_hit_record(to_local(r), local, rec);
+        rec.t = candidate.t;
+        rec.p = r.at(rec.t);
+        rec.normal = rotate_to_world(rec.normal);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        return object->occluded(to_local(r), interval(ray_t.min * inverse_scale, ray_t.max * inverse_scale));
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    // Maps point `p` of the object's space to world space.
+    point3 to_world(const point3& p) const { return rotate_to_world(scale * p) + translation; }
+
+  private:
+    shared_ptr<const hittable> object = {}; // The placed object, shared with every other instance of it
+    vec3 translation = {}; // Position of the object's origin in world space
+    real scale = 1; // Uniform scale from object to world space
+    real inverse_scale = 1; // 1 / scale
+    real sin_theta = 0; // Rotation about the y axis
+    real cos_theta = 1;
+    aabb bbox = {}; // Box enclosing the placed object
+
+    vec3 rotate_to_world(const vec3& v) const {
+        return vec3(cos_theta * v.x() + sin_theta * v.z(), v.y(), -sin_theta * v.x() + cos_theta * v.z());
+    }
+
+    vec3 rotate_to_local(const vec3& v) const {
+        return vec3(cos_theta * v.x() - sin_theta * v.z(), v.y(), sin_theta * v.x() + cos_theta * v.z());
+    }
+
+    // `r` in the object's space, with its direction still a unit vector and its time unchanged
+    ray to_local(const ray& r) const {
+        return ray(rotate_to_local(r.origin() - translation) * inverse_scale, rotate_to_local(r.direction()), r.time());
+    }
+};
+
+#endif
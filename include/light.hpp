@@ -0,0 +1,120 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include "material.hpp"
+
+#include <limits>
+#include <vector>
+
+// Explicit light sources for next-event estimation. Instead of waiting for a scattered path
+// to stumble onto a small light, every diffuse hit also sends one shadow ray toward a point
+// chosen on a light, and adds that light's contribution if nothing blocks the way (see
+// camera::direct_light). Paths that do hit a light by scattering still count it; multiple
+// importance sampling weighs both estimates so each one dominates where it has less noise.
+
+// A spherical emitter, as seen from the points it lights.
+struct sphere_light {
+    point3 center = point3(0, 0, 0); // Center at time 0
+    real radius = 0;
+    color radiance = color(0, 0, 0); // Radiance of the sphere's surface
+    vec3 motion = vec3(0, 0, 0); // Distance the center travels from time 0 to time 1 (see sphere)
+
+    // Center of the light at `time`.
+    point3 center_at(real time) const { return center + time * motion; }
+};
+
+// One light sample: the direction toward a point on a light and what arrives along it.
+struct light_sample {
+    vec3 direction = {}; // Unit direction from the shaded point toward the light
+    real distance = 0; // Distance to the sampled point on the light's surface
+    color radiance = {}; // Radiance leaving the light toward the shaded point
+    real pdf = 0; // Probability density of the direction per solid angle (0: no sample)
+};
+
+// Every light of a scene. A light is picked uniformly, then a direction inside the cone the
+// sphere spans as seen from the shaded point, so every sample lands on the light.
+class light_list {
+  public:
+    std::vector<sphere_light> lights = {};
+
+    bool empty() const { return lights.empty(); }
+
+    void add(const point3& center, real radius, const color& radiance, const vec3& motion = vec3(0, 0, 0)) { lights.push_back({center, radius, radiance, motion}); }
+
+    // Samples a direction from point `p` toward one of the lights, as they are at `time`
+    // (the list must not be empty). Draws three numbers from `gen`. Returns false (with
+    // sample.pdf 0) if `p` is inside the chosen light.
+    bool sample(const point3& p, real time, rng& gen, light_sample& sample) const {
+        size_t count = lights.size();
+        size_t index = std::min(count - 1, static_cast<size_t>(gen.next_double() * count));
+        const sphere_light& light = lights[index];
+        double u = gen.next_double();
+        double v = gen.next_double();
+
+        vec3 to_center = light.center_at(time) - p;
+        real distance_squared = to_center.length_squared();
+        real sin_squared = light.radius * light.radius / distance_squared;
+        if (sin_squared >= 1) {
+            sample.pdf = 0;
+            return false;
+        }
+
+        // Cone of directions around the center: 1 - cos is computed as sin^2 / (1 + cos),
+        // which keeps its precision for small, distant lights
+        real cos_max = std::sqrt(1 - sin_squared);
+        real one_minus_cos_max = sin_squared / (1 + cos_max);
+        real one_minus_cos = real(u) * one_minus_cos_max;
+        real cos_theta = 1 - one_minus_cos;
+        real sin_theta = std::sqrt(std::fmax(real(0), one_minus_cos * (2 - one_minus_cos)));
+        real phi = real(2 * pi * v);
+
+        // Orthonormal frame around the direction to the center
+        real distance_to_center = std::sqrt(distance_squared);
+        vec3 w = to_center / distance_to_center;
+        vec3 a = std::fabs(w.x()) > real(0.9) ? vec3(0, 1, 0) : vec3(1, 0, 0);
+        vec3 s = unit_vector(cross(w, a));
+        vec3 t = cross(w, s);
+        sample.direction = unit_vector(sin_theta * std::cos(phi) * s + sin_theta * std::sin(phi) * t + cos_theta * w);
+
+        // Nearest intersection with the sphere along the sampled direction
+        real h = distance_to_center * cos_theta;
+        real inside = light.radius * light.radius - distance_squared * sin_theta * sin_theta;
+        sample.distance = h - std::sqrt(std::fmax(real(0), inside));
+        sample.radiance = light.radiance;
+        sample.pdf = 1 / (real(2 * pi) * one_minus_cos_max * real(count));
+        return true;
+    }
+
+    // Density sample() would have given the direction from `origin` to `hit_point`, a point
+    // on the surface of one of the lights at `time`. Returns 0 if no light has that point on
+    // its surface.
+    real pdf(const point3& origin, const point3& hit_point, real time) const {
+        const sphere_light* found = nullptr;
+        real best = std::numeric_limits<real>::max();
+        for (const sphere_light& light : lights) {
+            real gap = std::fabs((hit_point - light.center_at(time)).length() - light.radius);
+            if (gap < best) {
+                best = gap;
+                found = &light;
+            }
+        }
+        if (!found || best > real(1e-3) * std::fmax(real(1), found->radius))
+            return 0;
+
+        real sin_squared = found->radius * found->radius / (found->center_at(time) - origin).length_squared();
+        if (sin_squared >= 1)
+            return 0;
+        real one_minus_cos_max = sin_squared / (1 + std::sqrt(1 - sin_squared));
+        return 1 / (real(2 * pi) * one_minus_cos_max * real(lights.size()));
+    }
+};
+
+// Power heuristic (beta = 2) weight of a sample drawn with density `pdf` when the other
+// strategy would have drawn it with density `other_pdf`.
+inline real power_heuristic(real pdf, real other_pdf) {
+    real a = pdf * pdf;
+    real b = other_pdf * other_pdf;
+    return a + b > 0 ? a / (a + b) : 0;
+}
+
+#endif
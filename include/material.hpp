@@ -3,10 +3,28 @@
 
 #include "hittable.hpp"
 
+// The built-in material classes. Renderers that process many hits at once (see wavefront.hpp)
+// group hits by kind and call each class's scatter() directly instead of through the vtable.
+enum class material_kind {
+    other, // Any other material class: only reachable through the virtual scatter()
+    lambertian,
+    metal,
+    dielectric,
+    diffuse_light, // Emitter: adds its radiance to paths that hit it and scatters nothing
+};
+
+// Number of material_kind values
+constexpr int material_kind_count = 5;
+
 // Abstract base class for materials, providing a common interface for different types of materials.
 // A material is responsible for how a ray interacts with an object - e.g., reflection, refraction, absorption, etc.
 class material {
   public:
+    // The class of this material, set once by the constructor. A plain field, so sorting
+    // hits by material needs no virtual call.
+    const material_kind kind = material_kind::other;
+
+    material() {}
     virtual ~material() = default;
 
     // Scatter method, defining how rays interact with the surface.
@@ -15,33 +33,45 @@ class material {
     // - rec: information about the hit point (position, normal, etc.).
     // - attenuation: represents how much the color intensity is reduced.
     // - scattered: output parameter for the scattered ray after interaction.
+    // - gen: random number generator of the sample being traced.
     // Returns: true if the ray is scattered, false otherwise.
     virtual bool scatter(
-        [[maybe_unused]] const ray& r_in, [[maybe_unused]] const hit_record& rec, [[maybe_unused]] color& attenuation, [[maybe_unused]] ray& scattered
+        [[maybe_unused]] const ray& r_in, [[maybe_unused]] const hit_record& rec, [[maybe_unused]] color& attenuation, [[maybe_unused]] ray& scattered,
+        [[maybe_unused]] rng& gen
     ) const {
         return false;
     }
+
+    // Reflectance of the surface, used as a guide buffer by the denoiser (see denoiser.hpp).
+    // Materials without a color of their own, like glass, report white.
+    virtual color surface_albedo() const { return color(1, 1, 1); }
+
+  protected:
+    // Constructor for the built-in material classes, which report their kind.
+    explicit material(material_kind kind) : kind(kind) {}
 };
 
 // Lambertian (diffuse) material: scatters light uniformly in all directions.
-class lambertian : public material {
+class lambertian final : public material {
   public:
     // Constructor to initialize the albedo, which defines the material color.
-    lambertian(const color& albedo) : albedo(albedo) {}
+    lambertian(const color& albedo) : material(material_kind::lambertian), albedo(albedo) {}
 
     // Scatter method for lambertian material.
     // It generates a scattered ray in a random direction biased by the normal, simulating a matte surface.
-    bool scatter([[maybe_unused]] const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen)
     const override {
         // Scatter direction is a random direction that is biased by the normal at the hit point.
-        auto scatter_direction = rec.normal + random_unit_vector();
+        auto scatter_direction = rec.normal + random_unit_vector(gen);
 
         // Catch degenerate scatter direction: when the scattered direction is zero, fallback to the normal.
         if (scatter_direction.near_zero())
             scatter_direction = rec.normal;
 
-        // Create the scattered ray from the hit point in the direction of the scatter.
-        scattered = ray(rec.p, scatter_direction);
+        // Create the scattered ray from the hit point in the direction of the scatter, at the
+        // time of the incoming ray. Rays carry unit directions (see hittable), so the sum is
+        // normalized here.
+        scattered = ray(rec.p, unit_vector(scatter_direction), r_in.time());
         
         // Attenuation represents the color and intensity of the ray after the hit.
         attenuation = albedo;
@@ -49,30 +79,46 @@ class lambertian : public material {
         return true;
     }
 
+    color surface_albedo() const override { return albedo; }
+
+    // Reflected fraction of light arriving from `direction` (a unit vector) toward any outgoing
+    // direction, times the cosine at the surface: albedo * cos / pi. Next-event estimation
+    // (see camera::direct_light) weighs light samples with it.
+    color evaluate(const hit_record& rec, const vec3& direction) const {
+        return albedo * (std::fmax(real(0), dot(rec.normal, direction)) * real(1 / pi));
+    }
+
+    // Probability density (per solid angle) of scatter() choosing `direction`: the
+    // cosine-weighted hemisphere, cos / pi.
+    static real pdf(const hit_record& rec, const vec3& direction) {
+        return std::fmax(real(0), dot(rec.normal, direction)) * real(1 / pi);
+    }
+
   private:
     // Albedo of the material, representing how much light is absorbed or reflected (the surface color).
     color albedo = {};
 };
 
 // Metal material: reflects rays, simulating metallic surfaces.
-class metal : public material {
+class metal final : public material {
   public:
     // Constructor with albedo and fuzziness for how rough the metal surface appears.
     // Fuzziness controls the random spread of reflection; it's clamped to 1 to prevent extreme scattering.
-    metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
+    metal(const color& albedo, real fuzz) : material(material_kind::metal), albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
 
     // Scatter method for metal material.
     // Reflects the incoming ray in the direction dictated by the normal, adjusted by fuzziness for rough surfaces.
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen)
     const override {
         // Reflect the incoming ray direction around the surface normal.
+        // Both are unit vectors, so the reflection is one as well.
         vec3 reflected = reflect(r_in.direction(), rec.normal);
         
         // Add a small random deviation proportional to fuzz to simulate surface roughness.
-        reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
+        reflected = reflected + (fuzz * random_unit_vector(gen));
         
         // Create the scattered ray from the hit point in the adjusted reflection direction.
-        scattered = ray(rec.p, reflected);
+        scattered = ray(rec.p, unit_vector(reflected), r_in.time());
         
         // Attenuation for metal is the albedo, which gives it its color/reflective properties.
         attenuation = albedo;
@@ -81,57 +127,59 @@ class metal : public material {
         return (dot(scattered.direction(), rec.normal) > 0);
     }
 
+    color surface_albedo() const override { return albedo; }
+
   private:
     color albedo = {}; // Albedo for the metal, determining its color.
-    double fuzz = {};  // Fuzziness factor, determining the roughness of the metal surface.
+    real fuzz = {};    // Fuzziness factor, determining the roughness of the metal surface.
 };
 
 // Dielectric (transparent) material: simulates glass-like surfaces with refraction and reflection.
-class dielectric : public material {
+class dielectric final : public material {
   public:
     // Constructor with refractive index, describing how much the material bends light.
-    dielectric(double refraction_index) : refraction_index(refraction_index) {}
+    dielectric(real refraction_index) : material(material_kind::dielectric), refraction_index(refraction_index) {}
 
     // Scatter method for dielectric materials.
     // Determines if the ray should reflect or refract based on the refractive index.
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, rng& gen)
     const override {
         // Glass absorbs no color, so attenuation is set to 1 (full transmission).
         attenuation = color(1.0, 1.0, 1.0);
         
         // Ratio of refractive indices depending on whether the ray is entering or exiting the material.
-        double ri = rec.front_face ? (1.0/refraction_index) : refraction_index;
+        real ri = rec.front_face ? (1 / refraction_index) : refraction_index;
 
-        // Unit vector of the incoming ray direction.
-        vec3 unit_direction = unit_vector(r_in.direction());
+        // Unit vector of the incoming ray direction (rays always carry one).
+        const vec3& unit_direction = r_in.direction();
         
         // Calculate the cosine of the angle between the ray and the normal.
-        double cos_theta = std::fmin(dot(-unit_direction, rec.normal), 1.0);
+        real cos_theta = std::fmin(dot(-unit_direction, rec.normal), real(1));
         
         // Calculate the sine of the angle (using trigonometric identity sin^2 + cos^2 = 1).
-        double sin_theta = std::sqrt(1.0 - cos_theta*cos_theta);
+        real sin_theta = std::sqrt(1 - cos_theta*cos_theta);
 
         // Check for total internal reflection (when the ray cannot pass through the surface).
-        bool cannot_refract = ri * sin_theta > 1.0;
+        bool cannot_refract = ri * sin_theta > 1;
 
         // Decide whether to reflect or refract.
         vec3 direction = {};
-        if (cannot_refract || reflectance(cos_theta, ri) > random_double())
+        if (cannot_refract || reflectance(cos_theta, ri) > gen.next_double())
             direction = reflect(unit_direction, rec.normal); // Reflect the ray.
         else
             direction = refract(unit_direction, rec.normal, ri); // Refract the ray.
 
         // Create the scattered ray from the hit point in the calculated direction.
-        scattered = ray(rec.p, direction);
+        scattered = ray(rec.p, direction, r_in.time());
         
         return true;
     }
 
   private:
-    double refraction_index = {}; // Refractive index, determining the bending of light through the material.
+    real refraction_index = {}; // Refractive index, determining the bending of light through the material.
 
     // Schlick's approximation to estimate the reflectance for a given angle and refractive index.
-    static double reflectance(double cosine, double refraction_index) {
+    static real reflectance(real cosine, real refraction_index) {
         // Approximation for reflectance at a given angle.
         auto r0 = (1 - refraction_index) / (1 + refraction_index);
         r0 = r0*r0;
@@ -139,4 +187,41 @@ class dielectric : public material {
     }
 };
 
+// Diffuse emitter: glows with the same radiance in every direction from its front face, and
+// absorbs every ray that hits it. Spheres made of it become light sources that next-event
+// estimation aims shadow rays at (see light.hpp).
+class diffuse_light final : public material {
+  public:
+    diffuse_light(const color& radiance) : material(material_kind::diffuse_light), radiance(radiance) {}
+
+    // Radiance leaving the surface toward the ray that made `rec`. The back face is dark.
+    color emitted(const hit_record& rec) const { return rec.front_face ? radiance : color(0, 0, 0); }
+
+    // Radiance of the front face.
+    const color& emission() const { return radiance; }
+
+  private:
+    color radiance = {}; // Emitted radiance per color channel
+};
+
+// Calls `f` with `mat` as a reference to its concrete class, found from its kind. The
+// built-in classes are final, so calls made inside `f` bind statically and can be inlined
+// instead of going through the vtable. Materials of kind `other` are passed as `material`
+// and keep the virtual calls.
+template <typename function>
+decltype(auto) visit_material(const material& mat, function&& f) {
+    switch (mat.kind) {
+    case material_kind::lambertian:
+        return f(static_cast<const lambertian&>(mat));
+    case material_kind::metal:
+        return f(static_cast<const metal&>(mat));
+    case material_kind::dielectric:
+        return f(static_cast<const dielectric&>(mat));
+    case material_kind::diffuse_light:
+        return f(static_cast<const diffuse_light&>(mat));
+    default:
+        return f(mat);
+    }
+}
+
 #endif
@@ -0,0 +1,164 @@
+#ifndef PARTIAL_IMAGE_H
+#define PARTIAL_IMAGE_H
+
+#include "framebuffer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Partial framebuffers for distributed rendering. A node renders a band of rows and/or a
+// range of sample indices of a frame (camera::row_begin/row_end, sample_begin/sample_end)
+// and writes the linear, unquantized sum of those samples for every pixel of the band.
+// Every node uses the same scene and seed, and each sample has its own generator, so the
+// nodes together trace exactly the samples of a single-process render. merge_partials()
+// adds the parts up and divides by the number of samples of every pixel. Row bands merge
+// bit for bit into the single-process image; sample ranges only differ by the order in
+// which the sums were added.
+//
+// File layout: partial_image_header, then (row_end - row_begin) * width RGB triplets of
+// doubles, row by row from row_begin. Version 1 headers end before frame_key.
+
+// Magic bytes and version at the start of a partial framebuffer file
+constexpr char partial_image_magic[8] = {'R', 'T', 'P', 'A', 'R', 'T', 'I', 'A'};
+constexpr std::uint32_t partial_image_version = 2; // Version 2 added partial_image_header::frame_key
+
+// Header of a partial framebuffer file.
+struct partial_image_header {
+    char magic[8] = {};
+    std::uint32_t version = 0;
+    std::int32_t width = 0; // Width of the whole frame
+    std::int32_t height = 0; // Height of the whole frame
+    std::int32_t row_begin = 0; // First row of the band
+    std::int32_t row_end = 0; // One past the last row of the band
+    std::int32_t sample_begin = 0; // First sample index traced for every pixel
+    std::int32_t sample_end = 0; // One past the last sample index
+    std::int32_t frame_samples = 0; // Samples per pixel of the whole frame
+    std::uint64_t seed = 0; // Seed of the per-sample random streams (camera::seed)
+    std::uint64_t frame_key = 0; // camera::render_key() of the frame: scene and view (0 in version 1 files)
+};
+
+// The sums of one node's samples over one band of rows.
+struct partial_image {
+    partial_image_header header = {};
+    std::vector<double> sums = {}; // Sum of the band's samples, three doubles per pixel
+
+    // Number of samples every pixel of the band holds.
+    int samples() const { return header.sample_end - header.sample_begin; }
+
+    // Writes the partial framebuffer to `path`. Returns false if the file could not be written.
+    bool write(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary);
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(sums.data()), static_cast<std::streamsize>(sums.size() * sizeof(double)));
+        return static_cast<bool>(out);
+    }
+
+    // Reads a partial framebuffer from `path`. Returns false with a message on std::cerr on failure.
+    bool read(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        header = partial_image_header();
+        const size_t version_1_size = offsetof(partial_image_header, frame_key);
+        if (!in || !in.read(reinterpret_cast<char*>(&header), version_1_size)) {
+            std::cerr << "Error: Could not read " << path << ".\n";
+            return false;
+        }
+        if (std::memcmp(header.magic, partial_image_magic, sizeof(header.magic)) != 0 || header.version < 1 || header.version > partial_image_version) {
+            std::cerr << "Error: " << path << " is not a partial framebuffer.\n";
+            return false;
+        }
+        if (header.version >= 2 && !in.read(reinterpret_cast<char*>(&header) + version_1_size, sizeof(header) - version_1_size)) {
+            std::cerr << "Error: " << path << " is truncated.\n";
+            return false;
+        }
+        if (header.width <= 0 || header.height <= 0 || header.row_begin < 0 || header.row_end > header.height ||
+            header.row_begin >= header.row_end || header.sample_begin < 0 || header.sample_end > header.frame_samples ||
+            header.sample_begin >= header.sample_end) {
+            std::cerr << "Error: " << path << " has an invalid header.\n";
+            return false;
+        }
+
+        // The header must describe exactly the sums that follow it. Both factors are below 2^31,
+        // so the pixel count fits; it is compared against the bytes left before it is multiplied.
+        std::streamoff header_end = in.tellg();
+        in.seekg(0, std::ios::end);
+        std::uint64_t bytes_left = static_cast<std::uint64_t>(in.tellg() - header_end);
+        in.seekg(header_end);
+        const std::uint64_t pixel_bytes = 3 * sizeof(double);
+        std::uint64_t pixel_count = static_cast<std::uint64_t>(header.row_end - header.row_begin) * static_cast<std::uint64_t>(header.width);
+        if (pixel_count > bytes_left / pixel_bytes) {
+            std::cerr << "Error: " << path << " is truncated.\n";
+            return false;
+        }
+        if (pixel_count * pixel_bytes != bytes_left) {
+            std::cerr << "Error: " << path << " does not match the size its header gives.\n";
+            return false;
+        }
+
+        sums.resize(static_cast<size_t>(pixel_count) * 3);
+        if (!in.read(reinterpret_cast<char*>(sums.data()), static_cast<std::streamsize>(sums.size() * sizeof(double)))) {
+            std::cerr << "Error: " << path << " is truncated.\n";
+            return false;
+        }
+        return true;
+    }
+};
+
+// Adds up `parts` into `image`: every pixel becomes the sum of its samples divided by their
+// number. All parts must come from the same frame. Pixels without samples stay black, and
+// pixels left with fewer than the frame's samples are reported, as are overlapping parts.
+// Returns false with a message on std::cerr if the parts do not fit together.
+inline bool merge_partials(const std::vector<partial_image>& parts, framebuffer& image) {
+    if (parts.empty()) {
+        std::cerr << "Error: No partial framebuffers to merge.\n";
+        return false;
+    }
+    const partial_image_header& frame = parts[0].header;
+    for (const auto& part : parts) {
+        if (part.header.width != frame.width || part.header.height != frame.height || part.header.frame_samples != frame.frame_samples ||
+            part.header.seed != frame.seed || part.header.frame_key != frame.frame_key) {
+            std::cerr << "Error: Partial framebuffers come from different frames.\n";
+            return false;
+        }
+    }
+
+    // Sum every part into one buffer and count the samples of every pixel
+    size_t pixel_count = static_cast<size_t>(frame.width) * frame.height;
+    std::vector<double> sums(pixel_count * 3, 0.0);
+    std::vector<int> counts(pixel_count, 0);
+    for (const auto& part : parts) {
+        size_t first = static_cast<size_t>(part.header.row_begin) * frame.width;
+        size_t band_pixels = static_cast<size_t>(part.header.row_end - part.header.row_begin) * frame.width;
+        for (size_t i = 0; i < band_pixels; ++i) {
+            for (int c = 0; c < 3; ++c)
+                sums[3 * (first + i) + c] += part.sums[3 * i + c];
+            counts[first + i] += part.samples();
+        }
+    }
+
+    size_t incomplete = 0, oversampled = 0;
+    image = framebuffer(frame.width, frame.height);
+    for (size_t i = 0; i < pixel_count; ++i) {
+        incomplete += counts[i] < frame.frame_samples ? 1 : 0;
+        oversampled += counts[i] > frame.frame_samples ? 1 : 0;
+        if (counts[i] == 0)
+            continue;
+        // Same scaling as the camera, so a band rendered in one piece is reproduced exactly
+        real scale = real(1.0 / counts[i]);
+        image.pixels[i] = scale * color(sums[3 * i], sums[3 * i + 1], sums[3 * i + 2]);
+    }
+
+    if (incomplete > 0)
+        std::cerr << "Warning: " << incomplete << " pixels have fewer than " << frame.frame_samples << " samples.\n";
+    if (oversampled > 0)
+        std::cerr << "Warning: " << oversampled << " pixels have more than " << frame.frame_samples << " samples (overlapping parts).\n";
+    return true;
+}
+
+#endif
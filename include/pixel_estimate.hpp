@@ -0,0 +1,46 @@
+#ifndef PIXEL_ESTIMATE_H
+#define PIXEL_ESTIMATE_H
+
+// pixel_estimate accumulates the samples of one pixel for adaptive sampling. Besides the
+// color sum it tracks the first two moments of the sample luminance, which gives a cheap
+// estimate of how noisy the pixel's mean still is.
+struct pixel_estimate {
+    color sum = color(0, 0, 0); // Sum of every sample color
+    real luminance_sum = 0; // Sum of the sample luminances
+    real luminance_squared_sum = 0; // Sum of the squared sample luminances
+    int samples = 0; // Number of samples taken so far
+    bool converged = false; // Set once the pixel is quiet enough to stop sampling
+
+    // Adds one sample.
+    void add(const color& sample) {
+        real y = luminance(sample);
+        sum += sample;
+        luminance_sum += y;
+        luminance_squared_sum += y * y;
+        ++samples;
+    }
+
+    // Returns the average color of the samples so far (black before the first sample).
+    color mean() const { return samples > 0 ? sum / real(samples) : color(0, 0, 0); }
+
+    // Estimated error of the pixel's mean luminance as it will appear on screen. The
+    // standard error of the mean is scaled by the slope of the gamma 2 transfer curve,
+    // d sqrt(y) = dy / (2 sqrt(y)), so dark pixels need less absolute precision to
+    // look as clean as bright ones.
+    real display_error() const {
+        if (samples < 2)
+            return infinity;
+        real n = real(samples);
+        real mean_y = luminance_sum / n;
+        real variance = std::fmax(real(0), (luminance_squared_sum - n * mean_y * mean_y) / (n - 1));
+        real standard_error = std::sqrt(variance / n);
+        return standard_error / (2 * std::sqrt(std::fmax(mean_y, real(1.0 / 256))));
+    }
+
+    // Rec. 709 luminance of a linear color.
+    static real luminance(const color& c) {
+        return real(0.2126) * c.x() + real(0.7152) * c.y() + real(0.0722) * c.z();
+    }
+};
+
+#endif
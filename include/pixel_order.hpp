@@ -0,0 +1,116 @@
+#ifndef PIXEL_ORDER_H
+#define PIXEL_ORDER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Orders in which the pixels of a tile are traced, and the tiles of an image handed out.
+// Row by row, consecutive rays run along one scanline and the ray after the last pixel of
+// a row starts back at the other edge of the tile. Along a space-filling curve,
+// consecutive pixels stay close in both directions. Their rays then meet the same BVH
+// nodes and spheres, which are still in the cache from the ray before. Tiles are ordered
+// by the same curve, so the block of tiles each worker starts with (see thread_pool)
+// covers a compact patch of the image instead of a strip.
+//
+// - Morton (Z-order): the pixel's index is its x and y bits interleaved. Cheap to compute,
+//   but it jumps at every power-of-two boundary.
+// - Hilbert: consecutive pixels are always neighbours, and every run of the curve stays
+//   inside a compact block.
+//
+// The order changes only the schedule, never the image: every sample has its own random
+// stream (see rng::for_sample) and every pixel its own sum.
+enum class pixel_order {
+    row_major, // Row by row from the top-left corner
+    morton, // Z-order curve
+    hilbert, // Hilbert curve
+};
+
+// Parses "row", "morton" or "hilbert" into `order`. Returns false for anything else.
+inline bool parse_pixel_order(const std::string& name, pixel_order& order) {
+    if (name == "row")
+        order = pixel_order::row_major;
+    else if (name == "morton")
+        order = pixel_order::morton;
+    else if (name == "hilbert")
+        order = pixel_order::hilbert;
+    else
+        return false;
+    return true;
+}
+
+// Spreads the 32 bits of `x` out to the even bits of the result.
+inline std::uint64_t spread_bits(std::uint32_t x) {
+    std::uint64_t v = x;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+    v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+    v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+    v = (v | (v << 2)) & 0x3333333333333333ull;
+    v = (v | (v << 1)) & 0x5555555555555555ull;
+    return v;
+}
+
+// Position of (x, y) along the Morton curve.
+inline std::uint64_t morton_index(std::uint32_t x, std::uint32_t y) {
+    return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+// Position of (x, y) along the Hilbert curve filling a square of side `side` (a power of
+// two larger than x and y). Walks down from the largest quadrant, rotating the
+// coordinates into the orientation the curve has inside each one.
+inline std::uint64_t hilbert_index(std::uint32_t side, std::uint32_t x, std::uint32_t y) {
+    std::uint64_t index = 0;
+    for (std::uint32_t half = side / 2; half > 0; half /= 2) {
+        std::uint32_t right = (x & half) ? 1 : 0;
+        std::uint32_t top = (y & half) ? 1 : 0;
+        index += static_cast<std::uint64_t>(half) * half * ((3 * right) ^ top);
+        if (top == 0) {
+            if (right == 1) {
+                x = side - 1 - x;
+                y = side - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return index;
+}
+
+// Position of cell (x, y) of a grid `width` cells wide in `order`.
+inline std::uint64_t pixel_order_index(pixel_order order, int width, int height, int x, int y) {
+    std::uint32_t side = 1;
+    while (side < static_cast<std::uint32_t>(std::max(width, height)))
+        side *= 2;
+    switch (order) {
+    case pixel_order::morton:
+        return morton_index(x, y);
+    case pixel_order::hilbert:
+        return hilbert_index(side, x, y);
+    default:
+        return static_cast<std::uint64_t>(y) * width + x;
+    }
+}
+
+// Offset of a pixel from the top-left corner of its tile.
+struct pixel_offset {
+    std::uint16_t x = 0;
+    std::uint16_t y = 0;
+};
+
+// Every cell of a `width` x `height` block in `order`.
+inline std::vector<pixel_offset> make_pixel_order(pixel_order order, int width, int height) {
+    std::vector<std::pair<std::uint64_t, pixel_offset>> keyed;
+    keyed.reserve(static_cast<size_t>(width) * height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            keyed.push_back({pixel_order_index(order, width, height, x, y), {static_cast<std::uint16_t>(x), static_cast<std::uint16_t>(y)}});
+    std::sort(keyed.begin(), keyed.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<pixel_offset> cells;
+    cells.reserve(keyed.size());
+    for (const auto& [key, cell] : keyed)
+        cells.push_back(cell);
+    return cells;
+}
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "image_writer.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Live preview of a render in progress. While the workers trace tiles, the main thread
+// (which otherwise only waits for them) copies every finished tile into a preview image
+// and publishes an 8-bit snapshot of it at a fixed interval, after every progressive pass
+// and once more when the image is final. The workers only flag each tile as finished, so
+// the preview costs them nothing. Two outputs are supported, alone or together:
+//
+// - An image file that is replaced atomically (written to a temporary file, then renamed),
+//   so a viewer polling it never sees half a frame and a killed render leaves its latest
+//   snapshot behind.
+// - A POSIX shared-memory object holding two frame slots (double buffering). A new frame is
+//   written into the slot readers are not directed to and then published with one atomic
+//   store; readers copy without taking any lock, and a per-slot sequence number tells them
+//   when the writer lapped them mid-copy (a seqlock). read_preview_shm() is the reader.
+
+// Magic bytes and version at the start of the preview shared memory
+constexpr char preview_shm_magic[8] = {'R', 'T', 'P', 'R', 'E', 'V', 'I', 'W'};
+constexpr std::uint32_t preview_shm_version = 1;
+
+// Header of the preview shared memory. It is followed by two slots of width * height RGB
+// triplets of bytes, row by row from the top.
+struct preview_shm_header {
+    char magic[8] = {};
+    std::uint32_t version = 0;
+    std::int32_t width = 0; // Image width in pixels
+    std::int32_t height = 0; // Image height in pixels
+    std::uint32_t reserved = 0;
+    std::atomic<std::uint64_t> frame; // Number of the latest complete frame, held by slot frame % 2 (0: none yet)
+    std::atomic<std::uint64_t> slot_sequence[2]; // 2 * frame while a slot holds `frame`, odd while it is being written
+    std::atomic<std::uint32_t> finished; // 1 once the latest frame is the final image
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the preview shared memory needs lock-free 64-bit atomics");
+
+// Publishes snapshots of a render to an image file and/or a shared-memory object.
+class preview_stream {
+public:
+    preview_stream() {}
+    preview_stream(const preview_stream&) = delete;
+    preview_stream& operator=(const preview_stream&) = delete;
+
+    ~preview_stream() {
+        if (shared)
+            ::munmap(shared, shared_size);
+    }
+
+    // Sets up the outputs for an image of the given size: `file_path` for the image file
+    // ("" for none; ".png" selects PNG) and `shm_name` for the shared memory (a POSIX name
+    // like "/raytracer"; "" for none). Returns false with a message on std::cerr on failure.
+    bool open(const std::string& file_path, const std::string& shm_name, int width, int height) {
+        path = file_path;
+        shm = shm_name;
+        image_width = width;
+        image_height = height;
+        if (shm_name.empty())
+            return true;
+
+        frame_bytes = static_cast<size_t>(width) * height * 3;
+        shared_size = sizeof(preview_shm_header) + 2 * frame_bytes;
+        int fd = ::shm_open(shm_name.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(shared_size)) != 0) {
+            std::cerr << "Error: Could not create the shared memory " << shm_name << ".\n";
+            if (fd >= 0)
+                ::close(fd);
+            return false;
+        }
+        void* mapping = ::mmap(nullptr, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Error: Could not map the shared memory " << shm_name << ".\n";
+            return false;
+        }
+
+        // A fresh header: readers ignore the object until the magic is in place
+        shared = static_cast<unsigned char*>(mapping);
+        preview_shm_header* header = new (shared) preview_shm_header();
+        header->version = preview_shm_version;
+        header->width = width;
+        header->height = height;
+        header->frame.store(0, std::memory_order_relaxed);
+        header->slot_sequence[0].store(0, std::memory_order_relaxed);
+        header->slot_sequence[1].store(0, std::memory_order_relaxed);
+        header->finished.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header->magic, preview_shm_magic, sizeof(header->magic));
+        return true;
+    }
+
+    // True if open() was last called with these arguments, so the outputs can be reused by
+    // the next render (frame numbers in the shared memory then keep counting up).
+    bool opened_as(const std::string& file_path, const std::string& shm_name, int width, int height) const {
+        return path == file_path && shm == shm_name && image_width == width && image_height == height;
+    }
+
+    // Publishes `rgb` (width * height * 3 bytes) as the next frame; `final` marks the
+    // finished image. Returns false with a message on std::cerr if the file could not be written.
+    bool publish(const std::vector<unsigned char>& rgb, bool final) {
+        if (shared) {
+            preview_shm_header* header = reinterpret_cast<preview_shm_header*>(shared);
+            std::uint64_t next = header->frame.load(std::memory_order_relaxed) + 1;
+            int slot = static_cast<int>(next % 2);
+
+            // Odd while writing; the fence keeps the copy from moving above the store
+            header->slot_sequence[slot].store(2 * next - 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            std::memcpy(shared + sizeof(preview_shm_header) + slot * frame_bytes, rgb.data(), frame_bytes);
+            header->slot_sequence[slot].store(2 * next, std::memory_order_release);
+            header->finished.store(final ? 1 : 0, std::memory_order_relaxed);
+            header->frame.store(next, std::memory_order_release);
+        }
+
+        if (!path.empty()) {
+            std::string temporary_path = path + ".tmp";
+            if (!make_image_writer(path)->write(temporary_path, image_width, image_height, rgb) ||
+                std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+                std::cerr << "\nError: Could not write the preview " << path << ".\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::string path = ""; // Preview image file ("" for none)
+    std::string shm = ""; // Name of the shared memory ("" for none)
+    int image_width = 0;
+    int image_height = 0;
+    unsigned char* shared = nullptr; // The shared-memory mapping (header, then two slots), or null
+    size_t shared_size = 0; // Size of the mapping in bytes
+    size_t frame_bytes = 0; // Size of one slot in bytes
+};
+
+// Copies the latest frame of the preview shared memory `shm_name` into `rgb` and its size
+// into width and height; `frame` receives its number (0 while nothing has been published)
+// and `finished` whether it is the final image. Never blocks the renderer: a copy the
+// writer overtook is retried. Returns false with a message on std::cerr on failure.
+inline bool read_preview_shm(const std::string& shm_name, std::vector<unsigned char>& rgb, int& width, int& height, std::uint64_t& frame, bool& finished) {
+    int fd = ::shm_open(shm_name.c_str(), O_RDONLY, 0);
+    struct stat info = {};
+    if (fd < 0 || ::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(preview_shm_header)) {
+        std::cerr << "Error: No preview shared memory " << shm_name << ".\n";
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error: Could not map the preview shared memory " << shm_name << ".\n";
+        return false;
+    }
+
+    const unsigned char* shared = static_cast<const unsigned char*>(mapping);
+    const preview_shm_header* header = reinterpret_cast<const preview_shm_header*>(shared);
+    size_t frame_bytes = static_cast<size_t>(header->width) * header->height * 3;
+    if (std::memcmp(header->magic, preview_shm_magic, sizeof(header->magic)) != 0 || header->version != preview_shm_version ||
+        header->width <= 0 || header->height <= 0 || size < sizeof(preview_shm_header) + 2 * frame_bytes) {
+        std::cerr << "Error: " << shm_name << " is not a preview shared memory.\n";
+        ::munmap(mapping, size);
+        return false;
+    }
+
+    width = header->width;
+    height = header->height;
+    rgb.resize(frame_bytes);
+    while (true) {
+        frame = header->frame.load(std::memory_order_acquire);
+        finished = header->finished.load(std::memory_order_relaxed) != 0;
+        if (frame == 0)
+            break;
+        int slot = static_cast<int>(frame % 2);
+        std::uint64_t before = header->slot_sequence[slot].load(std::memory_order_acquire);
+        if (before != 2 * frame)
+            continue; // The writer has already moved on to this slot
+        std::memcpy(rgb.data(), shared + sizeof(preview_shm_header) + slot * frame_bytes, frame_bytes);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->slot_sequence[slot].load(std::memory_order_relaxed) == before)
+            break; // Nothing was written to the slot during the copy
+    }
+    ::munmap(mapping, size);
+    return true;
+}
+
+#endif
@@ -6,25 +6,34 @@
 // The ray class represents a mathematical ray in 3D space, which is defined by an
 // origin point and a direction vector. This class will be central in ray tracing,
 // where rays are used to sample the environment (e.g., check for intersections with objects).
-class ray {
+// Like vec3_t it is templated on the scalar type; `ray` is the renderer's precision.
+// Every ray also carries the moment it samples: a time within the camera's shutter
+// interval, at which moving objects are tested (see camera::shutter_open).
+template <typename T>
+class ray_t {
   public:
     // Default constructor: Initializes a ray with no specific origin or direction.
     // This might be used if we need to declare a ray without immediately defining it.
-    ray() {}
+    ray_t() {}
 
     // Parameterized constructor: Initializes a ray with a specified origin and direction.
     // Parameters:
     // - origin: A point in 3D space where the ray starts.
     // - direction: A vector that represents the direction of the ray.
-    ray(const point3& origin, const vec3& direction) : orig(origin), dir(direction) {}
+    // - time: The moment the ray exists at, 0 at the start of the shutter interval and 1 at its end.
+    ray_t(const vec3_t<T>& origin, const vec3_t<T>& direction, T time = 0) : orig(origin), dir(direction), tm(time) {}
 
     // Returns the origin of the ray.
     // The origin is the starting point of the ray in 3D space.
-    const point3& origin() const  { return orig; }
+    const vec3_t<T>& origin() const  { return orig; }
 
     // Returns the direction of the ray.
     // The direction vector represents the direction the ray is traveling.
-    const vec3& direction() const { return dir; }
+    const vec3_t<T>& direction() const { return dir; }
+
+    // Returns the time of the ray. Rays scattered from a hit keep the time of the ray that
+    // made the hit, so a whole path sees the scene at one moment.
+    T time() const { return tm; }
 
     // Calculates a point along the ray at a given distance `t`.
     // The formula is derived from the parametric equation of a line in 3D space:
@@ -35,17 +44,25 @@ class ray {
     // Parameters:
     // - t: A scalar value that scales the direction vector to determine how far along
     //      the ray the point is from the origin.
-    point3 at(double t) const {
+    vec3_t<T> at(T t) const {
         return orig + t*dir;
     }
 
   private:
     // The origin of the ray, a point in 3D space. This is where the ray starts.
-    point3 orig = {};
+    vec3_t<T> orig = {};
+
+    // The direction of the ray, a vector in 3D space, indicating the direction in which the
+    // ray is traveling. The renderer only creates rays with unit directions (the camera and
+    // the materials normalize them), and the intersection tests rely on it: `t` is then the
+    // distance from the origin.
+    vec3_t<T> dir = {};
 
-    // The direction of the ray, a vector in 3D space. This vector is normalized (typically
-    // has a length of 1) and indicates the direction in which the ray is traveling.
-    vec3 dir = {};
+    // The time of the ray within the shutter interval, see time().
+    T tm = 0;
 };
 
+// The ray type used by the renderer, in the precision selected at build time
+using ray = ray_t<real>;
+
 #endif
@@ -0,0 +1,33 @@
+#ifndef RENDER_KERNEL_H
+#define RENDER_KERNEL_H
+
+#include <utility>
+
+// Compile-time render kernels. A few camera settings stay the same for every sample of a
+// frame but would otherwise be tested for every ray or bounce: whether the lens blurs,
+// whether the lights are sampled directly, whether Russian roulette can end a path. The
+// camera's tile loops, ray generation and path tracing are templates on one of these
+// structs, and camera::initialize() picks the instantiation matching the settings once per
+// render (see camera::kernel_table). A switched-off feature is then not merely skipped: its
+// code is gone from the loop, and what is left inlines better.
+template <bool lens_blur, bool light_sampling, bool roulette>
+struct render_kernel {
+    static constexpr bool depth_of_field = lens_blur; // Camera rays start on the lens disk (camera::lens_aperture > 0)
+    static constexpr bool next_event = light_sampling; // Diffuse hits sample the lights (camera::next_event with lights)
+    static constexpr bool russian_roulette = roulette; // Paths may be ended early (camera::roulette_depth > 0)
+};
+
+// Number of render_kernel instantiations, one per combination of the flags
+constexpr int render_kernel_count = 8;
+
+// The render_kernel whose flags are the bits of `index` (bit 0: depth_of_field, bit 1:
+// next_event, bit 2: russian_roulette).
+template <int index>
+using render_kernel_at = render_kernel<(index & 1) != 0, (index & 2) != 0, (index & 4) != 0>;
+
+// Index of the render_kernel with the given flags, as render_kernel_at counts them.
+inline int render_kernel_index(bool depth_of_field, bool next_event, bool russian_roulette) {
+    return (depth_of_field ? 1 : 0) | (next_event ? 2 : 0) | (russian_roulette ? 4 : 0);
+}
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Optional instrumentation of the renderer. Building with -DRT_STATS turns on per-thread
+// counters (rays, intersection tests, bounce depths, scatter events per material class)
+// and phase timers, which camera::render merges and reports after every render. Without
+// RT_STATS every RT_STAT(...) statement and RT_STAT_TIMER(...) declaration disappears at
+// compile time, so the normal build pays nothing.
+//
+//     RT_STAT(stats.rays++);                                     // count an event
+//     RT_STAT_TIMER(stats_phase::intersect);                     // time the rest of the scope (one per scope)
+#ifdef RT_STATS
+#define RT_STAT(statement) do { render_stats& stats = render_stats::local(); statement; } while (0)
+#define RT_STAT_TIMER(phase) phase_timer rt_stat_timer(phase)
+#else
+#define RT_STAT(statement) do {} while (0)
+#define RT_STAT_TIMER(phase) do {} while (0)
+#endif
+
+// Phases of a render that get their own timer.
+enum class stats_phase {
+    camera_rays, // Generating camera rays
+    intersect, // Finding the closest hit of a ray
+    scatter, // Material scattering
+    output, // Quantizing and writing the image
+};
+
+constexpr int stats_phase_count = 4;
+
+// Counters of one thread, or of a whole render once merged.
+struct render_stats {
+    static constexpr int max_tracked_depth = 64; // Deeper bounces are counted in the last bin
+
+    std::uint64_t rays = 0; // Rays intersected with the scene
+    std::uint64_t primary_rays = 0; // Camera rays (bounce 0)
+    std::uint64_t secondary_rays = 0; // Scattered rays (bounce 1 and up)
+    std::uint64_t misses = 0; // Rays that escaped to the background
+    std::uint64_t box_tests = 0; // Ray / bounding box slab tests
+    std::uint64_t primitive_tests = 0; // Ray / object tests (a SIMD batch counts every sphere)
+    std::uint64_t absorbed = 0; // Paths ended by a material absorbing the ray
+    std::uint64_t roulette_kills = 0; // Paths ended by Russian roulette
+    std::uint64_t shadow_rays = 0; // Rays sent toward a light by next-event estimation
+    std::uint64_t shadowed = 0; // Shadow rays blocked before reaching the light
+    std::array<std::uint64_t, 5> scatters = {}; // Scatter events per material_kind (material_kind_count entries)
+    std::array<std::uint64_t, max_tracked_depth> path_depths = {}; // Number of paths that ended after n bounces
+    std::array<std::uint64_t, stats_phase_count> phase_ns = {}; // Time spent in each phase, in nanoseconds
+
+    // Adds the counters of `other` to this one.
+    void merge(const render_stats& other) {
+        rays += other.rays;
+        primary_rays += other.primary_rays;
+        secondary_rays += other.secondary_rays;
+        misses += other.misses;
+        box_tests += other.box_tests;
+        primitive_tests += other.primitive_tests;
+        absorbed += other.absorbed;
+        roulette_kills += other.roulette_kills;
+        shadow_rays += other.shadow_rays;
+        shadowed += other.shadowed;
+        for (size_t i = 0; i < scatters.size(); ++i)
+            scatters[i] += other.scatters[i];
+        for (size_t i = 0; i < path_depths.size(); ++i)
+            path_depths[i] += other.path_depths[i];
+        for (size_t i = 0; i < phase_ns.size(); ++i)
+            phase_ns[i] += other.phase_ns[i];
+    }
+
+    // Counts a path that ended after `depth` bounces.
+    void end_path(int depth) { path_depths[std::min(depth, max_tracked_depth - 1)]++; }
+
+    // Writes the counters as one JSON object.
+    void write_json(std::ostream& out) const {
+        static const char* kind_names[] = {"other", "lambertian", "metal", "dielectric", "diffuse_light"};
+        static const char* phase_names[] = {"camera_rays", "intersect", "scatter", "output"};
+        double per_ray = rays > 0 ? 1.0 / double(rays) : 0;
+
+        out << "{\n";
+        out << "  \"rays\": " << rays << ",\n";
+        out << "  \"primary_rays\": " << primary_rays << ",\n";
+        out << "  \"secondary_rays\": " << secondary_rays << ",\n";
+        out << "  \"misses\": " << misses << ",\n";
+        out << "  \"box_tests\": " << box_tests << ",\n";
+        out << "  \"primitive_tests\": " << primitive_tests << ",\n";
+        out << "  \"box_tests_per_ray\": " << double(box_tests) * per_ray << ",\n";
+        out << "  \"primitive_tests_per_ray\": " << double(primitive_tests) * per_ray << ",\n";
+        out << "  \"absorbed\": " << absorbed << ",\n";
+        out << "  \"roulette_kills\": " << roulette_kills << ",\n";
+        out << "  \"shadow_rays\": " << shadow_rays << ",\n";
+        out << "  \"shadowed\": " << shadowed << ",\n";
+        out << "  \"scatters\": {";
+        for (size_t i = 0; i < scatters.size(); ++i)
+            out << (i ? ", " : "") << '"' << kind_names[i] << "\": " << scatters[i];
+        out << "},\n";
+
+        // Histogram up to the deepest bin that was used
+        size_t used = path_depths.size();
+        while (used > 0 && path_depths[used - 1] == 0)
+            --used;
+        out << "  \"path_depths\": [";
+        for (size_t i = 0; i < used; ++i)
+            out << (i ? ", " : "") << path_depths[i];
+        out << "],\n";
+
+        // Phase times are summed over threads, so they can exceed the wall-clock time
+        out << "  \"phase_ms\": {";
+        for (size_t i = 0; i < phase_ns.size(); ++i)
+            out << (i ? ", " : "") << '"' << phase_names[i] << "\": " << double(phase_ns[i]) / 1e6;
+        out << "}\n";
+        out << "}\n";
+    }
+
+    // The calling thread's counters. Each thread registers its counters once, so collect()
+    // can find them; threads of the pool live as long as the pool, and with it the counters.
+    static render_stats& local() {
+        thread_local render_stats& stats = registry().add();
+        return stats;
+    }
+
+    // Merges the counters of every thread into one and resets them for the next render.
+    // Call it while no thread is rendering.
+    static render_stats collect() {
+        stats_registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.lock);
+        render_stats total;
+        for (auto& stats : r.all) {
+            total.merge(*stats);
+            *stats = render_stats();
+        }
+        return total;
+    }
+
+  private:
+    struct stats_registry {
+        std::mutex lock;
+        std::vector<std::unique_ptr<render_stats>> all; // Counters are never freed, so threads that exit leave them valid
+
+        render_stats& add() {
+            std::lock_guard<std::mutex> guard(lock);
+            all.push_back(std::make_unique<render_stats>());
+            return *all.back();
+        }
+    };
+
+    static stats_registry& registry() {
+        static stats_registry r;
+        return r;
+    }
+};
+
+// Adds the time from its construction to its destruction to one phase of the calling
+// thread's counters (used through RT_STAT_TIMER).
+class phase_timer {
+  public:
+    explicit phase_timer(stats_phase phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+
+    ~phase_timer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        render_stats::local().phase_ns[static_cast<int>(phase)] += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    phase_timer(const phase_timer&) = delete;
+    phase_timer& operator=(const phase_timer&) = delete;
+
+  private:
+    stats_phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+// Mixes the bits of a 64-bit value (splitmix64 finalizer). Used to turn structured inputs
+// such as (seed, pixel, sample) into well-spread generator seeds.
+inline std::uint64_t mix64(std::uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// rng is a small PCG32 random number generator (64 bits of state, 32-bit outputs).
+// It is cheap to construct, so the renderer creates a fresh one for every sample of
+// every pixel. A sample's random numbers then depend only on the seed, the pixel and
+// the sample index, which keeps renders reproducible however the work is scheduled.
+// Generators are passed explicitly (by reference) to everything that needs randomness.
+class rng {
+public:
+    // Creates a generator for the given seed and stream. Different streams with the same
+    // seed produce independent sequences.
+    explicit rng(std::uint64_t seed = 0, std::uint64_t stream = 0) : increment((stream << 1) | 1) {
+        next_uint();
+        state += seed;
+        next_uint();
+    }
+
+    // Creates the generator for sample `sample_index` of pixel `pixel_index`.
+    static rng for_sample(std::uint64_t seed, std::uint64_t pixel_index, std::uint64_t sample_index) {
+        return rng(mix64(seed + mix64(pixel_index)), sample_index);
+    }
+
+    // Returns the next 32 random bits.
+    std::uint32_t next_uint() {
+        std::uint64_t old_state = state;
+        state = old_state * 6364136223846793005ull + increment;
+        auto xorshifted = static_cast<std::uint32_t>(((old_state >> 18) ^ old_state) >> 27);
+        auto rotation = static_cast<std::uint32_t>(old_state >> 59);
+        return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+    }
+
+    // Returns a random real in [0,1).
+    double next_double() {
+        return next_uint() * 0x1.0p-32;
+    }
+
+    // Returns a random real in [min,max).
+    double next_double(double min, double max) {
+        return min + (max - min) * next_double();
+    }
+
+private:
+    std::uint64_t state = 0; // Current generator state
+    std::uint64_t increment = 1; // Stream selector, always odd
+};
+
+// Generator used for setup work outside the renderer (such as building a random scene).
+// Each thread has its own, so there is no shared state between threads.
+inline rng& default_rng() {
+    thread_local rng generator;
+    return generator;
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rng.hpp"
+
+#include <cstdint>
+#include <string>
+
+// Sample patterns for the camera's 2D choices (where in the pixel a ray starts, and where
+// on the lens). Independent random points clump and leave gaps; low-discrepancy points
+// cover the square evenly after any number of samples, so the pixel and lens integrals
+// converge faster. Every pixel gets its own scrambling of the pattern, which keeps
+// neighbouring pixels uncorrelated (the error shows up as noise, not as structure).
+//
+// Each sample can draw several 2D points, one per `dimension` (0: pixel, 1: lens, 2: shutter time).
+// Sobol points are Owen-scrambled per pixel and dimension (Burley, "Practical Hash-based
+// Owen Scrambling", 2020) with the sample order shuffled per dimension, so the dimensions
+// are independent of each other. Halton points use bases (2, 3), (5, 7), ... with a random
+// per-pixel toroidal shift (Cranley-Patterson rotation).
+enum class sample_pattern {
+    random, // Independent points from the sample's generator
+    halton, // Rotated Halton sequence
+    sobol, // Owen-scrambled Sobol (0,2)-sequence
+};
+
+// Parses "random", "halton" or "sobol" into `pattern`. Returns false for anything else.
+inline bool parse_sample_pattern(const std::string& name, sample_pattern& pattern) {
+    if (name == "random")
+        pattern = sample_pattern::random;
+    else if (name == "halton")
+        pattern = sample_pattern::halton;
+    else if (name == "sobol")
+        pattern = sample_pattern::sobol;
+    else
+        return false;
+    return true;
+}
+
+// Reverses the order of the 32 bits of `x`.
+inline std::uint32_t reverse_bits(std::uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// Hash-based Owen scrambling of the bits of `x` (as a binary fraction, highest bit first):
+// every bit is flipped depending on the bits above it, with a tree of flips chosen by `seed`.
+inline std::uint32_t owen_scramble(std::uint32_t x, std::uint32_t seed) {
+    x = reverse_bits(x);
+    x += seed; // Laine-Karras permutation on the reversed bits
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverse_bits(x);
+}
+
+// Point `index` of the first two dimensions of the Sobol sequence, as 32-bit fractions.
+// Dimension 0 is the van der Corput sequence; dimension 1 is computed without branches.
+inline void sobol_2d(std::uint32_t index, std::uint32_t& x, std::uint32_t& y) {
+    x = reverse_bits(index);
+    y = 0;
+    for (std::uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+        y ^= v & (0u - (index & 1u));
+}
+
+// Radical inverse of `index` in base `base`, in [0, 1).
+inline double radical_inverse(std::uint32_t index, std::uint32_t base) {
+    double inverse_base = 1.0 / base, scale = inverse_base, result = 0;
+    for (; index != 0; index /= base, scale *= inverse_base)
+        result += (index % base) * scale;
+    return result;
+}
+
+// Point `sample` of 2D dimension `dimension` of `pattern`, scrambled for the pixel whose
+// generator seed is `pixel_seed`. Returns it in u and v, both in [0, 1).
+inline void pattern_sample(sample_pattern pattern, std::uint64_t pixel_seed, std::uint32_t sample, std::uint32_t dimension, double& u, double& v) {
+    std::uint64_t hash = mix64(pixel_seed + mix64(dimension + 1));
+    auto seed = [&](int k) { return static_cast<std::uint32_t>(mix64(hash + k)); };
+
+    if (pattern == sample_pattern::sobol) {
+        std::uint32_t x, y;
+        sobol_2d(owen_scramble(sample, seed(0)), x, y);
+        u = owen_scramble(x, seed(1)) * 0x1.0p-32;
+        v = owen_scramble(y, seed(2)) * 0x1.0p-32;
+        return;
+    }
+
+    // Halton: dimension d uses the (2d+1)-th and (2d+2)-th primes
+    static const std::uint32_t primes[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    std::uint32_t pair = dimension % 6;
+    u = radical_inverse(sample, primes[2 * pair]) + seed(0) * 0x1.0p-32;
+    v = radical_inverse(sample, primes[2 * pair + 1]) + seed(1) * 0x1.0p-32;
+    u -= u >= 1 ? 1 : 0;
+    v -= v >= 1 ? 1 : 0;
+}
+
+// Fills x[i], y[i], z[i] with `count` random unit vectors. The random numbers are drawn
+// first; the mapping onto the sphere then runs as one branch-free loop the compiler turns
+// into SIMD code (sin and cos included).
+inline void fill_random_unit_vectors(rng& gen, int count, real* x, real* y, real* z) {
+    for (int i = 0; i < count; ++i) {
+        x[i] = real(gen.next_double());
+        y[i] = real(gen.next_double());
+    }
+    for (int i = 0; i < count; ++i) {
+        vec3 p = sphere_from_square(x[i], y[i]);
+        x[i] = p.x();
+        y[i] = p.y();
+        z[i] = p.z();
+    }
+}
+
+// Fills x[i], y[i] with `count` random points of the unit disk (like random_in_unit_disk),
+// mapped in one branch-free loop.
+inline void fill_random_in_unit_disk(rng& gen, int count, real* x, real* y) {
+    for (int i = 0; i < count; ++i) {
+        x[i] = real(gen.next_double());
+        y[i] = real(gen.next_double());
+    }
+    for (int i = 0; i < count; ++i) {
+        vec3 p = disk_from_square(x[i], y[i]);
+        x[i] = p.x();
+        y[i] = p.y();
+    }
+}
+
+#endif
@@ -0,0 +1,738 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "content_hash.hpp"
+#include "hittable_list.hpp"
+#include "instance.hpp"
+#include "light.hpp"
+#include "material.hpp"
+#include "sphere.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Scene files describe the camera, the materials and the spheres of a scene, so a scene
+// can change without rebuilding the renderer. There are two forms:
+//
+// Text, for authoring. One statement per line, '#' starts a comment:
+//
+//     camera aspect_ratio 1.7778          # any camera setting, see scene_camera_settings
+//     camera position 13 2 3
+//     camera sky_brightness 0.1           # scale of the sky gradient, 0 for a black sky
+//     material ground lambertian 0.5 0.5 0.5
+//     material mirror metal 0.7 0.6 0.5 0.0      # albedo, fuzz
+//     material glass dielectric 1.5              # refraction index
+//     material lamp light 8 8 8                  # emitted radiance; its spheres become light sources
+//     sphere 0 -1000 0 1000 ground               # center, radius, material name
+//     moving_sphere 0 1 0  0 1.5 0  0.5 ground  # centers at times 0 and 1 (see camera::shutter_open), radius, material
+//     group tree                                 # spheres up to 'end' form a group, only drawn by instances
+//     sphere 0 1 0 0.5 ground
+//     end
+//     instance tree 3 0 -2 1.5 30                # group, translation, scale (default 1), rotation about y in degrees (default 0)
+//
+// A group is built once into its own BVH and shared by every instance of it, so repeated
+// objects cost the memory of one copy (see instance.hpp).
+//
+// Binary, for big scenes: a fixed header followed by the material, sphere and instance
+// records exactly as they lie in memory. Loading memory-maps the file and copies each
+// array in one go, so even millions of spheres load in milliseconds. load_scene() tells
+// the two forms apart by the binary magic; save_scene() writes binary for the ".rtsb"
+// extension.
+
+// Camera settings stored in a scene (the binary form writes this struct as is).
+struct scene_camera_settings {
+    double aspect_ratio = 16.0 / 9.0;
+    double vertical_fov = 90;
+    double position[3] = {0, 0, 0};
+    double focus_point[3] = {0, 0, -1};
+    double up_direction[3] = {0, 1, 0};
+    double lens_aperture = 0;
+    double focus_distance = 10;
+    std::int32_t image_width = 100;
+    std::int32_t samples_per_pixel = 10;
+    std::int32_t max_depth = 10;
+    float sky_brightness = 1; // camera::sky_brightness (binary version 2; version 1 files held zero padding here)
+};
+
+// One material: lambertian (albedo), metal (albedo, fuzz), dielectric (refraction index in
+// params[0]) or diffuse_light (radiance).
+struct material_record {
+    std::uint32_t kind = 0; // A material_kind other than material_kind::other
+    std::uint32_t reserved = 0; // Padding, always zero
+    double params[4] = {0, 0, 0, 0};
+};
+
+// One sphere, referring to its material by index.
+struct sphere_record {
+    double center[3] = {0, 0, 0};
+    double radius = 0;
+    std::uint32_t material = 0; // Index into scene_description::materials
+    std::uint32_t group = 0; // 0: part of the scene itself; g > 0: member of group g - 1 (version 1 and 2 files held zero padding here)
+};
+
+// Motion of one sphere, which moves by `displacement` from time 0 (where sphere_record
+// puts it) to time 1. Spheres without a motion record are static.
+struct sphere_motion_record {
+    std::uint64_t sphere = 0; // Index into scene_description::spheres
+    double displacement[3] = {0, 0, 0};
+};
+
+// One placed copy of a group: scaled, rotated about the y axis, then moved.
+struct instance_record {
+    double translation[3] = {0, 0, 0};
+    double scale = 1;
+    double rotation_y = 0; // Degrees
+    std::uint32_t group = 0; // Index of the group (see sphere_record::group)
+    std::uint32_t reserved = 0; // Padding, always zero
+};
+
+static_assert(sizeof(scene_camera_settings) == 120, "binary scene layout changed");
+static_assert(sizeof(material_record) == 40, "binary scene layout changed");
+static_assert(sizeof(sphere_record) == 40, "binary scene layout changed");
+static_assert(sizeof(instance_record) == 48, "binary scene layout changed");
+static_assert(sizeof(sphere_motion_record) == 32, "binary scene layout changed");
+
+// Everything a scene file holds.
+struct scene_description {
+    scene_camera_settings camera = {}; // View and image settings
+    std::vector<material_record> materials = {}; // Every material of the scene
+    std::vector<std::string> material_names = {}; // Name of every material (text form only; may be empty)
+    std::vector<sphere_record> spheres = {}; // Every sphere of the scene and of its groups
+    std::vector<std::string> group_names = {}; // Name of every group (text form only; may be empty)
+    std::vector<instance_record> instances = {}; // Every placed copy of a group
+    std::vector<sphere_motion_record> motions = {}; // Motion of every moving sphere
+
+    // Adds a material and returns its index.
+    std::uint32_t add_material(material_kind kind, double p0, double p1 = 0, double p2 = 0, double p3 = 0) {
+        material_record record;
+        record.kind = static_cast<std::uint32_t>(kind);
+        record.params[0] = p0;
+        record.params[1] = p1;
+        record.params[2] = p2;
+        record.params[3] = p3;
+        materials.push_back(record);
+        return static_cast<std::uint32_t>(materials.size() - 1);
+    }
+
+    // Adds a sphere made of material `material_index`, to the scene itself or (with
+    // `group` g > 0) to group g - 1.
+    void add_sphere(const point3& center, double radius, std::uint32_t material_index, std::uint32_t group = 0) {
+        sphere_record record;
+        record.center[0] = center.x();
+        record.center[1] = center.y();
+        record.center[2] = center.z();
+        record.radius = radius;
+        record.material = material_index;
+        record.group = group;
+        spheres.push_back(record);
+    }
+
+    // Adds a sphere like add_sphere() that moves from `start_center` at time 0 to `end_center`
+    // at time 1.
+    void add_moving_sphere(const point3& start_center, const point3& end_center, double radius, std::uint32_t material_index, std::uint32_t group = 0) {
+        add_sphere(start_center, radius, material_index, group);
+        vec3 displacement = end_center - start_center;
+        sphere_motion_record record;
+        record.sphere = spheres.size() - 1;
+        record.displacement[0] = displacement.x();
+        record.displacement[1] = displacement.y();
+        record.displacement[2] = displacement.z();
+        motions.push_back(record);
+    }
+
+    // Motion of every sphere, in sphere order (empty if nothing moves). Returns false if a
+    // motion record names a missing sphere.
+    bool sphere_motions(std::vector<vec3>& motion) const {
+        motion.clear();
+        if (motions.empty())
+            return true;
+        motion.assign(spheres.size(), vec3(0, 0, 0));
+        for (const auto& record : motions) {
+            if (record.sphere >= spheres.size())
+                return false;
+            motion[record.sphere] = vec3(record.displacement[0], record.displacement[1], record.displacement[2]);
+        }
+        return true;
+    }
+
+    // Places a copy of group `group`.
+    void add_instance(std::uint32_t group, const vec3& translation, double scale = 1, double rotation_y = 0) {
+        instance_record record;
+        record.translation[0] = translation.x();
+        record.translation[1] = translation.y();
+        record.translation[2] = translation.z();
+        record.scale = scale;
+        record.rotation_y = rotation_y;
+        record.group = group;
+        instances.push_back(record);
+    }
+
+    // Number of groups: every group index a sphere uses, up to the highest.
+    std::uint32_t group_count() const {
+        std::uint32_t count = 0;
+        for (const auto& record : spheres)
+            count = std::max(count, record.group);
+        return count;
+    }
+
+    // Hash of what the scene renders: its materials, spheres, instances and motions. Names
+    // and the camera settings are left out; the camera hashes the view it renders itself
+    // (see camera::scene_key).
+    std::uint64_t content_key() const {
+        content_hash hash;
+        hash.add_array(materials).add_array(spheres).add_array(instances).add_array(motions);
+        return hash.value();
+    }
+};
+
+// Configures `scene_camera` from the scene's camera settings.
+inline void apply_camera_settings(const scene_camera_settings& settings, camera& scene_camera) {
+    scene_camera.aspect_ratio = settings.aspect_ratio;
+    scene_camera.image_width = settings.image_width;
+    scene_camera.samples_per_pixel = settings.samples_per_pixel;
+    scene_camera.max_depth = settings.max_depth;
+    scene_camera.vertical_fov = settings.vertical_fov;
+    scene_camera.camera_position = point3(settings.position[0], settings.position[1], settings.position[2]);
+    scene_camera.focus_point = point3(settings.focus_point[0], settings.focus_point[1], settings.focus_point[2]);
+    scene_camera.up_direction = vec3(settings.up_direction[0], settings.up_direction[1], settings.up_direction[2]);
+    scene_camera.lens_aperture = settings.lens_aperture;
+    scene_camera.focus_distance = settings.focus_distance;
+    scene_camera.sky_brightness = settings.sky_brightness;
+}
+
+// Motion of sphere `index` from scene_description::sphere_motions() (static if it is empty)
+inline vec3 motion_of(const std::vector<vec3>& motions, size_t index) {
+    return motions.empty() ? vec3(0, 0, 0) : motions[index];
+}
+
+// Owns the objects of a built scene. Materials and spheres each live in one array, so a
+// scene of any size costs a handful of allocations; the hittable_list refers to them
+// through aliasing shared_ptrs that keep the arrays alive. Identical material records share
+// one material, so a scene that repeats "dielectric 1.5" for every glass sphere builds one.
+struct scene_storage {
+    std::vector<lambertian> lambertians = {};
+    std::vector<metal> metals = {};
+    std::vector<dielectric> dielectrics = {};
+    std::vector<diffuse_light> diffuse_lights = {};
+    std::vector<material*> by_index = {}; // Material of every material_record
+};
+
+// What both ways of building a scene share: the materials, and an instance object for every
+// instance record (each group is built once into a BVH that its instances share).
+struct scene_parts {
+    shared_ptr<scene_storage> materials = {};
+    std::vector<shared_ptr<hittable>> instances = {};
+    std::vector<vec3> motions = {}; // Motion of every sphere of the scene (empty: nothing moves)
+
+    // Material of sphere `record`, kept alive by the storage.
+    shared_ptr<material> material_of(const sphere_record& record) const { return shared_ptr<material>(materials, materials->by_index[record.material]); }
+};
+
+// Builds the materials, groups and instances of `scene`, and adds every light, including
+// the lights of placed groups, to `lights` unless it is null. Returns false with a message
+// on std::cerr if a sphere names a missing material, an instance a missing group or a
+// motion a missing sphere.
+inline bool build_scene_parts(const scene_description& scene, scene_parts& parts, light_list* lights) {
+    if (!scene.sphere_motions(parts.motions)) {
+        std::cerr << "Error: A sphere motion refers to a missing sphere.\n";
+        return false;
+    }
+
+    // Distinct material records (kind and parameters); duplicates map to the first one
+    std::map<std::pair<std::uint32_t, std::array<double, 4>>, size_t> distinct;
+    std::vector<size_t> first_of(scene.materials.size());
+    size_t counts[material_kind_count] = {};
+    for (size_t i = 0; i < scene.materials.size(); ++i) {
+        const material_record& record = scene.materials[i];
+        auto key = std::make_pair(record.kind, std::array<double, 4>{record.params[0], record.params[1], record.params[2], record.params[3]});
+        auto inserted = distinct.emplace(key, i);
+        first_of[i] = inserted.first->second;
+        if (inserted.second)
+            counts[record.kind]++;
+    }
+
+    auto materials = make_shared<scene_storage>();
+    materials->lambertians.reserve(counts[static_cast<int>(material_kind::lambertian)]);
+    materials->metals.reserve(counts[static_cast<int>(material_kind::metal)]);
+    materials->dielectrics.reserve(counts[static_cast<int>(material_kind::dielectric)]);
+    materials->diffuse_lights.reserve(counts[static_cast<int>(material_kind::diffuse_light)]);
+
+    // The arrays were reserved up front, so pointers into them stay valid
+    for (size_t i = 0; i < scene.materials.size(); ++i) {
+        if (first_of[i] != i) {
+            materials->by_index.push_back(materials->by_index[first_of[i]]);
+            continue;
+        }
+        const material_record& record = scene.materials[i];
+        const double* p = record.params;
+        switch (static_cast<material_kind>(record.kind)) {
+        case material_kind::lambertian:
+            materials->lambertians.emplace_back(color(p[0], p[1], p[2]));
+            materials->by_index.push_back(&materials->lambertians.back());
+            break;
+        case material_kind::metal:
+            materials->metals.emplace_back(color(p[0], p[1], p[2]), p[3]);
+            materials->by_index.push_back(&materials->metals.back());
+            break;
+        case material_kind::diffuse_light:
+            materials->diffuse_lights.emplace_back(color(p[0], p[1], p[2]));
+            materials->by_index.push_back(&materials->diffuse_lights.back());
+            break;
+        default:
+            materials->dielectrics.emplace_back(p[0]);
+            materials->by_index.push_back(&materials->dielectrics.back());
+            break;
+        }
+    }
+    parts.materials = materials;
+    parts.instances.clear();
+
+    // Every group into a batch of its own, and the scene's lights (group lights are only
+    // lights where an instance places them)
+    std::uint32_t group_count = scene.group_count();
+    std::vector<sphere_batch> groups(group_count);
+    std::vector<std::vector<sphere_light>> group_lights(group_count);
+    if (lights)
+        lights->lights.clear();
+    for (size_t i = 0; i < scene.spheres.size(); ++i) {
+        const sphere_record& record = scene.spheres[i];
+        if (record.material >= materials->by_index.size()) {
+            std::cerr << "Error: Sphere refers to missing material " << record.material << ".\n";
+            return false;
+        }
+        point3 center(record.center[0], record.center[1], record.center[2]);
+        vec3 motion = motion_of(parts.motions, i);
+        const material* mat = materials->by_index[record.material];
+        if (mat->kind == material_kind::diffuse_light && record.radius > 0) {
+            sphere_light light = {center, real(record.radius), static_cast<const diffuse_light*>(mat)->emission(), motion};
+            if (record.group == 0 && lights)
+                lights->lights.push_back(light);
+            else if (record.group > 0)
+                group_lights[record.group - 1].push_back(light);
+        }
+        if (record.group > 0 && !groups[record.group - 1].add(center, real(record.radius), parts.material_of(record), motion)) {
+            std::cerr << "Error: Group " << record.group - 1 << " uses more than " << sphere_batch::max_materials << " materials.\n";
+            return false;
+        }
+    }
+
+    // One shared BVH per group that is placed somewhere
+    std::vector<shared_ptr<const hittable>> group_trees(group_count);
+    for (const auto& record : scene.instances) {
+        if (record.group >= group_count || groups[record.group].size() == 0) {
+            std::cerr << "Error: Instance refers to missing or empty group " << record.group << ".\n";
+            return false;
+        }
+        if (!(record.scale > 0)) {
+            std::cerr << "Error: Instance of group " << record.group << " has a scale of " << record.scale << ".\n";
+            return false;
+        }
+        if (!group_trees[record.group])
+            group_trees[record.group] = make_shared<bvh_node>(groups[record.group]);
+
+        vec3 translation(record.translation[0], record.translation[1], record.translation[2]);
+        auto placed = make_shared<instance>(group_trees[record.group], translation, real(record.scale), real(record.rotation_y));
+        parts.instances.push_back(placed);
+        if (lights) {
+            for (const sphere_light& light : group_lights[record.group]) {
+                point3 center = placed->to_world(light.center);
+                lights->add(center, light.radius * real(record.scale), light.radiance, placed->to_world(light.center + light.motion) - center);
+            }
+        }
+    }
+    return true;
+}
+
+// Builds the objects of `scene` into a hittable_list (wrap it in a bvh_node before rendering):
+// a sphere object per sphere of the scene itself, then one instance per instance record.
+// Every light goes into `lights` unless it is null. Returns false with a message on
+// std::cerr if a sphere names a missing material or an instance a missing group.
+inline bool build_scene(const scene_description& scene, hittable_list& objects, light_list* lights = nullptr) {
+    scene_parts parts;
+    if (!build_scene_parts(scene, parts, lights))
+        return false;
+
+    auto spheres = make_shared<std::vector<sphere>>();
+    spheres->reserve(scene.spheres.size());
+    for (size_t i = 0; i < scene.spheres.size(); ++i) {
+        const sphere_record& record = scene.spheres[i];
+        point3 center(record.center[0], record.center[1], record.center[2]);
+        if (record.group == 0)
+            spheres->emplace_back(center, center + motion_of(parts.motions, i), record.radius, parts.material_of(record));
+    }
+
+    objects.clear();
+    objects.objects.reserve(spheres->size() + parts.instances.size());
+    for (auto& s : *spheres)
+        objects.add(shared_ptr<hittable>(spheres, &s));
+    for (auto& placed : parts.instances)
+        objects.add(placed);
+    return true;
+}
+
+// Builds `scene` straight into a BVH over its spheres and instances, without a sphere object
+// per sphere (see bvh_node), which is the compact form for rendering big scenes. Returns
+// null with a message on std::cerr on the errors of build_scene().
+inline shared_ptr<bvh_node> build_scene_tree(const scene_description& scene, light_list* lights = nullptr) {
+    scene_parts parts;
+    if (!build_scene_parts(scene, parts, lights))
+        return nullptr;
+
+    sphere_batch spheres;
+    for (size_t i = 0; i < scene.spheres.size(); ++i) {
+        const sphere_record& record = scene.spheres[i];
+        if (record.group == 0 && !spheres.add(point3(record.center[0], record.center[1], record.center[2]), real(record.radius), parts.material_of(record), motion_of(parts.motions, i))) {
+            std::cerr << "Error: The scene uses more than " << sphere_batch::max_materials << " materials outside groups.\n";
+            return nullptr;
+        }
+    }
+    return make_shared<bvh_node>(spheres, parts.instances);
+}
+
+// Magic bytes and version at the start of a binary scene file
+constexpr char scene_binary_magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', 'B'};
+constexpr std::uint32_t scene_binary_version = 4; // Version 2 added scene_camera_settings::sky_brightness, 3 groups and instances, 4 sphere motions
+
+// Header of a binary scene file, followed by the material and then the sphere records.
+// Version 3 files continue with a std::uint64_t instance count and the instance records,
+// version 4 files then with a std::uint64_t motion count and the motion records.
+struct scene_binary_header {
+    char magic[8] = {};
+    std::uint32_t version = 0;
+    std::uint32_t material_count = 0;
+    std::uint64_t sphere_count = 0;
+    scene_camera_settings camera = {};
+};
+
+// Reads a text scene. Returns false with a message on std::cerr on a syntax error.
+inline bool parse_scene_text(std::istream& in, const std::string& path, scene_description& scene) {
+    scene = scene_description();
+    std::string line;
+    int line_number = 0;
+    auto fail = [&](const std::string& message) {
+        std::cerr << "Error: " << path << ":" << line_number << ": " << message << ".\n";
+        return false;
+    };
+
+    std::uint32_t group = 0; // Group the spheres being read belong to (see sphere_record::group)
+    while (std::getline(in, line)) {
+        ++line_number;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string statement;
+        if (!(words >> statement))
+            continue; // Blank or comment-only line
+
+        if (statement == "camera") {
+            std::string key;
+            words >> key;
+            scene_camera_settings& c = scene.camera;
+            bool ok = true;
+            if (key == "aspect_ratio") ok = static_cast<bool>(words >> c.aspect_ratio);
+            else if (key == "image_width") ok = static_cast<bool>(words >> c.image_width);
+            else if (key == "samples_per_pixel") ok = static_cast<bool>(words >> c.samples_per_pixel);
+            else if (key == "max_depth") ok = static_cast<bool>(words >> c.max_depth);
+            else if (key == "vertical_fov") ok = static_cast<bool>(words >> c.vertical_fov);
+            else if (key == "position") ok = static_cast<bool>(words >> c.position[0] >> c.position[1] >> c.position[2]);
+            else if (key == "focus_point") ok = static_cast<bool>(words >> c.focus_point[0] >> c.focus_point[1] >> c.focus_point[2]);
+            else if (key == "up_direction") ok = static_cast<bool>(words >> c.up_direction[0] >> c.up_direction[1] >> c.up_direction[2]);
+            else if (key == "lens_aperture") ok = static_cast<bool>(words >> c.lens_aperture);
+            else if (key == "focus_distance") ok = static_cast<bool>(words >> c.focus_distance);
+            else if (key == "sky_brightness") ok = static_cast<bool>(words >> c.sky_brightness);
+            else return fail("unknown camera setting '" + key + "'");
+            if (!ok)
+                return fail("bad value for camera " + key);
+        } else if (statement == "material") {
+            std::string name, kind;
+            words >> name >> kind;
+            double p[4] = {0, 0, 0, 0};
+            bool ok = true;
+            material_kind parsed = material_kind::other;
+            if (kind == "lambertian") {
+                parsed = material_kind::lambertian;
+                ok = static_cast<bool>(words >> p[0] >> p[1] >> p[2]);
+            } else if (kind == "metal") {
+                parsed = material_kind::metal;
+                ok = static_cast<bool>(words >> p[0] >> p[1] >> p[2] >> p[3]);
+            } else if (kind == "dielectric") {
+                parsed = material_kind::dielectric;
+                ok = static_cast<bool>(words >> p[0]);
+            } else if (kind == "light") {
+                parsed = material_kind::diffuse_light;
+                ok = static_cast<bool>(words >> p[0] >> p[1] >> p[2]);
+            } else {
+                return fail("unknown material type '" + kind + "'");
+            }
+            if (!ok)
+                return fail("bad parameters for material " + name);
+            scene.add_material(parsed, p[0], p[1], p[2], p[3]);
+            scene.material_names.push_back(name);
+        } else if (statement == "sphere") {
+            double x, y, z, radius;
+            std::string name;
+            if (!(words >> x >> y >> z >> radius >> name))
+                return fail("expected 'sphere x y z radius material'");
+            auto found = std::find(scene.material_names.begin(), scene.material_names.end(), name);
+            if (found == scene.material_names.end())
+                return fail("unknown material '" + name + "'");
+            scene.add_sphere(point3(x, y, z), radius, static_cast<std::uint32_t>(found - scene.material_names.begin()), group);
+        } else if (statement == "moving_sphere") {
+            double x0, y0, z0, x1, y1, z1, radius;
+            std::string name;
+            if (!(words >> x0 >> y0 >> z0 >> x1 >> y1 >> z1 >> radius >> name))
+                return fail("expected 'moving_sphere x0 y0 z0 x1 y1 z1 radius material'");
+            auto found = std::find(scene.material_names.begin(), scene.material_names.end(), name);
+            if (found == scene.material_names.end())
+                return fail("unknown material '" + name + "'");
+            scene.add_moving_sphere(point3(x0, y0, z0), point3(x1, y1, z1), radius, static_cast<std::uint32_t>(found - scene.material_names.begin()), group);
+        } else if (statement == "group") {
+            std::string name;
+            if (!(words >> name))
+                return fail("expected 'group name'");
+            if (group != 0)
+                return fail("groups cannot be nested");
+            if (std::find(scene.group_names.begin(), scene.group_names.end(), name) != scene.group_names.end())
+                return fail("group '" + name + "' is already defined");
+            scene.group_names.push_back(name);
+            group = static_cast<std::uint32_t>(scene.group_names.size());
+        } else if (statement == "end") {
+            if (group == 0)
+                return fail("'end' without 'group'");
+            group = 0;
+        } else if (statement == "instance") {
+            std::string name;
+            double x, y, z, scale = 1, rotation_y = 0;
+            if (!(words >> name >> x >> y >> z))
+                return fail("expected 'instance group x y z [scale [rotation_y]]'");
+            if (words >> scale)
+                words >> rotation_y;
+            if (group != 0)
+                return fail("instances cannot be part of a group");
+            if (!(scale > 0))
+                return fail("instance scale must be positive");
+            auto found = std::find(scene.group_names.begin(), scene.group_names.end(), name);
+            if (found == scene.group_names.end())
+                return fail("unknown group '" + name + "'");
+            scene.add_instance(static_cast<std::uint32_t>(found - scene.group_names.begin()), vec3(x, y, z), scale, rotation_y);
+        } else {
+            return fail("unknown statement '" + statement + "'");
+        }
+    }
+    if (group != 0) {
+        std::cerr << "Error: " << path << ": group '" << scene.group_names.back() << "' has no 'end'.\n";
+        return false;
+    }
+    return true;
+}
+
+// Reads a binary scene from memory (e.g. a mapped file) of `size` bytes.
+inline bool parse_scene_binary(const unsigned char* data, size_t size, const std::string& path, scene_description& scene) {
+    scene_binary_header header;
+    if (size < sizeof(header)) {
+        std::cerr << "Error: " << path << " is truncated.\n";
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.version < 1 || header.version > scene_binary_version) {
+        std::cerr << "Error: " << path << " has unsupported version " << header.version << ".\n";
+        return false;
+    }
+
+    // The sections in file order. Every count is checked against the bytes left before it is
+    // multiplied, so a corrupt count cannot overflow the size arithmetic (and a count that
+    // does not fit in size_t never fits in the file either).
+    size_t offset = sizeof(header);
+    auto section = [&](std::uint64_t count, size_t record_size, size_t& section_offset) {
+        if (count > (size - offset) / record_size)
+            return false;
+        section_offset = offset;
+        offset += static_cast<size_t>(count) * record_size;
+        return true;
+    };
+    auto read_count = [&](std::uint64_t& count) {
+        if (size - offset < sizeof(count))
+            return false;
+        std::memcpy(&count, data + offset, sizeof(count));
+        offset += sizeof(count);
+        return true;
+    };
+    size_t materials_offset = 0, spheres_offset = 0, instances_offset = 0, motions_offset = 0;
+    std::uint64_t instance_count = 0;
+    std::uint64_t motion_count = 0;
+    bool complete = section(header.material_count, sizeof(material_record), materials_offset) &&
+                    section(header.sphere_count, sizeof(sphere_record), spheres_offset) &&
+                    (header.version < 3 || (read_count(instance_count) && section(instance_count, sizeof(instance_record), instances_offset))) &&
+                    (header.version < 4 || (read_count(motion_count) && section(motion_count, sizeof(sphere_motion_record), motions_offset)));
+    if (!complete) {
+        std::cerr << "Error: " << path << " is truncated.\n";
+        return false;
+    }
+
+    scene = scene_description();
+    scene.camera = header.camera;
+    if (header.version < 2)
+        scene.camera.sky_brightness = 1;
+    scene.materials.resize(header.material_count);
+    scene.spheres.resize(static_cast<size_t>(header.sphere_count));
+    scene.instances.resize(static_cast<size_t>(instance_count));
+    scene.motions.resize(static_cast<size_t>(motion_count));
+    std::memcpy(scene.materials.data(), data + materials_offset, scene.materials.size() * sizeof(material_record));
+    std::memcpy(scene.spheres.data(), data + spheres_offset, scene.spheres.size() * sizeof(sphere_record));
+    std::memcpy(scene.instances.data(), data + instances_offset, scene.instances.size() * sizeof(instance_record));
+    std::memcpy(scene.motions.data(), data + motions_offset, scene.motions.size() * sizeof(sphere_motion_record));
+    for (const auto& record : scene.materials) {
+        if (record.kind == 0 || record.kind >= material_kind_count) {
+            std::cerr << "Error: " << path << " has a material of unknown kind " << record.kind << ".\n";
+            return false;
+        }
+    }
+    // Groups are sized by the highest index (see group_count), so an index must stay within
+    // what the file can describe: no more groups than spheres
+    for (const auto& record : scene.spheres) {
+        if (record.group > scene.spheres.size()) {
+            std::cerr << "Error: " << path << " has a sphere in group " << record.group - 1 << ", more groups than its " << scene.spheres.size() << " spheres.\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Loads a text or binary scene file. Returns false with a message on std::cerr on failure.
+inline bool load_scene(const std::string& path, scene_description& scene) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: Could not open " << path << ".\n";
+        return false;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        std::cerr << "Error: Could not read " << path << ".\n";
+        return false;
+    }
+
+    // Map the whole file: binary scenes are copied straight out of the mapping
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error: Could not map " << path << ".\n";
+        return false;
+    }
+
+    const auto* data = static_cast<const unsigned char*>(mapping);
+    bool ok;
+    if (size >= sizeof(scene_binary_magic) && std::memcmp(data, scene_binary_magic, sizeof(scene_binary_magic)) == 0) {
+        ok = parse_scene_binary(data, size, path, scene);
+    } else {
+        std::istringstream text(std::string(reinterpret_cast<const char*>(data), size));
+        ok = parse_scene_text(text, path, scene);
+    }
+    ::munmap(mapping, size);
+    return ok;
+}
+
+// Writes `scene` as text, or as binary if `path` ends in ".rtsb". Returns false if the file could not be written.
+inline bool save_scene(const std::string& path, const scene_description& scene) {
+    bool binary = path.size() >= 5 && path.compare(path.size() - 5, 5, ".rtsb") == 0;
+    std::ofstream out(path, binary ? std::ios::binary : std::ios::out);
+    if (!out)
+        return false;
+
+    if (binary) {
+        scene_binary_header header;
+        std::memcpy(header.magic, scene_binary_magic, sizeof(header.magic));
+        header.version = scene_binary_version;
+        header.material_count = static_cast<std::uint32_t>(scene.materials.size());
+        header.sphere_count = scene.spheres.size();
+        header.camera = scene.camera;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(scene.materials.data()), static_cast<std::streamsize>(scene.materials.size() * sizeof(material_record)));
+        out.write(reinterpret_cast<const char*>(scene.spheres.data()), static_cast<std::streamsize>(scene.spheres.size() * sizeof(sphere_record)));
+        std::uint64_t instance_count = scene.instances.size();
+        out.write(reinterpret_cast<const char*>(&instance_count), sizeof(instance_count));
+        out.write(reinterpret_cast<const char*>(scene.instances.data()), static_cast<std::streamsize>(scene.instances.size() * sizeof(instance_record)));
+        std::uint64_t motion_count = scene.motions.size();
+        out.write(reinterpret_cast<const char*>(&motion_count), sizeof(motion_count));
+        out.write(reinterpret_cast<const char*>(scene.motions.data()), static_cast<std::streamsize>(scene.motions.size() * sizeof(sphere_motion_record)));
+        return static_cast<bool>(out);
+    }
+
+    // Text: full precision, so a scene survives a round trip unchanged
+    const scene_camera_settings& c = scene.camera;
+    out << std::setprecision(17);
+    out << "camera aspect_ratio " << c.aspect_ratio << "\n";
+    out << "camera image_width " << c.image_width << "\n";
+    out << "camera samples_per_pixel " << c.samples_per_pixel << "\n";
+    out << "camera max_depth " << c.max_depth << "\n";
+    out << "camera vertical_fov " << c.vertical_fov << "\n";
+    out << "camera position " << c.position[0] << ' ' << c.position[1] << ' ' << c.position[2] << "\n";
+    out << "camera focus_point " << c.focus_point[0] << ' ' << c.focus_point[1] << ' ' << c.focus_point[2] << "\n";
+    out << "camera up_direction " << c.up_direction[0] << ' ' << c.up_direction[1] << ' ' << c.up_direction[2] << "\n";
+    out << "camera lens_aperture " << c.lens_aperture << "\n";
+    out << "camera focus_distance " << c.focus_distance << "\n";
+    out << "camera sky_brightness " << c.sky_brightness << "\n\n";
+
+    auto name_of = [&](size_t index) {
+        return index < scene.material_names.size() ? scene.material_names[index] : "m" + std::to_string(index);
+    };
+    for (size_t i = 0; i < scene.materials.size(); ++i) {
+        const material_record& m = scene.materials[i];
+        out << "material " << name_of(i);
+        switch (static_cast<material_kind>(m.kind)) {
+        case material_kind::lambertian: out << " lambertian " << m.params[0] << ' ' << m.params[1] << ' ' << m.params[2]; break;
+        case material_kind::metal: out << " metal " << m.params[0] << ' ' << m.params[1] << ' ' << m.params[2] << ' ' << m.params[3]; break;
+        case material_kind::diffuse_light: out << " light " << m.params[0] << ' ' << m.params[1] << ' ' << m.params[2]; break;
+        default: out << " dielectric " << m.params[0]; break;
+        }
+        out << "\n";
+    }
+    std::vector<vec3> motions;
+    if (!scene.sphere_motions(motions))
+        return false;
+    auto write_spheres = [&](std::uint32_t group) {
+        for (size_t i = 0; i < scene.spheres.size(); ++i) {
+            const sphere_record& s = scene.spheres[i];
+            if (s.group != group)
+                continue;
+            vec3 motion = motion_of(motions, i);
+            if (motion.length_squared() > 0)
+                out << "moving_sphere " << s.center[0] << ' ' << s.center[1] << ' ' << s.center[2] << ' ' << s.center[0] + motion.x() << ' ' << s.center[1] + motion.y() << ' ' << s.center[2] + motion.z();
+            else
+                out << "sphere " << s.center[0] << ' ' << s.center[1] << ' ' << s.center[2];
+            out << ' ' << s.radius << ' ' << name_of(s.material) << "\n";
+        }
+    };
+    auto group_name = [&](std::uint32_t index) {
+        return index < scene.group_names.size() ? scene.group_names[index] : "g" + std::to_string(index);
+    };
+    out << "\n";
+    write_spheres(0);
+    for (std::uint32_t g = 0; g < scene.group_count(); ++g) {
+        out << "\ngroup " << group_name(g) << "\n";
+        write_spheres(g + 1);
+        out << "end\n";
+    }
+    if (!scene.instances.empty())
+        out << "\n";
+    for (const instance_record& i : scene.instances)
+        out << "instance " << group_name(i.group) << ' ' << i.translation[0] << ' ' << i.translation[1] << ' ' << i.translation[2] << ' ' << i.scale << ' ' << i.rotation_y << "\n";
+    return static_cast<bool>(out);
+}
+
+#endif
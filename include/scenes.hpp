@@ -0,0 +1,127 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "scene_file.hpp"
+
+// Camera settings of random_spheres_description() (the default image).
+inline scene_camera_settings random_spheres_camera_settings() {
+    scene_camera_settings settings;
+
+    // Set basic camera parameters.
+    settings.aspect_ratio = 16.0 / 9.0; // Aspect ratio for widescreen rendering.
+    settings.image_width = 720; // Image width in pixels.
+    settings.samples_per_pixel = 10; // Samples per pixel for anti-aliasing.
+    settings.max_depth = 25; // Maximum number of bounces for reflections/refractions.
+
+    // Set the camera's field of view and orientation.
+    settings.vertical_fov = 20; // Vertical field of view in degrees.
+    settings.position[0] = 13, settings.position[1] = 2, settings.position[2] = 3; // Camera position.
+    settings.focus_point[0] = 0, settings.focus_point[1] = 0, settings.focus_point[2] = 0; // Target point the camera is looking at.
+    settings.up_direction[0] = 0, settings.up_direction[1] = 1, settings.up_direction[2] = 0; // Up direction (aligned with y-axis).
+
+    // Configure depth of field by setting focus and aperture.
+    settings.lens_aperture = 0.2; // Aperture size affecting depth of field.
+    settings.focus_distance = 10.0; // Distance at which the camera is focused.
+    return settings;
+}
+
+// Describes the final scene of "Ray Tracing in One Weekend": a ground sphere, three large
+// spheres and a grid of small randomly placed spheres with random materials. Every call
+// returns the same scene; save_scene() turns it into a scene file.
+inline scene_description random_spheres_description() {
+    // Restart the setup generator so every call builds exactly the same scene.
+    default_rng() = rng();
+
+    // Start with the default view; the description stores materials and spheres by index.
+    scene_description scene = {};
+    scene.camera = random_spheres_camera_settings();
+
+    // Add a large ground sphere to represent the floor. Lambertian is the diffusion distribution method.
+    auto ground_material = scene.add_material(material_kind::lambertian, 0.2, 0.2, 0.2); // Diffuse dark gray material
+    scene.add_sphere(point3(0, -1000, 0), 1000, ground_material); // Large sphere as ground
+
+    double large_sphere_radius = 1.0;
+    double small_sphere_radius = 0.2;
+    double possbile_interaction_radius = large_sphere_radius + small_sphere_radius;
+
+    // Large glass-like sphere
+    auto glass_material = scene.add_material(material_kind::dielectric, 1.5);
+    scene.add_sphere(point3(0, 1, 0), large_sphere_radius, glass_material);
+
+    // Large diffuse sphere
+    auto diffuse_material = scene.add_material(material_kind::lambertian, 0.4, 0.2, 0.1);
+    scene.add_sphere(point3(-4, 1, 0), large_sphere_radius, diffuse_material);
+
+    // Large metal sphere
+    auto metal_material = scene.add_material(material_kind::metal, 0.7, 0.6, 0.5, 0.0);
+    scene.add_sphere(point3(4, 1, 0), large_sphere_radius, metal_material);
+
+    // Generate small spheres randomly scattered across the ground.
+    for (int x = -11; x < 11; x++) {
+        for (int z = -11; z < 11; z++) {
+            // Randomly choose a material for the current sphere.
+            double random_material_choice = random_double();
+
+            // Generate a random position for the sphere, slightly offset from grid positions.
+            point3 sphere_center(x + 0.9 * random_double(), 0.2, z + 0.9 * random_double());
+
+            // Ensure spheres don't overlap with the large spheres.
+            if ((sphere_center - point3(4, 1, 0)).length() > possbile_interaction_radius && (sphere_center - point3(0, 1, 0)).length() > possbile_interaction_radius && (sphere_center - point3(-4, 1, 0)).length() > possbile_interaction_radius) {
+                std::uint32_t sphere_material;
+
+                // Choose a diffuse material (30% probability).
+                if (random_material_choice < 0.3) {
+                    auto albedo = color::random() * color::random(); // Random color for diffuse reflection
+                    sphere_material = scene.add_material(material_kind::lambertian, albedo.x(), albedo.y(), albedo.z()); // Diffuse material
+                    scene.add_sphere(sphere_center, small_sphere_radius, sphere_material); // Add sphere
+
+                // Choose a metal material (30% probability).
+                } else if (random_material_choice < 0.6) {
+                    auto albedo = color::random(0.5, 1); // Random metal color with some brightness
+                    double fuzziness = random_double(0, 0.5); // Fuzziness affects the reflection blur
+                    sphere_material = scene.add_material(material_kind::metal, albedo.x(), albedo.y(), albedo.z(), fuzziness); // Metal material
+                    scene.add_sphere(sphere_center, small_sphere_radius, sphere_material); // Add sphere
+
+                // Choose a glass-like (dielectric) material (40% probability).
+                } else {
+                    sphere_material = scene.add_material(material_kind::dielectric, 1.5); // Refractive index for glass-like material
+                    scene.add_sphere(sphere_center, small_sphere_radius, sphere_material); // Add sphere
+                }
+            }
+        }
+    }
+
+    return scene;
+}
+
+// random_spheres_description() with its small diffuse spheres bouncing: each one rises by up
+// to half a unit while the shutter is open, as in "Ray Tracing: The Next Week". Rendered
+// with the default shutter, they leave vertical streaks.
+inline scene_description moving_spheres_description() {
+    scene_description scene = random_spheres_description();
+    rng gen(2024);
+    for (size_t i = 0; i < scene.spheres.size(); ++i) {
+        const sphere_record& record = scene.spheres[i];
+        if (record.radius != 0.2 || scene.materials[record.material].kind != static_cast<std::uint32_t>(material_kind::lambertian))
+            continue;
+        sphere_motion_record motion;
+        motion.sphere = i;
+        motion.displacement[1] = gen.next_double(0, 0.5);
+        scene.motions.push_back(motion);
+    }
+    return scene;
+}
+
+// Builds random_spheres_description() as a plain list; wrap it in a bvh_node before rendering.
+inline hittable_list random_spheres_scene() {
+    hittable_list scene_objects = {};
+    build_scene(random_spheres_description(), scene_objects);
+    return scene_objects;
+}
+
+// Points `scene_camera` at random_spheres_scene() with the default image settings.
+inline void random_spheres_camera(camera& scene_camera) {
+    apply_camera_settings(random_spheres_camera_settings(), scene_camera);
+}
+
+#endif
@@ -0,0 +1,367 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// SIMD backends. One binary carries every backend its target architecture can run and
+// picks one when it starts, from what the CPU reports (see simd_active_isa), so a build made
+// for plain x86-64 still uses AVX-512 where it is there and SSE4.1 where it is not.
+//
+// On x86 the backends are compiled for instruction sets the build itself does not enable:
+// each is wrapped in RT_SIMD_*_BEGIN / RT_SIMD_END, GCC target pragmas that compile the
+// functions in between for that instruction set only. Code using a backend (see
+// sphere_batch) must live inside the same pragmas and only run after the check. Other
+// compilers and architectures get the scalar code alone.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__clang__)
+#define RT_SIMD_X86 1
+#include <immintrin.h>
+#define RT_SIMD_AVX512_BEGIN _Pragma("GCC push_options") _Pragma("GCC target(\"avx512f,avx2,fma\")")
+#define RT_SIMD_AVX2_BEGIN _Pragma("GCC push_options") _Pragma("GCC target(\"avx2,fma\")")
+#define RT_SIMD_SSE4_BEGIN _Pragma("GCC push_options") _Pragma("GCC target(\"sse4.1\")")
+#define RT_SIMD_END _Pragma("GCC pop_options")
+#endif
+
+// Instruction sets a kernel can run with, narrowest first
+enum class simd_isa { scalar, sse4, avx2, avx512 };
+
+inline const char* simd_isa_name(simd_isa isa) {
+    switch (isa) {
+        case simd_isa::sse4: return "sse4";
+        case simd_isa::avx2: return "avx2";
+        case simd_isa::avx512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+// Parses a name simd_isa_name() returns. Returns false for any other name.
+inline bool parse_simd_isa(const std::string& name, simd_isa& isa) {
+    for (simd_isa candidate : {simd_isa::scalar, simd_isa::sse4, simd_isa::avx2, simd_isa::avx512}) {
+        if (name == simd_isa_name(candidate)) {
+            isa = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// True if this binary has a backend for `isa` and the CPU it runs on can execute it.
+inline bool simd_supported(simd_isa isa) {
+    switch (isa) {
+        case simd_isa::scalar:
+            return true;
+#ifdef RT_SIMD_X86
+        // The checks include the operating system saving the wider registers
+        case simd_isa::sse4:
+            return __builtin_cpu_supports("sse4.1");
+        case simd_isa::avx2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case simd_isa::avx512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+        default:
+            return false;
+    }
+}
+
+// The widest backend the CPU supports.
+inline simd_isa simd_best() {
+#ifdef RT_SIMD_X86
+    __builtin_cpu_init(); // Runs before main(), possibly ahead of the library's own initialization
+#endif
+    for (simd_isa isa : {simd_isa::avx512, simd_isa::avx2, simd_isa::sse4})
+        if (simd_supported(isa))
+            return isa;
+    return simd_isa::scalar;
+}
+
+// Backend the kernels run with: the widest one, picked once when the program starts.
+inline simd_isa simd_active_isa = simd_best();
+
+// Makes the kernels use `isa` from now on (for comparisons and tests; not while rendering).
+// Returns false, changing nothing, if the CPU or the build lacks it.
+inline bool select_simd_isa(simd_isa isa) {
+    if (!simd_supported(isa))
+        return false;
+    simd_active_isa = isa;
+    return true;
+}
+
+// Lanes of T per register with `isa`.
+template <typename T>
+constexpr int simd_width(simd_isa isa) {
+    switch (isa) {
+        case simd_isa::avx512: return static_cast<int>(64 / sizeof(T));
+        case simd_isa::avx2: return static_cast<int>(32 / sizeof(T));
+        case simd_isa::sse4: return static_cast<int>(16 / sizeof(T));
+        default: return 1;
+    }
+}
+
+// Every backend namespace holds lanes<double> and lanes<float>, wrappers around the vector
+// instructions of its instruction set for that scalar type. Kernels written against them
+// (see sphere_batch) compile to AVX-512 (8 doubles / 16 floats per register), AVX2 (4 / 8),
+// or SSE4.1 (2 / 4).
+//
+// Every wrapper provides:
+// - `vec` / `mask`: a register of lanes and a per-lane predicate
+// - `width`: lanes per register
+// - `masked_tail`: whether loads can be masked, so a partial last chunk needs no scalar loop
+// - arithmetic, comparisons, `blend(m, a, b)` (m ? b : a) and a horizontal `reduce_min`
+
+#ifdef RT_SIMD_X86
+
+RT_SIMD_AVX512_BEGIN
+namespace simd_avx512 {
+
+template <typename T>
+struct lanes;
+
+template <>
+struct lanes<double> {
+    using vec = __m512d;
+    using mask = __mmask8;
+    static constexpr bool masked_tail = true;
+    static constexpr int width = 8;
+
+    static vec set1(double x) { return _mm512_set1_pd(x); }
+    static vec zero() { return _mm512_setzero_pd(); }
+    static vec iota() { return _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0); }
+    static mask tail(size_t remaining) { return remaining >= 8 ? mask(0xFF) : mask((1u << remaining) - 1); }
+    static vec load(mask m, const double* p) { return _mm512_maskz_loadu_pd(m, p); }
+
+    static vec add(vec a, vec b) { return _mm512_add_pd(a, b); }
+    static vec sub(vec a, vec b) { return _mm512_sub_pd(a, b); }
+    static vec mul(vec a, vec b) { return _mm512_mul_pd(a, b); }
+    static vec fmadd(vec a, vec b, vec c) { return _mm512_fmadd_pd(a, b, c); }   // a * b + c
+    static vec fnmadd(vec a, vec b, vec c) { return _mm512_fnmadd_pd(a, b, c); } // c - a * b
+    static vec sqrt(mask m, vec v) { return _mm512_maskz_sqrt_pd(m, v); }      // Lanes outside m are zero
+
+    static mask less(vec a, vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static mask greater(vec a, vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+    static mask greater_equal(vec a, vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+    static mask equal(vec a, vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+    static mask both(mask a, mask b) { return a & b; }
+    static mask either(mask a, mask b) { return a | b; }
+    static bool any(mask m) { return m != 0; }
+    static vec blend(mask m, vec a, vec b) { return _mm512_mask_blend_pd(m, a, b); }
+
+    // Horizontal minimum. Uses masked extracts and 256-bit operations because GCC 12
+    // warns about the _mm512_undefined_pd() placeholders inside _mm512_reduce_min_pd.
+    static double reduce_min(vec v) {
+        __m256d low = _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, v, 0);
+        __m256d high = _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, v, 1);
+        __m256d m = _mm256_min_pd(low, high);
+        m = _mm256_min_pd(m, _mm256_permute2f128_pd(m, m, 1));
+        m = _mm256_min_pd(m, _mm256_permute_pd(m, 0x5));
+        return _mm256_cvtsd_f64(m);
+    }
+};
+
+template <>
+struct lanes<float> {
+    using vec = __m512;
+    using mask = __mmask16;
+    static constexpr bool masked_tail = true;
+    static constexpr int width = 16;
+
+    static vec set1(float x) { return _mm512_set1_ps(x); }
+    static vec zero() { return _mm512_setzero_ps(); }
+    static vec iota() { return _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0); }
+    static mask tail(size_t remaining) { return remaining >= 16 ? mask(0xFFFF) : mask((1u << remaining) - 1); }
+    static vec load(mask m, const float* p) { return _mm512_maskz_loadu_ps(m, p); }
+
+    static vec add(vec a, vec b) { return _mm512_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm512_sub_ps(a, b); }
+    static vec mul(vec a, vec b) { return _mm512_mul_ps(a, b); }
+    static vec fmadd(vec a, vec b, vec c) { return _mm512_fmadd_ps(a, b, c); }
+    static vec fnmadd(vec a, vec b, vec c) { return _mm512_fnmadd_ps(a, b, c); }
+    static vec sqrt(mask m, vec v) { return _mm512_maskz_sqrt_ps(m, v); }
+
+    static mask less(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static mask greater(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static mask greater_equal(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+    static mask equal(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+    static mask both(mask a, mask b) { return a & b; }
+    static mask either(mask a, mask b) { return a | b; }
+    static bool any(mask m) { return m != 0; }
+    static vec blend(mask m, vec a, vec b) { return _mm512_mask_blend_ps(m, a, b); }
+
+    static float reduce_min(vec v) {
+        __m128 m = _mm512_mask_extractf32x4_ps(_mm_setzero_ps(), 0xF, v, 0);
+        m = _mm_min_ps(m, _mm512_mask_extractf32x4_ps(_mm_setzero_ps(), 0xF, v, 1));
+        m = _mm_min_ps(m, _mm512_mask_extractf32x4_ps(_mm_setzero_ps(), 0xF, v, 2));
+        m = _mm_min_ps(m, _mm512_mask_extractf32x4_ps(_mm_setzero_ps(), 0xF, v, 3));
+        m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 0x1));
+        return _mm_cvtss_f32(m);
+    }
+};
+
+} // namespace simd_avx512
+RT_SIMD_END
+
+RT_SIMD_AVX2_BEGIN
+namespace simd_avx2 {
+
+template <typename T>
+struct lanes;
+
+template <>
+struct lanes<double> {
+    using vec = __m256d;
+    using mask = __m256d; // All-ones / all-zeros lanes
+    static constexpr bool masked_tail = false;
+    static constexpr int width = 4;
+
+    static vec set1(double x) { return _mm256_set1_pd(x); }
+    static vec zero() { return _mm256_setzero_pd(); }
+    static vec iota() { return _mm256_set_pd(3, 2, 1, 0); }
+    static mask tail(size_t) { return _mm256_castsi256_pd(_mm256_set1_epi64x(-1)); }
+    static vec load(mask, const double* p) { return _mm256_loadu_pd(p); }
+
+    static vec add(vec a, vec b) { return _mm256_add_pd(a, b); }
+    static vec sub(vec a, vec b) { return _mm256_sub_pd(a, b); }
+    static vec mul(vec a, vec b) { return _mm256_mul_pd(a, b); }
+    static vec fmadd(vec a, vec b, vec c) { return _mm256_fmadd_pd(a, b, c); }
+    static vec fnmadd(vec a, vec b, vec c) { return _mm256_fnmadd_pd(a, b, c); }
+    static vec sqrt(mask m, vec v) { return _mm256_and_pd(m, _mm256_sqrt_pd(_mm256_max_pd(v, zero()))); }
+
+    static mask less(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static mask greater(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static mask greater_equal(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+    static mask equal(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static mask both(mask a, mask b) { return _mm256_and_pd(a, b); }
+    static mask either(mask a, mask b) { return _mm256_or_pd(a, b); }
+    static bool any(mask m) { return !_mm256_testz_pd(m, m); }
+    static vec blend(mask m, vec a, vec b) { return _mm256_blendv_pd(a, b, m); }
+
+    static double reduce_min(vec v) {
+        __m256d m = _mm256_min_pd(v, _mm256_permute2f128_pd(v, v, 1));
+        m = _mm256_min_pd(m, _mm256_permute_pd(m, 0x5));
+        return _mm256_cvtsd_f64(m);
+    }
+};
+
+template <>
+struct lanes<float> {
+    using vec = __m256;
+    using mask = __m256;
+    static constexpr bool masked_tail = false;
+    static constexpr int width = 8;
+
+    static vec set1(float x) { return _mm256_set1_ps(x); }
+    static vec zero() { return _mm256_setzero_ps(); }
+    static vec iota() { return _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0); }
+    static mask tail(size_t) { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+    static vec load(mask, const float* p) { return _mm256_loadu_ps(p); }
+
+    static vec add(vec a, vec b) { return _mm256_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm256_sub_ps(a, b); }
+    static vec mul(vec a, vec b) { return _mm256_mul_ps(a, b); }
+    static vec fmadd(vec a, vec b, vec c) { return _mm256_fmadd_ps(a, b, c); }
+    static vec fnmadd(vec a, vec b, vec c) { return _mm256_fnmadd_ps(a, b, c); }
+    static vec sqrt(mask m, vec v) { return _mm256_and_ps(m, _mm256_sqrt_ps(_mm256_max_ps(v, zero()))); }
+
+    static mask less(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static mask greater(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static mask greater_equal(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static mask equal(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static mask both(mask a, mask b) { return _mm256_and_ps(a, b); }
+    static mask either(mask a, mask b) { return _mm256_or_ps(a, b); }
+    static bool any(mask m) { return !_mm256_testz_ps(m, m); }
+    static vec blend(mask m, vec a, vec b) { return _mm256_blendv_ps(a, b, m); }
+
+    static float reduce_min(vec v) {
+        __m128 m = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 0x1));
+        return _mm_cvtss_f32(m);
+    }
+};
+
+} // namespace simd_avx2
+RT_SIMD_END
+
+// SSE4.1 has no fused multiply-add; fmadd and fnmadd round twice.
+RT_SIMD_SSE4_BEGIN
+namespace simd_sse4 {
+
+template <typename T>
+struct lanes;
+
+template <>
+struct lanes<double> {
+    using vec = __m128d;
+    using mask = __m128d;
+    static constexpr bool masked_tail = false;
+    static constexpr int width = 2;
+
+    static vec set1(double x) { return _mm_set1_pd(x); }
+    static vec zero() { return _mm_setzero_pd(); }
+    static vec iota() { return _mm_set_pd(1, 0); }
+    static mask tail(size_t) { return _mm_castsi128_pd(_mm_set1_epi64x(-1)); }
+    static vec load(mask, const double* p) { return _mm_loadu_pd(p); }
+
+    static vec add(vec a, vec b) { return _mm_add_pd(a, b); }
+    static vec sub(vec a, vec b) { return _mm_sub_pd(a, b); }
+    static vec mul(vec a, vec b) { return _mm_mul_pd(a, b); }
+    static vec fmadd(vec a, vec b, vec c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+    static vec fnmadd(vec a, vec b, vec c) { return _mm_sub_pd(c, _mm_mul_pd(a, b)); }
+    static vec sqrt(mask m, vec v) { return _mm_and_pd(m, _mm_sqrt_pd(_mm_max_pd(v, zero()))); }
+
+    static mask less(vec a, vec b) { return _mm_cmplt_pd(a, b); }
+    static mask greater(vec a, vec b) { return _mm_cmpgt_pd(a, b); }
+    static mask greater_equal(vec a, vec b) { return _mm_cmpge_pd(a, b); }
+    static mask equal(vec a, vec b) { return _mm_cmpeq_pd(a, b); }
+    static mask both(mask a, mask b) { return _mm_and_pd(a, b); }
+    static mask either(mask a, mask b) { return _mm_or_pd(a, b); }
+    static bool any(mask m) { return _mm_movemask_pd(m) != 0; }
+    static vec blend(mask m, vec a, vec b) { return _mm_blendv_pd(a, b, m); }
+
+    static double reduce_min(vec v) { return _mm_cvtsd_f64(_mm_min_sd(v, _mm_unpackhi_pd(v, v))); }
+};
+
+template <>
+struct lanes<float> {
+    using vec = __m128;
+    using mask = __m128;
+    static constexpr bool masked_tail = false;
+    static constexpr int width = 4;
+
+    static vec set1(float x) { return _mm_set1_ps(x); }
+    static vec zero() { return _mm_setzero_ps(); }
+    static vec iota() { return _mm_set_ps(3, 2, 1, 0); }
+    static mask tail(size_t) { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+    static vec load(mask, const float* p) { return _mm_loadu_ps(p); }
+
+    static vec add(vec a, vec b) { return _mm_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm_sub_ps(a, b); }
+    static vec mul(vec a, vec b) { return _mm_mul_ps(a, b); }
+    static vec fmadd(vec a, vec b, vec c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static vec fnmadd(vec a, vec b, vec c) { return _mm_sub_ps(c, _mm_mul_ps(a, b)); }
+    static vec sqrt(mask m, vec v) { return _mm_and_ps(m, _mm_sqrt_ps(_mm_max_ps(v, zero()))); }
+
+    static mask less(vec a, vec b) { return _mm_cmplt_ps(a, b); }
+    static mask greater(vec a, vec b) { return _mm_cmpgt_ps(a, b); }
+    static mask greater_equal(vec a, vec b) { return _mm_cmpge_ps(a, b); }
+    static mask equal(vec a, vec b) { return _mm_cmpeq_ps(a, b); }
+    static mask both(mask a, mask b) { return _mm_and_ps(a, b); }
+    static mask either(mask a, mask b) { return _mm_or_ps(a, b); }
+    static bool any(mask m) { return _mm_movemask_ps(m) != 0; }
+    static vec blend(mask m, vec a, vec b) { return _mm_blendv_ps(a, b, m); }
+
+    static float reduce_min(vec v) {
+        __m128 m = _mm_min_ps(v, _mm_movehl_ps(v, v));
+        m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 0x1));
+        return _mm_cvtss_f32(m);
+    }
+};
+
+} // namespace simd_sse4
+RT_SIMD_END
+
+#endif
+
+#endif
@@ -2,25 +2,41 @@
 #define SPHERE_H
 
 // The sphere class represents a sphere in 3D space and inherits from the 'hittable' base class.
-// Each sphere object has a center, a radius, and a material.
-// The 'hit' method checks if a given ray intersects the sphere and records the hit details if it does.
+// Each sphere object has a center, a radius, and a material. A moving sphere also has a
+// motion: its center travels from `center` at time 0 to `center + motion` at time 1 along a
+// straight line, and rays meet it where it is at their time (see ray::time).
+// The 'intersect' method checks if a given ray intersects the sphere; 'fill_hit_record' then records
+// the hit details of the closest intersection only.
 
 class sphere : public hittable {
   public:
     // Constructor to initialize the sphere's center, radius, and material.
     // Radius is clamped to zero or positive to prevent invalid shapes.
-    sphere(const point3& center, double radius, shared_ptr<material> mat)
-      : center(center), radius(std::fmax(0,radius)), mat(mat) {}
+    sphere(const point3& center, real radius, shared_ptr<material> mat) : sphere(center, center, radius, mat) {}
+
+    // Constructor for a moving sphere, centered on `start_center` at time 0 and on
+    // `end_center` at time 1.
+    sphere(const point3& start_center, const point3& end_center, real radius, shared_ptr<material> mat)
+      : center(start_center), motion(end_center - start_center), radius(std::fmax(0,radius)), mat(mat)
+    {
+        // Constants of the intersection test, computed once instead of on every ray
+        radius_squared = this->radius * this->radius;
+        inverse_radius = this->radius > 0 ? 1 / this->radius : 0;
+
+        // The bounding box spans the center plus/minus the radius on every axis, at both ends
+        // of the motion: the swept box holds the sphere at any time
+        auto radius_vector = vec3(this->radius, this->radius, this->radius);
+        bbox = aabb(aabb(start_center - radius_vector, start_center + radius_vector), aabb(end_center - radius_vector, end_center + radius_vector));
+    }
 
     // Method to determine if a ray hits the sphere within a given interval.
-    // Takes a ray (r), an interval (ray_t), and a hit record (rec) to store hit details.
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        // Compute the vector from the ray origin to the center of the sphere.
-        vec3 oc = center - r.origin();
+    // Takes a ray (r) with a unit direction, an interval (ray_t), and the closest hit found so far
+    // (candidate), which is replaced if this sphere is hit closer. Only `t` is computed here.
+    bool intersect(const ray& r, interval ray_t, hit_candidate& candidate) const override {
+        RT_STAT(stats.primitive_tests++);
 
-        // 'a' represents the squared length of the ray direction vector.
-        // This value is used to normalize the direction component in the discriminant.
-        auto a = r.direction().length_squared();
+        // Compute the vector from the ray origin to the center of the sphere at the ray's time.
+        vec3 oc = center_at(r.time()) - r.origin();
 
         // 'h' is the projection of 'oc' onto the ray direction.
         // It represents half the length of the vector along the ray's direction
@@ -29,11 +45,12 @@ class sphere : public hittable {
 
         // 'c' is the squared distance from the ray origin to the sphere center,
         // adjusted by the sphere's radius. This is needed to calculate the discriminant.
-        auto c = oc.length_squared() - radius*radius;
+        auto c = oc.length_squared() - radius_squared;
 
         // Compute the discriminant to determine if the ray intersects the sphere.
+        // The direction is a unit vector, so the quadratic's 'a' term is 1 and drops out.
         // If the discriminant is negative, there is no intersection (ray misses the sphere).
-        auto discriminant = h*h - a*c;
+        auto discriminant = h*h - c;
         if (discriminant < 0)
             return false;
 
@@ -42,36 +59,57 @@ class sphere : public hittable {
 
         // Find the nearest root (t-value) that lies within the acceptable range.
         // This is the distance from the ray origin to the intersection point on the sphere.
-        auto root = (h - sqrtd) / a;
+        auto root = h - sqrtd;
         if (!ray_t.surrounds(root)) {  // Check if this root is within the interval
             // If the first root is not in the range, try the second possible root.
-            root = (h + sqrtd) / a;
+            root = h + sqrtd;
             if (!ray_t.surrounds(root)) // If both roots are out of range, there's no hit
                 return false;
         }
 
-        // If an intersection is found within the acceptable range, we record the hit details:
-        rec.t = root;                 // The t-value of the intersection point
+        candidate.set(root, this);
+        return true;  // The ray hit the sphere within the acceptable range
+    }
+
+    // Records the hit details of an intersection found by intersect().
+    void fill_hit_record(const ray& r, const hit_candidate& candidate, hit_record& rec) const override {
+        rec.t = candidate.t;          // The t-value of the intersection point
         rec.p = r.at(rec.t);          // Calculate the exact hit point on the sphere surface
 
         // Calculate the outward normal vector at the intersection point.
         // The normal is derived by subtracting the sphere's center from the hit point
-        // and dividing by the radius to ensure it’s unit length.
-        vec3 outward_normal = (rec.p - center) / radius;
+        // and scaling by the inverse radius to ensure it's unit length.
+        vec3 outward_normal = (rec.p - center_at(r.time())) * inverse_radius;
 
         // Set the hit record's normal, ensuring it faces against the ray's direction if needed.
         rec.set_face_normal(r, outward_normal);
 
         // Store the sphere's material in the hit record for shading or further processing.
-        rec.mat = mat;
-
-        return true;  // The ray hit the sphere within the acceptable range
+        rec.mat = mat.get();
     }
 
+    // Returns the precomputed box enclosing the sphere over its whole motion.
+    aabb bounding_box() const override { return bbox; }
+
+    // Center of the sphere at `time`.
+    point3 center_at(real time) const { return center + time * motion; }
+
+    // Radius of the sphere.
+    real sphere_radius() const { return radius; }
+
+    // Material of the sphere, as hit records point to it.
+    const material* surface_material() const { return mat.get(); }
+
   private:
-    point3 center = {};               // Sphere center point
-    double radius = {};               // Sphere radius
-    shared_ptr<material> mat = {};    // Material of the sphere
+    friend class sphere_batch; // Copies spheres into its structure-of-arrays layout
+
+    point3 center = {};               // Sphere center point (at time 0 for a moving sphere)
+    vec3 motion = {};                 // Distance the center travels from time 0 to time 1 (zero: static)
+    real radius = {};                 // Sphere radius
+    real radius_squared = {};         // radius * radius, used by intersect()
+    real inverse_radius = {};         // 1 / radius (0 for a point), scales the normal in fill_hit_record()
+    shared_ptr<material> mat = {};    // Material of the sphere (owned here, hit records only point to it)
+    aabb bbox = {};                   // Box enclosing the sphere
 };
 
 #endif
@@ -0,0 +1,308 @@
+#ifndef SPHERE_BATCH_H
+#define SPHERE_BATCH_H
+
+#include "hittable.hpp"
+#include "simd.hpp"
+#include "sphere.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+
+// Pointers to the per-sphere arrays of a sphere_batch, as its SIMD kernels read them. The
+// motion pointers are null when no sphere of the batch moves.
+struct sphere_arrays {
+    const real* center_x;
+    const real* center_y;
+    const real* center_z;
+    const real* radii;
+    const real* motion_x;
+    const real* motion_y;
+    const real* motion_z;
+};
+
+// One copy of the kernels per backend, each compiled for its instruction set
+#ifdef RT_SIMD_X86
+RT_SIMD_AVX512_BEGIN
+namespace simd_avx512 {
+#include "sphere_kernel.hpp"
+}
+RT_SIMD_END
+
+RT_SIMD_AVX2_BEGIN
+namespace simd_avx2 {
+#include "sphere_kernel.hpp"
+}
+RT_SIMD_END
+
+RT_SIMD_SSE4_BEGIN
+namespace simd_sse4 {
+#include "sphere_kernel.hpp"
+}
+RT_SIMD_END
+#endif
+
+
+// sphere_batch stores many spheres in structure-of-arrays form: one array per center
+// coordinate, one for the radii and one for 16-bit material indices into a shared table of
+// distinct materials. A sphere takes four `real`s and two bytes (18 bytes in float builds,
+// 34 with double geometry) and no allocation of its own, so millions of them fit where
+// millions of sphere objects would not. Laid out like this, a single ray can be tested
+// against a whole group of spheres per instruction. The kernel (sphere_kernel.hpp) is
+// compiled for every backend of simd.hpp and picked by simd_active_isa when the program
+// starts: AVX-512 (8 doubles or 16 floats at once), AVX2 (4 or 8), SSE4.1 (2 or 4),
+// or a plain scalar loop.
+//
+// Intersection happens in two steps: the kernel only finds the closest `t` and the index
+// of the sphere it belongs to (a hit_candidate), and fill_hit_record() builds the record
+// once, for that sphere only. Rays have unit directions, so the kernel never divides.
+//
+// Moving spheres (see sphere) add three more arrays with the distance every center travels
+// over the shutter interval. A batch without a moving sphere leaves them empty and runs the
+// static kernel, so motion costs nothing in scenes that have none.
+class sphere_batch : public hittable {
+public:
+    // Number of spheres the active kernel tests per instruction
+    static int lane_count() { return simd_width<real>(simd_active_isa); }
+
+    sphere_batch() {}
+
+    // Most distinct materials one batch can refer to (the range of its material indices)
+    static constexpr size_t max_materials = size_t(1) << 16;
+
+    // Appends a sphere, centered on `center` at time 0 and moved by `motion` at time 1.
+    // Materials shared by several spheres are stored only once. Returns false, adding
+    // nothing, if the sphere would be the batch's max_materials + 1st material.
+    bool add(const point3& center, real radius, shared_ptr<material> mat, const vec3& motion = vec3(0, 0, 0)) {
+        std::uint16_t slot;
+        if (!material_slot(mat, slot))
+            return false;
+        push_motion(motion);
+        center_x.push_back(center.x());
+        center_y.push_back(center.y());
+        center_z.push_back(center.z());
+        radii.push_back(std::fmax(real(0), radius));
+        material_index.push_back(slot);
+        bbox = aabb(bbox, box(size() - 1));
+        return true;
+    }
+
+    // Appends a copy of an existing sphere.
+    bool add(const sphere& s) { return add(s.center, s.radius, s.mat, s.motion); }
+
+    // Appends a copy of sphere `i` of `source`, a batch made with_materials_of() this one's
+    // table source (the material index is copied as is).
+    void append(const sphere_batch& source, size_t i) {
+        push_motion(source.sphere_motion(i));
+        center_x.push_back(source.center_x[i]);
+        center_y.push_back(source.center_y[i]);
+        center_z.push_back(source.center_z[i]);
+        radii.push_back(source.radii[i]);
+        material_index.push_back(source.material_index[i]);
+        bbox = aabb(bbox, box(size() - 1));
+    }
+
+    // An empty batch sharing the material table of `source`, for copying its spheres over
+    // in another order with append().
+    static sphere_batch with_materials_of(const sphere_batch& source) {
+        sphere_batch batch;
+        batch.material_table = source.material_table;
+        batch.materials = source.materials;
+        batch.material_slots = source.material_slots;
+        return batch;
+    }
+
+    // Appends an empty slot that keeps indices aligned with another array (see bvh_node).
+    // A placeholder must never be part of a range passed to intersect_range().
+    void add_placeholder() {
+        push_motion(vec3(0, 0, 0));
+        center_x.push_back(0);
+        center_y.push_back(0);
+        center_z.push_back(0);
+        radii.push_back(0);
+        material_index.push_back(0);
+    }
+
+    // Number of spheres (and placeholders) in the batch.
+    size_t size() const { return radii.size(); }
+
+    // True if any sphere of the batch moves.
+    bool has_motion() const { return !motion_x.empty(); }
+
+    // Box enclosing sphere `i` over its whole motion.
+    aabb box(size_t i) const { return aabb(box_at(i, 0), box_at(i, 1)); }
+
+    // Box enclosing sphere `i` at `time`.
+    aabb box_at(size_t i, real time) const {
+        auto radius_vector = vec3(radii[i], radii[i], radii[i]);
+        point3 center = sphere_center(i) + time * sphere_motion(i);
+        return aabb(center - radius_vector, center + radius_vector);
+    }
+
+    // Center (at time 0), motion, radius and material of sphere `i`.
+    point3 sphere_center(size_t i) const { return point3(center_x[i], center_y[i], center_z[i]); }
+    vec3 sphere_motion(size_t i) const { return has_motion() ? vec3(motion_x[i], motion_y[i], motion_z[i]) : vec3(0, 0, 0); }
+    real sphere_radius(size_t i) const { return radii[i]; }
+    const material* sphere_material(size_t i) const { return material_table[material_index[i]]; }
+
+    // Bytes held by the per-sphere arrays (the material table is not counted).
+    size_t memory_bytes() const {
+        return (4 * radii.capacity() + 3 * motion_x.capacity()) * sizeof(real) + material_index.capacity() * sizeof(std::uint16_t);
+    }
+
+    // Tests the ray against every sphere of the batch.
+    bool intersect(const ray& r, interval ray_t, hit_candidate& candidate) const override {
+        return intersect_range(r, ray_t, candidate, 0, size());
+    }
+
+    // Tests the ray against spheres [first, first + count) and records the closest one in
+    // `candidate` if it is hit inside `ray_t`.
+    bool intersect_range(const ray& r, interval ray_t, hit_candidate& candidate, size_t first, size_t count) const {
+        RT_STAT(stats.primitive_tests += count);
+        real closest_t = ray_t.max;
+        size_t closest_index = 0;
+        if (!closest_hit(r, ray_t, first, count, closest_t, closest_index))
+            return false;
+
+        candidate.set(closest_t, this, closest_index);
+        return true;
+    }
+
+    // Returns true if any sphere of the batch is hit inside `ray_t`.
+    bool occluded(const ray& r, interval ray_t) const override {
+        return occluded_range(r, ray_t, 0, size());
+    }
+
+    // Returns true if any of spheres [first, first + count) is hit inside `ray_t`. The
+    // kernels stop at the first chunk with a hit instead of finishing the range.
+    bool occluded_range(const ray& r, interval ray_t, size_t first, size_t count) const {
+        RT_STAT(stats.primitive_tests += count);
+        real closest_t = ray_t.max;
+        size_t closest_index = 0;
+        return closest_hit<true>(r, ray_t, first, count, closest_t, closest_index);
+    }
+
+    // Builds the hit record of the sphere intersect_range() picked.
+    void fill_hit_record(const ray& r, const hit_candidate& candidate, hit_record& rec) const override {
+        size_t i = candidate.index;
+        point3 center = sphere_center(i) + r.time() * sphere_motion(i);
+        rec.t = candidate.t;
+        rec.p = r.at(rec.t);
+        real inverse_radius = radii[i] > 0 ? 1 / radii[i] : 0; // Only computed for the winner
+        vec3 outward_normal = (rec.p - center) * inverse_radius;
+        rec.set_face_normal(r, outward_normal);
+        rec.mat = material_table[material_index[i]];
+    }
+
+    // Returns the box enclosing every sphere of the batch.
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    std::vector<real> center_x = {}; // Center x coordinate of every sphere
+    std::vector<real> center_y = {}; // Center y coordinate of every sphere
+    std::vector<real> center_z = {}; // Center z coordinate of every sphere
+    std::vector<real> radii = {}; // Radius of every sphere (the kernels square it themselves)
+    std::vector<real> motion_x = {}; // Distance every center moves along x from time 0 to 1 (all three empty: nothing moves)
+    std::vector<real> motion_y = {}; // ... along y
+    std::vector<real> motion_z = {}; // ... along z
+    std::vector<std::uint16_t> material_index = {}; // Index into `material_table` for every sphere
+    std::vector<const material*> material_table = {}; // Distinct materials used by the batch, read by hits
+    std::vector<shared_ptr<material>> materials = {}; // Keeps the table's materials alive, never touched by hits
+    std::unordered_map<const material*, std::uint16_t> material_slots = {}; // Material -> index in `material_table`
+    aabb bbox = {}; // Box enclosing every sphere
+
+    // Records the motion of the sphere about to be appended. The motion arrays are created
+    // with the first moving sphere, filled with zeros for the static ones before it.
+    void push_motion(const vec3& motion) {
+        if (!has_motion() && motion.length_squared() == 0)
+            return;
+        if (!has_motion()) {
+            motion_x.assign(size(), 0);
+            motion_y.assign(size(), 0);
+            motion_z.assign(size(), 0);
+        }
+        motion_x.push_back(motion.x());
+        motion_y.push_back(motion.y());
+        motion_z.push_back(motion.z());
+    }
+
+    // Finds the table index of `mat` in `slot`, adding it on first use. Returns false if
+    // the table is full.
+    bool material_slot(const shared_ptr<material>& mat, std::uint16_t& slot) {
+        auto found = material_slots.find(mat.get());
+        if (found != material_slots.end()) {
+            slot = found->second;
+            return true;
+        }
+        if (materials.size() >= max_materials)
+            return false;
+
+        slot = static_cast<std::uint16_t>(materials.size());
+        materials.push_back(mat);
+        material_table.push_back(mat.get());
+        material_slots.emplace(mat.get(), slot);
+        return true;
+    }
+
+    // Finds the closest intersection among spheres [first, first + count) inside `ray_t`.
+    // On success `closest_t` and `closest_index` describe the winning sphere. With `any_hit`
+    // the search returns at the first hit found, which is then not necessarily the closest.
+    template <bool any_hit = false>
+    bool closest_hit(const ray& r, interval ray_t, size_t first, size_t count, real& closest_t, size_t& closest_index) const {
+        bool hit_anything = false;
+        size_t i = first;
+        size_t end = first + count;
+
+        sphere_arrays arrays = {center_x.data(), center_y.data(), center_z.data(), radii.data(), nullptr, nullptr, nullptr};
+        if (has_motion()) {
+            arrays.motion_x = motion_x.data();
+            arrays.motion_y = motion_y.data();
+            arrays.motion_z = motion_z.data();
+        }
+        switch (simd_active_isa) {
+#ifdef RT_SIMD_X86
+            case simd_isa::avx512: hit_anything = simd_avx512::closest_hit<any_hit>(arrays, r, ray_t, i, end, closest_t, closest_index); break;
+            case simd_isa::avx2: hit_anything = simd_avx2::closest_hit<any_hit>(arrays, r, ray_t, i, end, closest_t, closest_index); break;
+            case simd_isa::sse4: hit_anything = simd_sse4::closest_hit<any_hit>(arrays, r, ray_t, i, end, closest_t, closest_index); break;
+#endif
+            default: break;
+        }
+        if (any_hit && hit_anything)
+            return true;
+
+        // Scalar loop: the whole range without SIMD, or the leftover spheres without masked loads
+        const vec3& origin = r.origin();
+        const vec3& direction = r.direction();
+        bool moving = has_motion();
+        for (; i < end; ++i) {
+            vec3 oc = vec3(center_x[i], center_y[i], center_z[i]) - origin;
+            if (moving)
+                oc += r.time() * vec3(motion_x[i], motion_y[i], motion_z[i]);
+            real h = dot(direction, oc);
+            real c = oc.length_squared() - radii[i] * radii[i];
+            real discriminant = h * h - c;
+            if (discriminant < 0)
+                continue;
+
+            real sqrtd = std::sqrt(discriminant);
+            real root = h - sqrtd;
+            if (!(ray_t.min < root && root < closest_t)) {
+                root = h + sqrtd;
+                if (!(ray_t.min < root && root < closest_t))
+                    continue;
+            }
+
+            hit_anything = true;
+            closest_t = root;
+            closest_index = i;
+            if constexpr (any_hit)
+                return true;
+        }
+        return hit_anything;
+    }
+};
+
+#endif
@@ -0,0 +1,106 @@
+// SIMD kernels of sphere_batch, written against `lanes<real>`.
+//
+// This file has no include guard on purpose: sphere_batch.hpp includes it once inside
+// every backend namespace of simd.hpp (and, on x86, inside that backend's target pragmas),
+// so each copy compiles for its own instruction set and uses its own `lanes`. It must not
+// be included anywhere else.
+
+// Tests `lanes<real>::width` spheres per iteration over [begin, end). With masked loads the
+// last partial chunk is masked off; otherwise the range must be a whole number of chunks.
+// Every lane keeps its own closest hit; the lanes are reduced once at the end. With
+// `any_hit` the first chunk holding a hit ends the loop. With `moving` every center is
+// first moved to the ray's time.
+template <bool any_hit, bool moving>
+bool closest_hit_chunk(const sphere_arrays& spheres, const ray& r, interval ray_t, size_t begin, size_t end, real& closest_t, size_t& closest_index) {
+    using vec = typename lanes<real>::vec;
+    using mask = typename lanes<real>::mask;
+    using L = lanes<real>;
+
+    const vec3& origin = r.origin();
+    const vec3& direction = r.direction();
+
+    const vec ox = L::set1(origin.x()), oy = L::set1(origin.y()), oz = L::set1(origin.z());
+    const vec dx = L::set1(direction.x()), dy = L::set1(direction.y()), dz = L::set1(direction.z());
+    [[maybe_unused]] const vec time = L::set1(r.time());
+    const vec t_min = L::set1(ray_t.min);
+    const vec zero = L::zero();
+    const vec lane_offsets = L::iota();
+
+    vec best_t = L::set1(closest_t); // Closest t found by each lane
+    vec best_index = L::set1(-1); // Sphere index of that hit, relative to `begin` (-1: none)
+
+    for (size_t i = begin; i < end; i += L::width) {
+        mask active = L::tail(end - i);
+
+        vec ocx = L::sub(L::load(active, &spheres.center_x[i]), ox);
+        vec ocy = L::sub(L::load(active, &spheres.center_y[i]), oy);
+        vec ocz = L::sub(L::load(active, &spheres.center_z[i]), oz);
+        if constexpr (moving) {
+            ocx = L::fmadd(time, L::load(active, &spheres.motion_x[i]), ocx);
+            ocy = L::fmadd(time, L::load(active, &spheres.motion_y[i]), ocy);
+            ocz = L::fmadd(time, L::load(active, &spheres.motion_z[i]), ocz);
+        }
+        vec radius = L::load(active, &spheres.radii[i]);
+        vec radius_squared = L::mul(radius, radius);
+
+        // Same quadratic as sphere::intersect, one sphere per lane
+        vec h = L::fmadd(dz, ocz, L::fmadd(dy, ocy, L::mul(dx, ocx)));
+        vec oc_squared = L::fmadd(ocz, ocz, L::fmadd(ocy, ocy, L::mul(ocx, ocx)));
+        vec c = L::sub(oc_squared, radius_squared);
+        vec discriminant = L::sub(L::mul(h, h), c);
+        active = L::both(active, L::greater_equal(discriminant, zero));
+        if (!L::any(active))
+            continue;
+
+        vec sqrtd = L::sqrt(active, discriminant); // Lanes that missed stay zero
+        vec near_root = L::sub(h, sqrtd);
+        vec far_root = L::add(h, sqrtd);
+
+        // Prefer the near root, fall back to the far one, exactly like the scalar test
+        mask near_ok = L::both(L::greater(near_root, t_min), L::less(near_root, best_t));
+        mask far_ok = L::both(L::greater(far_root, t_min), L::less(far_root, best_t));
+        vec root = L::blend(near_ok, far_root, near_root);
+        mask closer = L::both(active, L::either(near_ok, far_ok));
+
+        vec index = L::add(L::set1(static_cast<real>(i - begin)), lane_offsets);
+        best_t = L::blend(closer, best_t, root);
+        best_index = L::blend(closer, best_index, index);
+        if constexpr (any_hit) {
+            if (L::any(closer))
+                break;
+        }
+    }
+
+    // Reduce in registers: the smallest t wins, ties go to the lowest sphere index
+    mask found = L::greater_equal(best_index, zero);
+    if (!L::any(found))
+        return false;
+    const vec none = L::set1(std::numeric_limits<real>::max());
+    closest_t = L::reduce_min(L::blend(found, none, best_t));
+    mask winners = L::both(found, L::equal(best_t, L::set1(closest_t)));
+    closest_index = begin + static_cast<size_t>(L::reduce_min(L::blend(winners, none, best_index)));
+    return true;
+}
+
+// Runs the kernel over as much of [first, end) as it can take and moves `first` past the
+// spheres it tested; without masked loads the last partial chunk is left for scalar code.
+// Results as for closest_hit_chunk().
+template <bool any_hit>
+bool closest_hit(const sphere_arrays& spheres, const ray& r, interval ray_t, size_t& first, size_t end, real& closest_t, size_t& closest_index) {
+    // The kernel keeps sphere indices in `real` lanes, relative to the start of each call.
+    // Floats hold integers exactly only up to 2^24, so long ranges go in chunks.
+    constexpr size_t max_chunk = size_t(1) << 24;
+    size_t simd_end = lanes<real>::masked_tail ? end : end - ((end - first) % lanes<real>::width);
+    bool hit_anything = false;
+    while (first < simd_end) {
+        size_t chunk_end = std::min(simd_end, first + max_chunk);
+        if (spheres.motion_x)
+            hit_anything |= closest_hit_chunk<any_hit, true>(spheres, r, ray_t, first, chunk_end, closest_t, closest_index);
+        else
+            hit_anything |= closest_hit_chunk<any_hit, false>(spheres, r, ray_t, first, chunk_end, closest_t, closest_index);
+        first = chunk_end;
+        if (any_hit && hit_anything)
+            break;
+    }
+    return hit_anything;
+}
@@ -0,0 +1,170 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// thread_pool keeps a fixed set of worker threads alive and hands them batches of jobs.
+// Each batch is split into one contiguous block of job indices per worker. A worker pops
+// jobs from the front of its own queue and, once that runs dry, steals from the back of
+// another worker's queue. This keeps neighbouring jobs (e.g. adjacent tiles) on the same
+// thread while still letting idle threads pick up work left behind by slow ones.
+class thread_pool {
+public:
+    // A job receives its index within the batch and the index of the worker running it.
+    using job = std::function<void(int job_index, int worker_index)>;
+
+    // Starts `thread_count` workers. A count of zero or less uses every hardware thread.
+    explicit thread_pool(int thread_count = 0) {
+        if (thread_count <= 0)
+            thread_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+        queues = std::vector<job_queue>(thread_count);
+        for (int worker = 0; worker < thread_count; ++worker)
+            workers.emplace_back([this, worker] { worker_loop(worker); });
+    }
+
+    // Workers hold a pointer to the pool, so it can be neither copied nor moved.
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    // Waits for the current batch (if any) and joins every worker.
+    ~thread_pool() {
+        wait();
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+            stopping = true;
+        }
+        wake_workers.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    // Number of worker threads in the pool.
+    int size() const { return static_cast<int>(workers.size()); }
+
+    // Queues jobs [0, job_count) and returns immediately; use wait() or wait_for() to join.
+    void start(int job_count, job task) {
+        wait(); // Only one batch runs at a time
+
+        // Publish the task before any job becomes visible: a worker still draining the
+        // previous batch may pick up a new job the moment it lands in a queue.
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+            current_task = std::move(task);
+            jobs_left = job_count;
+        }
+
+        // Hand each worker a contiguous block so it starts on neighbouring jobs
+        int thread_count = size();
+        for (int worker = 0; worker < thread_count; ++worker) {
+            int first = static_cast<int>(static_cast<long long>(job_count) * worker / thread_count);
+            int last = static_cast<int>(static_cast<long long>(job_count) * (worker + 1) / thread_count);
+
+            std::lock_guard<std::mutex> guard(queues[worker].lock);
+            for (int job_index = first; job_index < last; ++job_index)
+                queues[worker].jobs.push_back(job_index);
+        }
+
+        // Wake sleeping workers only once every job is queued
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+            ++batch;
+        }
+        wake_workers.notify_all();
+    }
+
+    // Blocks until every job of the current batch has finished.
+    void wait() {
+        std::unique_lock<std::mutex> guard(state_lock);
+        batch_done.wait(guard, [this] { return jobs_left == 0; });
+    }
+
+    // Blocks for at most `timeout`; returns true if the current batch has finished.
+    template <typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout) {
+        std::unique_lock<std::mutex> guard(state_lock);
+        return batch_done.wait_for(guard, timeout, [this] { return jobs_left == 0; });
+    }
+
+    // Convenience wrapper: runs a batch to completion on the pool.
+    void run(int job_count, job task) {
+        start(job_count, std::move(task));
+        wait();
+    }
+
+private:
+    // Per-worker deque of job indices. The owner takes from the front, thieves from the back.
+    struct job_queue {
+        std::mutex lock;
+        std::deque<int> jobs;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<job_queue> queues;
+
+    std::mutex state_lock; // Guards everything below
+    std::condition_variable wake_workers; // Signalled when a batch starts or the pool stops
+    std::condition_variable batch_done; // Signalled when the last job of a batch finishes
+    job current_task = {};
+    int jobs_left = 0;
+    unsigned long long batch = 0; // Incremented for every started batch
+    bool stopping = false;
+
+    // Takes the next job for `worker`: its own queue first, then a victim's queue.
+    bool next_job(int worker, int& job_index) {
+        {
+            std::lock_guard<std::mutex> guard(queues[worker].lock);
+            if (!queues[worker].jobs.empty()) {
+                job_index = queues[worker].jobs.front();
+                queues[worker].jobs.pop_front();
+                return true;
+            }
+        }
+
+        // Steal, starting from the next worker over so thieves spread across victims
+        int thread_count = size();
+        for (int offset = 1; offset < thread_count; ++offset) {
+            job_queue& victim = queues[(worker + offset) % thread_count];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.jobs.empty()) {
+                job_index = victim.jobs.back();
+                victim.jobs.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker_loop(int worker) {
+        unsigned long long seen_batch = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(state_lock);
+                wake_workers.wait(guard, [&] { return stopping || batch != seen_batch; });
+                if (stopping)
+                    return;
+                seen_batch = batch;
+            }
+
+            // Drain jobs until every queue is empty. The task cannot change while any job
+            // of its batch is queued or running, so it is safe to read without the lock.
+            int job_index = 0;
+            while (next_job(worker, job_index)) {
+                current_task(job_index, worker);
+
+                std::lock_guard<std::mutex> guard(state_lock);
+                if (--jobs_left == 0)
+                    batch_done.notify_all();
+            }
+        }
+    }
+};
+
+#endif
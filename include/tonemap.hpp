@@ -0,0 +1,76 @@
+#ifndef TONEMAP_H
+#define TONEMAP_H
+
+#include "framebuffer.hpp"
+
+#include <string>
+#include <vector>
+
+// The display pass: turns the linear radiance of a framebuffer into 8-bit RGB. It runs only
+// when an image file is written, so the framebuffer (and every checkpoint or partial
+// framebuffer taken from it) keeps the unclamped linear values. The default settings
+// reproduce write_color() exactly.
+
+// Curves that compress linear radiance (after exposure) into [0, 1].
+enum class tonemap_curve {
+    clamp, // Values above 1 clip to white (what write_color does)
+    reinhard, // x / (1 + x): bright highlights roll off instead of clipping
+    aces, // Narkowicz's fit of the ACES filmic curve
+};
+
+// Settings of the display pass.
+struct tonemap_settings {
+    double exposure = 1.0; // Linear scale applied before the curve
+    tonemap_curve curve = tonemap_curve::clamp; // Highlight compression
+    double gamma = 2.0; // Display gamma (2 takes the square root, like linear_to_gamma)
+
+    // True for the settings that match write_color().
+    bool is_default() const { return exposure == 1.0 && curve == tonemap_curve::clamp && gamma == 2.0; }
+};
+
+// Parses "clamp", "reinhard" or "aces" into `curve`. Returns false for anything else.
+inline bool parse_tonemap_curve(const std::string& name, tonemap_curve& curve) {
+    if (name == "clamp")
+        curve = tonemap_curve::clamp;
+    else if (name == "reinhard")
+        curve = tonemap_curve::reinhard;
+    else if (name == "aces")
+        curve = tonemap_curve::aces;
+    else
+        return false;
+    return true;
+}
+
+// Maps one linear component to a display value in [0, 1] (before quantization).
+inline double tonemap_component(double linear, const tonemap_settings& settings) {
+    double x = linear > 0 ? linear * settings.exposure : 0;
+    switch (settings.curve) {
+    case tonemap_curve::reinhard:
+        x = x / (1 + x);
+        break;
+    case tonemap_curve::aces:
+        x = (x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14);
+        break;
+    default:
+        break;
+    }
+    return settings.gamma == 2.0 ? std::sqrt(x) : std::pow(x, 1.0 / settings.gamma);
+}
+
+// Tonemaps, gamma-corrects and quantizes every pixel of `image` into one contiguous buffer
+// of 8-bit RGB triplets, row by row from the top, ready to be handed to an image_writer.
+inline std::vector<unsigned char> tonemap_to_rgb8(const framebuffer& image, const tonemap_settings& settings) {
+    if (settings.is_default())
+        return image.to_rgb8();
+
+    static const interval intensity(0.000, 0.999); // Same clamp as write_color
+    std::vector<unsigned char> bytes(image.pixels.size() * 3);
+    for (size_t i = 0; i < image.pixels.size(); ++i) {
+        const color& pixel = image.pixels[i];
+        for (int c = 0; c < 3; ++c)
+            bytes[3 * i + c] = static_cast<unsigned char>(256 * intensity.clamp(tonemap_component(pixel[c], settings)));
+    }
+    return bytes;
+}
+
+#endif
@@ -2,32 +2,37 @@
 #define VEC3_H
 
 #include <cmath> // Required for sqrt and fabs functions
+#include <limits>
 
-// vec3 class represents a 3D vector with basic vector operations, commonly used in graphics and physics
-class vec3 {
+// vec3_t represents a 3D vector with basic vector operations, commonly used in graphics and physics.
+// It is templated on the scalar type so a whole render can run in float or double (see `real`).
+template <typename T>
+class vec3_t {
   public:
-    double e[3] = {}; // Stores the three components of the vector (x, y, z)
+    using value_type = T; // Scalar type of the components
+
+    T e[3] = {}; // Stores the three components of the vector (x, y, z)
 
     // Default constructor: initializes the vector to (0,0,0)
-    vec3() : e{0,0,0} {}
+    vec3_t() : e{0,0,0} {}
 
     // Parameterized constructor: initializes the vector to (e0, e1, e2)
-    vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+    vec3_t(T e0, T e1, T e2) : e{e0, e1, e2} {}
 
     // Accessor functions to retrieve each component
-    double x() const { return e[0]; }
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
+    T x() const { return e[0]; }
+    T y() const { return e[1]; }
+    T z() const { return e[2]; }
 
     // Unary negation operator to invert each component of the vector
-    vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
+    vec3_t operator-() const { return vec3_t(-e[0], -e[1], -e[2]); }
 
     // Index operators to get and set components of the vector
-    double operator[](int i) const { return e[i]; }
-    double& operator[](int i) { return e[i]; }
+    T operator[](int i) const { return e[i]; }
+    T& operator[](int i) { return e[i]; }
 
     // Vector addition and assignment
-    vec3& operator+=(const vec3& v) {
+    vec3_t& operator+=(const vec3_t& v) {
         e[0] += v.e[0];
         e[1] += v.e[1];
         e[2] += v.e[2];
@@ -35,7 +40,7 @@ class vec3 {
     }
 
     // Scalar multiplication and assignment (scales each component by t)
-    vec3& operator*=(double t) {
+    vec3_t& operator*=(T t) {
         e[0] *= t;
         e[1] *= t;
         e[2] *= t;
@@ -43,128 +48,195 @@ class vec3 {
     }
 
     // Scalar division and assignment (divides each component by t)
-    vec3& operator/=(double t) {
+    vec3_t& operator/=(T t) {
         return *this *= 1/t; // Dividing by t is equivalent to multiplying by 1/t
     }
 
     // Returns the length (magnitude) of the vector
-    double length() const {
+    T length() const {
         return std::sqrt(length_squared());
     }
 
     // Returns the square of the length, which is faster to compute and useful for comparison
-    double length_squared() const {
+    T length_squared() const {
         return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
     }
 
     // Checks if the vector is close to zero in all dimensions
     bool near_zero() const {
         // Define a small threshold value (1e-8) for comparison
-        auto s = 1e-8;
+        auto s = T(1e-8);
         return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
     }
 
     // Generates a random vector with each component between 0 and 1
-    static vec3 random() {
-        return vec3(random_double(), random_double(), random_double());
+    static vec3_t random() {
+        return vec3_t(T(random_double()), T(random_double()), T(random_double()));
     }
 
     // Generates a random vector with each component between min and max
-    static vec3 random(double min, double max) {
-        return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+    static vec3_t random(double min, double max) {
+        return vec3_t(T(random_double(min, max)), T(random_double(min, max)), T(random_double(min, max)));
+    }
+
+    // Same as random(min, max), drawing from the given generator
+    static vec3_t random(rng& gen, double min, double max) {
+        return vec3_t(T(gen.next_double(min, max)), T(gen.next_double(min, max)), T(gen.next_double(min, max)));
     }
 };
 
+// The vector type used by the renderer, in the precision selected at build time
+using vec3 = vec3_t<real>;
+
 // Define point3 as an alias for vec3 to represent points in 3D space (for semantic clarity)
 using point3 = vec3;
 
 // Vector Utility Functions
+// Scalar parameters use `scalar_of<T>` so they do not take part in template deduction:
+// `0.5 * v` then works for float vectors too, with the literal converted to float.
+
+template <typename T>
+using scalar_of = typename vec3_t<T>::value_type;
 
 // Vector addition
-inline vec3 operator+(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+template <typename T>
+inline vec3_t<T> operator+(const vec3_t<T>& u, const vec3_t<T>& v) {
+    return vec3_t<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
 
 // Vector subtraction
-inline vec3 operator-(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+template <typename T>
+inline vec3_t<T> operator-(const vec3_t<T>& u, const vec3_t<T>& v) {
+    return vec3_t<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
 
 // Component-wise vector multiplication (not dot product)
-inline vec3 operator*(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T>& u, const vec3_t<T>& v) {
+    return vec3_t<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
 // Scalar multiplication (scales the vector by t)
-inline vec3 operator*(double t, const vec3& v) {
-    return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
+template <typename T>
+inline vec3_t<T> operator*(scalar_of<T> t, const vec3_t<T>& v) {
+    return vec3_t<T>(t * v.e[0], t * v.e[1], t * v.e[2]);
 }
 
 // Scalar multiplication in reversed order (for symmetry)
-inline vec3 operator*(const vec3& v, double t) {
+template <typename T>
+inline vec3_t<T> operator*(const vec3_t<T>& v, scalar_of<T> t) {
     return t * v;
 }
 
 // Scalar division (scales the vector by 1/t)
-inline vec3 operator/(const vec3& v, double t) {
+template <typename T>
+inline vec3_t<T> operator/(const vec3_t<T>& v, scalar_of<T> t) {
     return (1/t) * v;
 }
 
 // Dot product: returns a scalar representing the cosine of the angle between u and v
-inline double dot(const vec3& u, const vec3& v) {
+template <typename T>
+inline T dot(const vec3_t<T>& u, const vec3_t<T>& v) {
     return u.e[0] * v.e[0] + u.e[1] * v.e[1] + u.e[2] * v.e[2];
 }
 
 // Cross product: returns a vector perpendicular to both u and v
-inline vec3 cross(const vec3& u, const vec3& v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+template <typename T>
+inline vec3_t<T> cross(const vec3_t<T>& u, const vec3_t<T>& v) {
+    return vec3_t<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
                 u.e[2] * v.e[0] - u.e[0] * v.e[2],
                 u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
 // Returns the unit vector in the same direction as v
-inline vec3 unit_vector(const vec3& v) {
+template <typename T>
+inline vec3_t<T> unit_vector(const vec3_t<T>& v) {
     return v / v.length();
 }
 
+// Sine and cosine of `turns` full turns (2 pi turns radians), without branches and without
+// a call into libm, so loops over many angles vectorize. The angle is reduced to within an
+// eighth of a turn of a quadrant, where Taylor series up to x^12 are accurate to 1e-11,
+// and the quadrant is applied by swapping and negating. Meant for sampling, where that
+// accuracy is plenty.
+inline void sincos_turns(real turns, real& sine, real& cosine) {
+    real quadrant = std::nearbyint(4 * turns);
+    real x = real(2 * pi) * (turns - real(0.25) * quadrant); // In [-pi/4, pi/4]
+    real x2 = x * x;
+    real s = x * (1 + x2 * (real(-1.0 / 6) + x2 * (real(1.0 / 120) + x2 * (real(-1.0 / 5040) + x2 * (real(1.0 / 362880) + x2 * real(-1.0 / 39916800))))));
+    real c = 1 + x2 * (real(-0.5) + x2 * (real(1.0 / 24) + x2 * (real(-1.0 / 720) + x2 * (real(1.0 / 40320) + x2 * (real(-1.0 / 3628800) + x2 * real(1.0 / 479001600))))));
+
+    // Quadrant q rotates (c, s) by q quarter turns
+    int q = static_cast<int>(quadrant) & 3;
+    real rotated_s = (q & 1) ? c : s;
+    real rotated_c = (q & 1) ? s : c;
+    sine = (q & 2) ? -rotated_s : rotated_s;
+    cosine = ((q + 1) & 2) ? -rotated_c : rotated_c;
+}
+
+// Maps a point (u, v) of the unit square onto the unit disk (Shirley and Chiu's concentric
+// mapping). Neighbouring points stay neighbours and areas are preserved, so stratified or
+// low-discrepancy points stay well spread on the disk. Branch free: both cases are
+// computed and one is selected.
+inline vec3 disk_from_square(real u, real v) {
+    real a = 2 * u - 1, b = 2 * v - 1;
+    bool horizontal = std::fabs(a) > std::fabs(b);
+    real radius = horizontal ? a : b;
+    real numerator = horizontal ? b : a;
+    real denominator = radius != 0 ? radius : real(1); // The center maps to itself
+    real ratio = numerator / denominator; // Angle in eighths of a turn
+    real turns = horizontal ? real(0.125) * ratio : real(0.25) - real(0.125) * ratio;
+    real sine, cosine;
+    sincos_turns(turns, sine, cosine);
+    return vec3(radius * cosine, radius * sine, 0);
+}
+
+// Maps a point (u, v) of the unit square onto the unit sphere, uniformly by area: z is
+// uniform in [-1, 1] and the angle around the z-axis uniform in [0, 2 pi).
+inline vec3 sphere_from_square(real u, real v) {
+    real z = 1 - 2 * u;
+    real r = std::sqrt(std::fmax(real(0), 1 - z * z));
+    real sine, cosine;
+    sincos_turns(v, sine, cosine);
+    return vec3(r * cosine, r * sine, z);
+}
+
 // Generates a random point inside a unit disk (for certain types of ray origins)
-inline vec3 random_in_unit_disk() {
-    while (true) {
-        auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0); // Generate a 2D point
-        if (p.length_squared() < 1) // Check if point is within unit disk
-            return p;
-    }
+inline vec3 random_in_unit_disk(rng& gen) {
+    real u = real(gen.next_double());
+    real v = real(gen.next_double());
+    return disk_from_square(u, v);
 }
 
-// Generates a random unit vector (useful for sampling directions on a sphere)
-inline vec3 random_unit_vector() {
-    while (true) {
-        auto p = vec3::random(-1, 1);
-        auto lensq = p.length_squared();
-        if (1e-160 < lensq && lensq <= 1.0) // Ensure non-zero length and unit length
-            return p / sqrt(lensq);
-    }
+// Generates a random unit vector (useful for sampling directions on a sphere). Two random
+// numbers per vector, instead of the three-or-more of rejection sampling.
+inline vec3 random_unit_vector(rng& gen) {
+    real u = real(gen.next_double());
+    real v = real(gen.next_double());
+    return sphere_from_square(u, v);
 }
 
 // Returns a random vector in the same hemisphere as the given normal vector
-inline vec3 random_on_hemisphere(const vec3& normal) {
-    vec3 on_unit_sphere = random_unit_vector(); // Random direction on unit sphere
-    if (dot(on_unit_sphere, normal) > 0.0) // Check if in the same hemisphere
+inline vec3 random_on_hemisphere(const vec3& normal, rng& gen) {
+    vec3 on_unit_sphere = random_unit_vector(gen); // Random direction on unit sphere
+    if (dot(on_unit_sphere, normal) > 0) // Check if in the same hemisphere
         return on_unit_sphere;
     else
         return -on_unit_sphere;
 }
 
 // Reflects vector v about normal n, used for simulating mirror-like reflections
-inline vec3 reflect(const vec3& v, const vec3& n) {
+template <typename T>
+inline vec3_t<T> reflect(const vec3_t<T>& v, const vec3_t<T>& n) {
     return v - 2 * dot(v, n) * n;
 }
 
 // Refracts vector uv through a surface with normal n given an index of refraction ratio (Snell's law)
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
-    auto cos_theta = std::fmin(dot(-uv, n), 1.0); // Angle between vector and normal
-    vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n); // Perpendicular component
-    vec3 r_out_parallel = -std::sqrt(std::fabs(1.0 - r_out_perp.length_squared())) * n; // Parallel component
+template <typename T>
+inline vec3_t<T> refract(const vec3_t<T>& uv, const vec3_t<T>& n, scalar_of<T> etai_over_etat) {
+    auto cos_theta = std::fmin(dot(-uv, n), T(1)); // Angle between vector and normal
+    vec3_t<T> r_out_perp = etai_over_etat * (uv + cos_theta * n); // Perpendicular component
+    vec3_t<T> r_out_parallel = -std::sqrt(std::fabs(1 - r_out_perp.length_squared())) * n; // Parallel component
     return r_out_perp + r_out_parallel; // Total refracted vector
 }
 
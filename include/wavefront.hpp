@@ -0,0 +1,56 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "hittable.hpp"
+#include "material.hpp"
+
+#include <array>
+#include <vector>
+
+// Data for wavefront path tracing (see camera::render_tile_wavefront). Instead of following
+// one path to the end before starting the next, a wavefront renderer advances a whole batch
+// of paths by one bounce at a time: intersect every ray, bin the hits by material kind,
+// scatter each bin in one tight loop, then compact the surviving paths for the next bounce.
+
+// One camera sample in flight.
+struct path_state {
+    ray r = {}; // Ray of the current path segment
+    color throughput = color(1, 1, 1); // Fraction of light that survives the bounces so far
+    real bsdf_pdf = 0; // Density the last bounce chose `r` with, if it also sampled the lights (see camera::emission)
+    rng gen = rng(); // The sample's own generator, the same one the depth-first renderer uses
+    int slot = 0; // Index of the sample's entry in wavefront_buffers::contributions
+};
+
+// Per-thread working memory of the wavefront renderer, reused from batch to batch so the
+// bounce loop never allocates once the buffers have grown to the batch size.
+struct wavefront_buffers {
+    std::vector<path_state> paths = {}; // Paths still alive at the current bounce
+    std::vector<path_state> next_paths = {}; // Survivors of the current bounce
+    std::vector<hit_record> records = {}; // Hit of every path in `paths` (mat is null for a miss)
+    std::vector<int> queue = {}; // Indices into `paths` of the hits, grouped by material kind
+    std::array<int, material_kind_count + 1> queue_start = {}; // Kind k occupies queue[queue_start[k], queue_start[k + 1])
+    std::vector<color> contributions = {}; // Light gathered so far by every sample of the batch
+
+    // Groups the hits of the current bounce by material kind with a counting sort, keeping
+    // path order within every kind. Misses are left out.
+    void bin_by_material() {
+        std::array<int, material_kind_count> counts = {};
+        for (size_t i = 0; i < paths.size(); ++i)
+            if (records[i].mat)
+                counts[static_cast<int>(records[i].mat->kind)]++;
+
+        queue_start[0] = 0;
+        for (int k = 0; k < material_kind_count; ++k)
+            queue_start[k + 1] = queue_start[k] + counts[k];
+
+        queue.resize(queue_start[material_kind_count]);
+        std::array<int, material_kind_count> next = {};
+        for (int k = 0; k < material_kind_count; ++k)
+            next[k] = queue_start[k];
+        for (size_t i = 0; i < paths.size(); ++i)
+            if (records[i].mat)
+                queue[next[static_cast<int>(records[i].mat->kind)]++] = static_cast<int>(i);
+    }
+};
+
+#endif
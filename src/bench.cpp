@@ -0,0 +1,405 @@
+#include "rtweekend.hpp"
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "hittable.hpp"
+#include "hittable_list.hpp"
+#include "image_writer.hpp"
+#include "material.hpp"
+#include "pixel_order.hpp"
+#include "sampler.hpp"
+#include "scenes.hpp"
+#include "sphere.hpp"
+#include "sphere_batch.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Benchmark suite: times the renderer's hot functions and a full render of the random
+// spheres scene over several iterations, and prints the results as JSON or CSV so runs
+// with different compiler flags or commits can be compared. Everything is seeded, so
+// every run does exactly the same work.
+
+#ifndef RT_BENCH_FLAGS
+#define RT_BENCH_FLAGS "unknown"
+#endif
+#ifndef RT_BENCH_COMMIT
+#define RT_BENCH_COMMIT "unknown"
+#endif
+
+// Timings of one benchmark: `work` units (rays, calls, bytes...) per iteration.
+struct bench_result {
+    std::string name = {}; // Benchmark name
+    std::string unit = {}; // What one unit of work is
+    double work = 0; // Units of work per iteration
+    std::vector<double> times_ms = {}; // Wall-clock time of every iteration
+
+    double min_ms() const { return *std::min_element(times_ms.begin(), times_ms.end()); }
+    double max_ms() const { return *std::max_element(times_ms.begin(), times_ms.end()); }
+
+    double mean_ms() const {
+        double sum = 0;
+        for (double t : times_ms)
+            sum += t;
+        return sum / times_ms.size();
+    }
+
+    double median_ms() const {
+        std::vector<double> sorted = times_ms;
+        std::sort(sorted.begin(), sorted.end());
+        size_t middle = sorted.size() / 2;
+        return (sorted.size() % 2) ? sorted[middle] : 0.5 * (sorted[middle - 1] + sorted[middle]);
+    }
+
+    double stddev_ms() const {
+        if (times_ms.size() < 2)
+            return 0;
+        double mean = mean_ms(), sum = 0;
+        for (double t : times_ms)
+            sum += (t - mean) * (t - mean);
+        return std::sqrt(sum / (times_ms.size() - 1));
+    }
+
+    // Throughput of the median iteration, in units per second
+    double per_second() const { return work / (median_ms() / 1000); }
+
+    // Cost of one unit at the median, in nanoseconds
+    double ns_per_unit() const { return median_ms() * 1e6 / work; }
+};
+
+// Runs `body` once to warm up, then `iterations` more times, timing each run.
+inline bench_result measure(const std::string& name, const std::string& unit, double work, int iterations, const std::function<void()>& body) {
+    bench_result result;
+    result.name = name;
+    result.unit = unit;
+    result.work = work;
+
+    body();
+    for (int i = 0; i < iterations; ++i) {
+        auto start = std::chrono::high_resolution_clock::now();
+        body();
+        auto end = std::chrono::high_resolution_clock::now();
+        result.times_ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::clog << "  " << name << ": " << std::fixed << std::setprecision(3) << result.median_ms() << " ms median\n";
+    return result;
+}
+
+// Rays from around the camera of random_spheres_camera() towards random points of the
+// sphere field, so they meet roughly the mix of hits and misses a render sees.
+inline std::vector<ray> make_bench_rays(int count) {
+    rng gen(1234);
+    std::vector<ray> rays;
+    rays.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        point3 origin = point3(13, 2, 3) + vec3::random(gen, -0.1, 0.1);
+        point3 target(real(gen.next_double(-11, 11)), real(gen.next_double(0, 1)), real(gen.next_double(-11, 11)));
+        rays.emplace_back(origin, unit_vector(target - origin));
+    }
+    return rays;
+}
+
+// Escapes `text` for a JSON string (names and flags never need more than this).
+inline std::string json_escape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+inline void write_json(std::ostream& out, const std::vector<bench_result>& results, int iterations) {
+    out << std::setprecision(6) << std::defaultfloat;
+    out << "{\n";
+    out << "  \"commit\": \"" << json_escape(RT_BENCH_COMMIT) << "\",\n";
+    out << "  \"compiler\": \"" << json_escape(__VERSION__) << "\",\n";
+    out << "  \"flags\": \"" << json_escape(RT_BENCH_FLAGS) << "\",\n";
+    out << "  \"real\": \"" << (sizeof(real) == sizeof(float) ? "float" : "double") << "\",\n";
+    out << "  \"simd\": \"" << simd_isa_name(simd_active_isa) << "\",\n";
+    out << "  \"simd_lanes\": " << sphere_batch::lane_count() << ",\n";
+    out << "  \"threads\": " << std::max(1u, std::thread::hardware_concurrency()) << ",\n";
+    out << "  \"iterations\": " << iterations << ",\n";
+    out << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const bench_result& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"unit\": \"" << r.unit << "\", \"work\": " << r.work
+            << ", \"min_ms\": " << r.min_ms() << ", \"median_ms\": " << r.median_ms() << ", \"mean_ms\": " << r.mean_ms()
+            << ", \"max_ms\": " << r.max_ms() << ", \"stddev_ms\": " << r.stddev_ms()
+            << ", \"per_second\": " << r.per_second() << ", \"ns_per_unit\": " << r.ns_per_unit() << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+inline void write_csv(std::ostream& out, const std::vector<bench_result>& results) {
+    out << std::setprecision(6) << std::defaultfloat;
+    out << "commit,real,name,unit,work,min_ms,median_ms,mean_ms,max_ms,stddev_ms,per_second,ns_per_unit\n";
+    for (const bench_result& r : results) {
+        out << RT_BENCH_COMMIT << ',' << (sizeof(real) == sizeof(float) ? "float" : "double") << ',' << r.name << ',' << r.unit << ','
+            << r.work << ',' << r.min_ms() << ',' << r.median_ms() << ',' << r.mean_ms() << ',' << r.max_ms() << ','
+            << r.stddev_ms() << ',' << r.per_second() << ',' << r.ns_per_unit() << '\n';
+    }
+}
+
+int main(int argc, char* argv[]) {
+
+    /* COMMAND LINE */
+
+    int iterations = 5;
+    std::string json_path = ""; // JSON report file; with neither file given, JSON goes to stdout
+    std::string csv_path = ""; // CSV report file
+    std::string filter = "";
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--simd") == 0 && i + 1 < argc) {
+            simd_isa isa;
+            if (!parse_simd_isa(argv[++i], isa) || !select_simd_isa(isa)) {
+                std::cerr << "Error: This CPU or build has no " << argv[i] << " kernels.\n";
+                return 1;
+            }
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--iterations <n>] [--json <file>] [--csv <file>] [--filter <name substring>]\n"
+                      << "       [--simd avx512|avx2|sse4|scalar (kernels to measure; the widest the CPU has by default)]\n";
+            return 1;
+        }
+    }
+    auto selected = [&](const std::string& name) { return filter.empty() || name.find(filter) != std::string::npos; };
+
+    /* FIXTURES */
+
+    hittable_list objects = random_spheres_scene();
+    bvh_node tree(objects);
+    sphere_batch batch;
+    for (const auto& object : objects.objects)
+        if (auto s = dynamic_cast<const sphere*>(object.get()))
+            batch.add(*s);
+
+    const int ray_count = 20000;
+    std::vector<ray> rays = make_bench_rays(ray_count);
+    std::vector<bench_result> results;
+    long long hits = 0; // Consumed at the end so the optimizer cannot drop the loops
+
+    std::clog << "Running benchmarks (" << iterations << " iterations each)\n";
+
+    /* INTERSECTION */
+
+    // The same rays against the same spheres, tested one object at a time, as one SIMD batch
+    // and through the BVH
+    auto intersect = [&](const hittable& target) {
+        hit_record rec;
+        for (const ray& r : rays)
+            hits += target.hit(r, interval(0.001, infinity), rec);
+    };
+    if (selected("intersect_list"))
+        results.push_back(measure("intersect_list", "rays", ray_count, iterations, [&] { intersect(objects); }));
+    if (selected("intersect_sphere_batch"))
+        results.push_back(measure("intersect_sphere_batch", "rays", ray_count, iterations, [&] { intersect(batch); }));
+    if (selected("intersect_bvh"))
+        results.push_back(measure("intersect_bvh", "rays", ray_count, iterations, [&] { intersect(tree); }));
+    if (selected("build_bvh"))
+        results.push_back(measure("build_bvh", "objects", double(objects.objects.size()), iterations, [&] {
+            bvh_node rebuilt(objects);
+            hits += rebuilt.bounding_box().x.size() > 0;
+        }));
+    if (selected("build_scene_tree")) {
+        scene_description description = random_spheres_description();
+        results.push_back(measure("build_scene_tree", "spheres", double(description.spheres.size()), iterations, [&] {
+            hits += build_scene_tree(description)->bounding_box().x.size() > 0;
+        }));
+    }
+
+    /* SCATTER */
+
+    // One material of each kind scattering a fixed incoming ray many times
+    const int scatter_count = 1000000;
+    hit_record surface;
+    surface.p = point3(0, 0, 0);
+    surface.t = 1;
+    ray incoming(point3(0, 1, 1), unit_vector(vec3(0, -1, -1)));
+    surface.set_face_normal(incoming, vec3(0, 1, 0));
+    auto scatter = [&](const material& mat) {
+        rng gen(42);
+        color attenuation;
+        ray scattered;
+        for (int i = 0; i < scatter_count; ++i)
+            hits += mat.scatter(incoming, surface, attenuation, scattered, gen);
+    };
+    lambertian diffuse(color(0.5, 0.5, 0.5));
+    metal shiny(color(0.7, 0.6, 0.5), 0.3);
+    dielectric glass(1.5);
+    if (selected("scatter_lambertian"))
+        results.push_back(measure("scatter_lambertian", "calls", scatter_count, iterations, [&] { scatter(diffuse); }));
+    if (selected("scatter_metal"))
+        results.push_back(measure("scatter_metal", "calls", scatter_count, iterations, [&] { scatter(shiny); }));
+    if (selected("scatter_dielectric"))
+        results.push_back(measure("scatter_dielectric", "calls", scatter_count, iterations, [&] { scatter(glass); }));
+
+    /* SAMPLING */
+
+    // Random directions one call at a time and in batches, and the low-discrepancy patterns
+    const int direction_count = 1000000, batch_size = 4096;
+    std::vector<real> xs(batch_size), ys(batch_size), zs(batch_size);
+    if (selected("sample_unit_vector"))
+        results.push_back(measure("sample_unit_vector", "vectors", direction_count, iterations, [&] {
+            rng gen(42);
+            real sum = 0;
+            for (int i = 0; i < direction_count; ++i)
+                sum += random_unit_vector(gen).x();
+            hits += sum > 0;
+        }));
+    if (selected("fill_unit_vectors"))
+        results.push_back(measure("fill_unit_vectors", "vectors", direction_count, iterations, [&] {
+            rng gen(42);
+            for (int done = 0; done < direction_count; done += batch_size) {
+                fill_random_unit_vectors(gen, batch_size, xs.data(), ys.data(), zs.data());
+                hits += xs[0] > 0;
+            }
+        }));
+    for (auto [name, pattern] : {std::make_pair("pattern_halton", sample_pattern::halton), std::make_pair("pattern_sobol", sample_pattern::sobol)}) {
+        if (!selected(name))
+            continue;
+        results.push_back(measure(name, "points", direction_count, iterations, [&, pattern = pattern] {
+            double u, v, sum = 0;
+            for (int i = 0; i < direction_count; ++i) {
+                pattern_sample(pattern, std::uint64_t(i >> 6), std::uint32_t(i & 63), 0, u, v);
+                sum += u + v;
+            }
+            hits += sum > 0;
+        }));
+    }
+
+    /* IMAGE OUTPUT */
+
+    // Encoding a default-size image in both formats
+    const int image_width = 720, image_height = 405;
+    std::vector<unsigned char> rgb(static_cast<size_t>(image_width) * image_height * 3);
+    rng pixel_gen(7);
+    for (auto& byte : rgb)
+        byte = static_cast<unsigned char>(pixel_gen.next_uint());
+    double pixel_count = double(image_width) * image_height;
+    if (selected("write_ppm"))
+        results.push_back(measure("write_ppm", "pixels", pixel_count, iterations, [&] { ppm_writer().write("output/bench.ppm", image_width, image_height, rgb); }));
+    if (selected("write_png"))
+        results.push_back(measure("write_png", "pixels", pixel_count, iterations, [&] { png_writer().write("output/bench.png", image_width, image_height, rgb); }));
+    std::remove("output/bench.ppm");
+    std::remove("output/bench.png");
+
+    /* END TO END */
+
+    // A smaller render of the full scene, through the BVH and the thread pool, following
+    // one path at a time and as a wavefront
+    if (selected("render_depth_first") || selected("render_wavefront")) {
+        hittable_list scene(make_shared<bvh_node>(objects));
+        camera scene_camera;
+        random_spheres_camera(scene_camera);
+        scene_camera.image_width = 360;
+        scene_camera.samples_per_pixel = 4;
+        scene_camera.output_path = "output/bench_render.ppm";
+        scene_camera.verbose = false;
+        int rows = std::max(1, static_cast<int>(scene_camera.image_width / scene_camera.aspect_ratio)); // As camera::initialize
+        double samples = double(scene_camera.image_width) * rows * scene_camera.samples_per_pixel;
+        if (selected("render_depth_first"))
+            results.push_back(measure("render_depth_first", "camera_samples", samples, iterations, [&] { scene_camera.render(scene); }));
+        scene_camera.wavefront = true;
+        if (selected("render_wavefront"))
+            results.push_back(measure("render_wavefront", "camera_samples", samples, iterations, [&] { scene_camera.render(scene); }));
+        std::remove("output/bench_render.ppm");
+    }
+
+    // The same renders with the pixels and tiles traced row by row and along the Morton and
+    // Hilbert curves, for the default scene and for a field of 200k small spheres whose BVH
+    // is far larger than the caches
+    const std::pair<const char*, pixel_order> orders[] = {{"row", pixel_order::row_major}, {"morton", pixel_order::morton}, {"hilbert", pixel_order::hilbert}};
+    for (const char* scene_name : {"default", "field"}) {
+        auto order_name = [&](const char* order) { return std::string("render_order_") + scene_name + "_" + order; };
+        if (std::none_of(std::begin(orders), std::end(orders), [&](const auto& order) { return selected(order_name(order.first)); }))
+            continue;
+
+        shared_ptr<hittable> scene_tree = make_shared<bvh_node>(objects);
+        if (std::strcmp(scene_name, "field") == 0) {
+            scene_description field;
+            std::uint32_t field_materials[3] = {field.add_material(material_kind::lambertian, 0.2, 0.2, 0.2), field.add_material(material_kind::lambertian, 0.6, 0.3, 0.2),
+                                                field.add_material(material_kind::metal, 0.7, 0.6, 0.5, 0.2)};
+            field.add_sphere(point3(0, -1000, 0), 1000, field_materials[0]);
+            rng field_gen(99);
+            for (int i = 0; i < 200000; ++i) {
+                double radius = field_gen.next_double(0.05, 0.1);
+                point3 center(real(field_gen.next_double(-60, 60)), real(radius), real(field_gen.next_double(-60, 10)));
+                field.add_sphere(center, radius, field_materials[1 + field_gen.next_uint() % 2]);
+            }
+            scene_tree = build_scene_tree(field);
+        }
+        hittable_list scene(scene_tree);
+
+        camera scene_camera;
+        random_spheres_camera(scene_camera);
+        scene_camera.image_width = 360;
+        scene_camera.samples_per_pixel = 2;
+        scene_camera.output_path = "output/bench_render.ppm";
+        scene_camera.verbose = false;
+        int rows = std::max(1, static_cast<int>(scene_camera.image_width / scene_camera.aspect_ratio)); // As camera::initialize
+        double samples = double(scene_camera.image_width) * rows * scene_camera.samples_per_pixel;
+        for (const auto& [name, order] : orders) {
+            if (!selected(order_name(name)))
+                continue;
+            scene_camera.traversal = order;
+            results.push_back(measure(order_name(name), "camera_samples", samples, iterations, [&] { scene_camera.render(scene); }));
+        }
+        std::remove("output/bench_render.ppm");
+    }
+
+    // The default view of the random spheres, static and with the diffuse spheres moving
+    // (see moving_spheres_description()), to see what motion blur costs
+    if (selected("render_motion_static") || selected("render_motion_blur")) {
+        camera scene_camera;
+        random_spheres_camera(scene_camera);
+        scene_camera.image_width = 360;
+        scene_camera.samples_per_pixel = 4;
+        scene_camera.output_path = "output/bench_render.ppm";
+        scene_camera.verbose = false;
+        int rows = std::max(1, static_cast<int>(scene_camera.image_width / scene_camera.aspect_ratio)); // As camera::initialize
+        double samples = double(scene_camera.image_width) * rows * scene_camera.samples_per_pixel;
+        for (auto [name, description] : {std::make_pair("render_motion_static", random_spheres_description()), std::make_pair("render_motion_blur", moving_spheres_description())}) {
+            if (!selected(name))
+                continue;
+            hittable_list scene(build_scene_tree(description));
+            results.push_back(measure(name, "camera_samples", samples, iterations, [&] { scene_camera.render(scene); }));
+        }
+        std::remove("output/bench_render.ppm");
+    }
+
+    /* REPORT */
+
+    if (json_path.empty() && csv_path.empty()) {
+        write_json(std::cout, results, iterations);
+        return hits < 0;
+    }
+
+    auto save = [&](const std::string& path, const std::function<void(std::ostream&)>& write) {
+        std::ofstream out(path);
+        write(out);
+        if (!out) {
+            std::cerr << "Error: Could not write " << path << ".\n";
+            return false;
+        }
+        std::clog << "Results written to " << path << "\n";
+        return true;
+    };
+    if (!json_path.empty() && !save(json_path, [&](std::ostream& out) { write_json(out, results, iterations); }))
+        return 1;
+    if (!csv_path.empty() && !save(csv_path, [&](std::ostream& out) { write_csv(out, results); }))
+        return 1;
+
+    return hits < 0; // Never true; keeps `hits` alive
+}
@@ -0,0 +1,665 @@
+#include "rtweekend.hpp"
+#include "bvh.hpp"
+#include "hittable.hpp"
+#include "hittable_list.hpp"
+#include "material.hpp"
+#include "scene_file.hpp"
+#include "scenes.hpp"
+#include "simd.hpp"
+#include "sphere.hpp"
+#include "sphere_batch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Correctness and speed harness for the intersection and scatter kernels. Every fast path
+// is run in isolation over a large seeded set of inputs and compared with the plain code
+// it replaces:
+//
+// - intersection: sphere_batch and bvh_node with every SIMD backend this CPU runs, against
+//   sphere::hit on every sphere in turn (what hittable_list::hit does, timed as "list"), for
+//   closest hits (t, normal, face, material) and for shadow-ray occlusion, on the random
+//   spheres scene and on its moving variant, and on two moving spheres at both ends of the
+//   shutter interval
+// - scatter: the three built-in materials called directly, as the renderers call them
+//   through visit_material(), against the virtual material::scatter, plus the properties
+//   every scattered ray must have
+// - renderers: the wavefront renderer against the depth-first one on a small frame of the
+//   default scene, plain, with roulette and lit by a lamp, and adaptive sampling under a
+//   sample budget smaller than the frame against a plain render of its first pass
+//
+// It prints ns/ray and rays per second for every variant and exits with status 1 if any
+// result is off. Disagreements rounding decides (a ray grazing a sphere, or two surfaces at
+// the same distance) are counted apart as borderline and do not fail the run.
+
+// The comparisons allow what rounding alone can change. Every kernel solves the quadratic of
+// sphere::intersect, but in its own order of operations (the AVX2 and AVX-512 kernels fuse
+// multiply-adds the scalar code rounds twice), so their roots may differ by the rounding
+// error of the discriminant h^2 - (|oc|^2 - r^2) carried through its square root. That error
+// grows with |oc|^2, which matters for the large ground sphere in float, and with 1 / cos of
+// the angle between ray and normal, which matters for nearly tangent hits.
+const real epsilon = std::numeric_limits<real>::epsilon();
+const real safety = 8; // Rounding steps allowed for, with room to spare
+
+// Outcome of one variant.
+struct check_result {
+    std::string name = {};
+    size_t cases = 0; // Rays or scatter calls compared
+    size_t failures = 0; // Results outside the tolerances
+    size_t borderline = 0; // Disagreements rounding can explain (tangent or touching hits), not failures
+    real max_t_error = 0; // Largest t difference among agreeing hits, in units of its tolerance
+    real max_normal_error = 0; // Largest normal (or direction) difference among agreeing results
+    double ns_per_case = 0; // Time of one ray or call, best of the timed runs
+    double tests_per_case = 0; // Sphere tests per ray when every ray tests every sphere (0: not known)
+};
+
+// Best time per call of `body` over a few runs of `count` calls each, in nanoseconds.
+inline double time_per_case(size_t count, const std::function<void()>& body) {
+    body(); // Warm up
+    double best = std::numeric_limits<double>::max();
+    for (int run = 0; run < 3; ++run) {
+        auto start = std::chrono::high_resolution_clock::now();
+        body();
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+        best = std::min(best, elapsed.count() / double(count));
+    }
+    return best;
+}
+
+// Half the rays start around the camera of random_spheres_camera() and aim into the sphere
+// field, like camera rays; the others start anywhere above the ground, some inside spheres,
+// and go in any direction, like bounces. Every ray gets a random time for moving spheres.
+inline std::vector<ray> make_check_rays(size_t count, std::uint64_t seed) {
+    rng gen(seed);
+    std::vector<ray> rays;
+    rays.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        real time = real(gen.next_double());
+        if (i % 2 == 0) {
+            point3 origin = point3(13, 2, 3) + vec3::random(gen, -0.1, 0.1);
+            point3 target(real(gen.next_double(-11, 11)), real(gen.next_double(0, 1)), real(gen.next_double(-11, 11)));
+            rays.emplace_back(origin, unit_vector(target - origin), time);
+        } else {
+            point3 origin(real(gen.next_double(-12, 12)), real(gen.next_double(0.05, 3)), real(gen.next_double(-12, 12)));
+            rays.emplace_back(origin, random_unit_vector(gen), time);
+        }
+    }
+    return rays;
+}
+
+// The quadratic of `r` against `s`, solved in long double: the roots are h -/+ sqrt(discriminant).
+struct sphere_roots {
+    long double h = 0;
+    long double discriminant = 0;
+    long double discriminant_error = 0; // Rounding error a `real` kernel may make in the discriminant
+    real extent = 0; // |oc| + radius, the size of the numbers the kernel works with
+
+    sphere_roots(const ray& r, const sphere& s) {
+        vec3 oc = s.center_at(r.time()) - r.origin();
+        long double ox = oc.x(), oy = oc.y(), oz = oc.z();
+        long double oc_squared = ox * ox + oy * oy + oz * oz;
+        long double radius_squared = (long double)s.sphere_radius() * s.sphere_radius();
+        h = r.direction().x() * ox + r.direction().y() * oy + r.direction().z() * oz;
+        discriminant = h * h - (oc_squared - radius_squared);
+        discriminant_error = safety * epsilon * (h * h + oc_squared + radius_squared);
+        extent = real(std::sqrt(oc_squared)) + s.sphere_radius();
+    }
+
+    // True if rounding could turn a hit into a miss or the other way round.
+    bool tangent() const { return std::fabs(discriminant) <= discriminant_error; }
+
+    // Largest difference rounding can make in a root.
+    real root_error() const {
+        long double sqrtd = std::sqrt(std::fmax(discriminant, 0.0L));
+        long double error = discriminant_error / (2 * std::fmax(sqrtd, std::sqrt(discriminant_error))) + safety * epsilon * (extent + std::fabs(h));
+        return real(std::fmin(error, (long double)std::numeric_limits<real>::max()));
+    }
+
+    // True if the ray grazes the sphere within rounding somewhere in `ray_t`.
+    bool tangent_within(interval ray_t) const {
+        real error = root_error();
+        return tangent() && h >= ray_t.min - error && h <= ray_t.max + error;
+    }
+
+    // True if a root lies within rounding of `t`.
+    bool root_near(real t) const {
+        if (discriminant < 0)
+            return false;
+        long double sqrtd = std::sqrt(discriminant);
+        real error = root_error();
+        return std::fabs(h - sqrtd - t) <= error || std::fabs(h + sqrtd - t) <= error;
+    }
+};
+
+// Closest hit of every ray, or a miss
+struct hit_answer {
+    bool hit = false;
+    hit_record rec = {};
+    const sphere* object = nullptr; // The sphere hit (reference answers only)
+};
+
+// The reference: sphere::hit on every sphere in turn, keeping the closest hit, exactly as
+// hittable_list::hit does, but remembering which sphere it was.
+inline std::vector<hit_answer> reference_hits(const std::vector<const sphere*>& spheres, const std::vector<ray>& rays) {
+    std::vector<hit_answer> answers(rays.size());
+    for (size_t i = 0; i < rays.size(); ++i) {
+        real closest = infinity;
+        hit_record rec;
+        for (const sphere* s : spheres) {
+            if (s->hit(rays[i], interval(0.001, closest), rec)) {
+                answers[i] = {true, rec, s};
+                closest = rec.t;
+            }
+        }
+    }
+    return answers;
+}
+
+// The sphere `rec` lies on: the one with its material that has a root closest to its t.
+inline const sphere* hit_sphere(const std::vector<const sphere*>& spheres, const ray& r, const hit_record& rec) {
+    const sphere* closest = nullptr;
+    long double closest_distance = infinity;
+    for (const sphere* s : spheres) {
+        sphere_roots roots(r, *s);
+        if (s->surface_material() != rec.mat || roots.discriminant < -roots.discriminant_error)
+            continue;
+        long double sqrtd = std::sqrt(std::fmax(roots.discriminant, 0.0L));
+        long double distance = std::fmin(std::fabs(roots.h - sqrtd - rec.t), std::fabs(roots.h + sqrtd - rec.t));
+        if (distance < closest_distance) {
+            closest = s;
+            closest_distance = distance;
+        }
+    }
+    return closest;
+}
+
+// True if rounding could decide whether `r` hits some sphere within `ray_t`: the ray grazes
+// a sphere there, or meets one at the start of the interval, or, with `check_end`, at its end.
+inline bool any_borderline(const std::vector<const sphere*>& spheres, const ray& r, interval ray_t, bool check_end) {
+    for (const sphere* s : spheres) {
+        sphere_roots roots(r, *s);
+        if (roots.tangent_within(ray_t) || roots.root_near(ray_t.min) || (check_end && roots.root_near(ray_t.max)))
+            return true;
+    }
+    return false;
+}
+
+// Compares the closest hits of `target` with the reference answers and times them.
+inline check_result check_closest(const std::string& name, const hittable& target, const std::vector<const sphere*>& spheres, const std::vector<ray>& rays, const std::vector<hit_answer>& reference, double tests_per_ray) {
+    check_result result;
+    result.name = name;
+    result.cases = rays.size();
+    result.tests_per_case = tests_per_ray;
+    for (size_t i = 0; i < rays.size(); ++i) {
+        const ray& r = rays[i];
+        hit_record got;
+        bool hit = target.hit(r, interval(0.001, infinity), got);
+        const hit_answer& want = reference[i];
+        if (!hit && !want.hit)
+            continue;
+
+        if (hit && want.hit) {
+            sphere_roots roots(r, *want.object);
+            real t_tolerance = roots.root_error();
+            // The normal is (p - center) / radius, rounded in world coordinates
+            real normal_tolerance = (t_tolerance + safety * epsilon * (want.rec.p.length() + roots.extent)) / want.object->sphere_radius();
+            real t_error = std::fabs(got.t - want.rec.t);
+            real normal_error = (got.normal - want.rec.normal).length();
+            if (t_error <= t_tolerance && normal_error <= normal_tolerance && got.front_face == want.rec.front_face && got.mat == want.rec.mat) {
+                result.max_t_error = std::max(result.max_t_error, t_error / t_tolerance);
+                result.max_normal_error = std::max(result.max_normal_error, normal_error);
+                continue;
+            }
+            // On the same sphere only a tangent hit, where the two roots meet, may go either way
+            const sphere* got_object = hit_sphere(spheres, r, got);
+            if (got_object == want.object) {
+                (roots.tangent() ? result.borderline : result.failures)++;
+                continue;
+            }
+            // Two surfaces within rounding of each other (a sphere resting on another): either may win
+            if (got_object && t_error <= t_tolerance + sphere_roots(r, *got_object).root_error()) {
+                result.borderline++;
+                continue;
+            }
+        }
+
+        // A tangent sphere seen by one side only, which then found the next surface or nothing
+        real farthest = std::max(hit ? got.t : real(0), want.hit ? want.rec.t : real(0));
+        (any_borderline(spheres, r, interval(0.001, farthest), false) ? result.borderline : result.failures)++;
+    }
+
+    hit_record rec;
+    long long hits = 0;
+    result.ns_per_case = time_per_case(rays.size(), [&] {
+        for (const ray& r : rays)
+            hits += target.hit(r, interval(0.001, infinity), rec);
+    });
+    result.failures += hits < 0; // Keeps the timed loop
+    return result;
+}
+
+// Compares occluded() of `target` over shadow rays of random lengths with the reference
+// closest hits: a ray is blocked if its closest hit lies within its length.
+inline check_result check_occluded(const std::string& name, const hittable& target, const std::vector<const sphere*>& spheres, const std::vector<ray>& rays, const std::vector<hit_answer>& reference, const std::vector<real>& lengths) {
+    check_result result;
+    result.name = name;
+    result.cases = rays.size();
+    for (size_t i = 0; i < rays.size(); ++i) {
+        const hit_answer& want = reference[i];
+        bool blocked = want.hit && want.rec.t < lengths[i];
+        if (target.occluded(rays[i], interval(0.001, lengths[i])) != blocked)
+            (any_borderline(spheres, rays[i], interval(0.001, lengths[i]), true) ? result.borderline : result.failures)++;
+    }
+
+    long long blocked = 0;
+    result.ns_per_case = time_per_case(rays.size(), [&] {
+        for (size_t i = 0; i < rays.size(); ++i)
+            blocked += target.occluded(rays[i], interval(0.001, lengths[i]));
+    });
+    result.failures += blocked < 0;
+    return result;
+}
+
+// Random surface points: a hit record with a random normal, hit from either side by a
+// random unit direction, and the incoming ray that made it.
+struct scatter_case {
+    ray incoming = {};
+    hit_record rec = {};
+};
+
+inline std::vector<scatter_case> make_scatter_cases(size_t count, std::uint64_t seed) {
+    rng gen(seed);
+    std::vector<scatter_case> cases(count);
+    for (auto& c : cases) {
+        vec3 outward_normal = random_unit_vector(gen);
+        vec3 direction = random_unit_vector(gen);
+        if (std::fabs(dot(direction, outward_normal)) < real(1e-3))
+            direction = unit_vector(direction - outward_normal); // No rays exactly along the surface
+        c.rec.p = point3(real(gen.next_double(-10, 10)), real(gen.next_double(0, 2)), real(gen.next_double(-10, 10)));
+        c.rec.t = real(gen.next_double(0.1, 20));
+        c.incoming = ray(c.rec.p - c.rec.t * direction, direction, real(gen.next_double()));
+        c.rec.set_face_normal(c.incoming, outward_normal);
+    }
+    return cases;
+}
+
+// Compares direct calls of `mat`'s scatter() (bound statically by visit_material) with
+// virtual calls through the base class, each case with its own generator, and checks what
+// every scattered ray must satisfy: it starts at the hit point, keeps the ray's time, has a
+// unit direction and, for lambertian and metal, leaves on the side of the normal.
+inline check_result check_scatter(const std::string& name, const material& mat, const std::vector<scatter_case>& cases) {
+    check_result result;
+    result.name = name;
+    result.cases = cases.size();
+    const material* volatile virtual_mat = &mat; // Keeps the reference calls virtual
+    const real tolerance = std::sqrt(epsilon); // Both calls run the same code; the compiler may round it differently
+
+    for (size_t i = 0; i < cases.size(); ++i) {
+        const scatter_case& c = cases[i];
+        color direct_attenuation, virtual_attenuation;
+        ray direct_ray, virtual_ray;
+        rng direct_gen(i, 7), virtual_gen(i, 7);
+        bool direct = visit_material(mat, [&](const auto& m) { return m.scatter(c.incoming, c.rec, direct_attenuation, direct_ray, direct_gen); });
+        bool reference = virtual_mat->scatter(c.incoming, c.rec, virtual_attenuation, virtual_ray, virtual_gen);
+
+        bool agrees = direct == reference;
+        if (agrees && direct) {
+            real direction_error = (direct_ray.direction() - virtual_ray.direction()).length();
+            agrees = direction_error <= tolerance && (direct_attenuation - virtual_attenuation).length() <= tolerance;
+            result.max_normal_error = std::max(result.max_normal_error, direction_error);
+
+            const vec3& d = direct_ray.direction();
+            bool leaves_surface = mat.kind == material_kind::dielectric || dot(d, c.rec.normal) > -tolerance;
+            agrees = agrees && leaves_surface && std::fabs(d.length() - 1) <= tolerance &&
+                     (direct_ray.origin() - c.rec.p).length() == 0 && direct_ray.time() == c.incoming.time();
+        }
+        result.failures += agrees ? 0 : 1;
+    }
+
+    auto time_calls = [&](auto call) {
+        long long scattered = 0;
+        double ns = time_per_case(cases.size(), [&] {
+            rng gen(42);
+            color attenuation;
+            ray out;
+            for (const scatter_case& c : cases)
+                scattered += call(c, attenuation, out, gen);
+        });
+        result.failures += scattered < 0;
+        return ns;
+    };
+    result.ns_per_case = time_calls([&](const scatter_case& c, color& attenuation, ray& out, rng& gen) {
+        return visit_material(mat, [&](const auto& m) { return m.scatter(c.incoming, c.rec, attenuation, out, gen); });
+    });
+    double virtual_ns = time_calls([&](const scatter_case& c, color& attenuation, ray& out, rng& gen) {
+        return virtual_mat->scatter(c.incoming, c.rec, attenuation, out, gen);
+    });
+    std::clog << "  " << name << ": " << std::fixed << std::setprecision(2) << result.ns_per_case << " ns direct, " << virtual_ns << " ns virtual\n";
+    return result;
+}
+
+// Renders the frame of `view` depth-first and as a wavefront (camera::wavefront) and
+// compares the linear sums of every pixel. The two renderers trace the same samples with the
+// same generators, but -ffast-math lets the compiler round the scatter code inlined into
+// each a little differently, and once a path's rounding differs a comparison further down
+// (a refraction or a roulette draw) may send it elsewhere. So a few pixels may differ by
+// whole samples (counted as borderline); the run fails if more than 1% of the pixels do, or
+// if the image means drift apart by more than 0.1%.
+inline check_result check_wavefront(const std::string& name, camera& view, const hittable& world) {
+    check_result result;
+    result.name = name;
+    view.verbose = false;
+    view.partial_path = (std::filesystem::temp_directory_path() / ("kernel_check_" + std::to_string(getpid()) + ".rtpf")).string();
+
+    partial_image images[2];
+    double seconds[2] = {};
+    for (int wavefront = 0; wavefront < 2; ++wavefront) {
+        view.wavefront = wavefront == 1;
+        auto start = std::chrono::high_resolution_clock::now();
+        bool rendered = view.render(world);
+        seconds[wavefront] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        if (!rendered || !images[wavefront].read(view.partial_path)) {
+            result.failures++;
+            std::remove(view.partial_path.c_str());
+            return result;
+        }
+    }
+    std::remove(view.partial_path.c_str());
+
+    const std::vector<double>& depth_first = images[0].sums;
+    const std::vector<double>& wavefront = images[1].sums;
+    double samples = images[0].samples();
+    double depth_first_total = 0, wavefront_total = 0;
+    result.cases = depth_first.size() / 3;
+    for (size_t pixel = 0; pixel < result.cases; ++pixel) {
+        double largest = 0;
+        for (size_t c = 3 * pixel; c < 3 * pixel + 3; ++c) {
+            largest = std::max(largest, std::fabs(depth_first[c] - wavefront[c]) / samples);
+            depth_first_total += depth_first[c];
+            wavefront_total += wavefront[c];
+        }
+        // Rounding of the sums themselves stays far below this; a diverged path does not
+        if (largest > 1e-4)
+            result.borderline++;
+        result.max_normal_error = std::max(result.max_normal_error, real(largest));
+    }
+    double drift = std::fabs(depth_first_total - wavefront_total) / std::max(1e-30, depth_first_total);
+    if (result.borderline > result.cases / 100 || drift > 1e-3) {
+        std::clog << "  " << name << ": " << result.borderline << " pixels differ, image means " << std::scientific << drift << " apart\n" << std::fixed;
+        result.failures = std::max<size_t>(1, result.borderline);
+    }
+    result.ns_per_case = 1e9 * seconds[1] / (double(result.cases) * samples);
+    std::clog << "  " << name << ": " << std::fixed << std::setprecision(2) << 1e9 * seconds[0] / (double(result.cases) * samples) << " ns per sample depth-first, "
+              << result.ns_per_case << " ns as a wavefront\n";
+    return result;
+}
+
+// Rays aimed at the center every sphere of `spheres` has at time 0 and at time 1, the ends
+// of the widest shutter, from points a few units away in every direction. The temporal BVH
+// blends its boxes between the two ends, so it must find each sphere at both.
+inline std::vector<ray> make_endpoint_rays(const std::vector<const sphere*>& spheres, size_t per_sphere, std::uint64_t seed) {
+    rng gen(seed);
+    std::vector<ray> rays;
+    for (real time : {real(0), real(1)}) {
+        for (const sphere* s : spheres) {
+            for (size_t i = 0; i < per_sphere; ++i) {
+                point3 target = s->center_at(time) + real(0.5) * s->sphere_radius() * random_unit_vector(gen);
+                point3 origin = s->center_at(time) + real(gen.next_double(3, 6)) * random_unit_vector(gen);
+                rays.emplace_back(origin, unit_vector(target - origin), time);
+            }
+        }
+    }
+    return rays;
+}
+
+// Reads the pixels of a binary PPM written by the camera. Returns false if it cannot.
+inline bool read_ppm(const std::string& path, std::vector<unsigned char>& rgb) {
+    std::ifstream in(path, std::ios::binary);
+    std::string magic;
+    int width = 0, height = 0, maximum = 0;
+    if (!(in >> magic >> width >> height >> maximum) || magic != "P6" || width <= 0 || height <= 0)
+        return false;
+    in.get(); // The single whitespace before the pixels
+    rgb.resize(static_cast<size_t>(width) * height * 3);
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(rgb.data()), static_cast<std::streamsize>(rgb.size())));
+}
+
+// Renders the frame of `view` adaptively with a sample budget far below one sample per
+// pixel and compares it with a plain render of the samples the first pass must still take
+// (two per pixel, for the error estimate): the budget may not leave any pixel unrendered.
+// The two differ only by rounding of the means, one step of 8-bit output at most.
+inline check_result check_tiny_budget(const std::string& name, camera& view, const hittable& world) {
+    check_result result;
+    result.name = name;
+    view.verbose = false;
+    std::string base = (std::filesystem::temp_directory_path() / ("kernel_check_" + std::to_string(getpid()))).string();
+
+    std::vector<unsigned char> images[2];
+    double seconds[2] = {};
+    for (int budgeted = 1; budgeted >= 0; --budgeted) { // The budgeted render first, into a fresh framebuffer
+        view.samples_per_pixel = budgeted ? 64 : 2;
+        view.adaptive_threshold = budgeted ? 0.01 : 0;
+        view.sample_budget = budgeted ? 100 : 0;
+        view.output_path = base + (budgeted ? "_budget.ppm" : "_plain.ppm");
+        auto start = std::chrono::high_resolution_clock::now();
+        bool rendered = view.render(world);
+        seconds[budgeted] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        if (!rendered || !read_ppm(view.output_path, images[budgeted])) {
+            result.failures++;
+            std::remove(view.output_path.c_str());
+            return result;
+        }
+        std::remove(view.output_path.c_str());
+    }
+    view.adaptive_threshold = 0;
+    view.sample_budget = 0;
+
+    result.cases = images[0].size() / 3;
+    for (size_t i = 0; i < images[0].size(); ++i)
+        result.failures += std::abs(int(images[0][i]) - int(images[1][i])) > 1 ? 1 : 0;
+    if (images[0].size() != images[1].size())
+        result.failures++;
+    result.ns_per_case = 1e9 * seconds[1] / (2.0 * double(result.cases));
+    return result;
+}
+
+inline void print_results(const std::vector<check_result>& results) {
+    std::cout << std::left << std::setw(30) << "kernel" << std::right << std::setw(10) << "cases" << std::setw(10) << "failed" << std::setw(12) << "borderline"
+              << std::setw(12) << "max dt/tol" << std::setw(12) << "max dn" << std::setw(10) << "ns/case" << std::setw(14) << "cases/s" << std::setw(14) << "tests/s" << "\n";
+    for (const check_result& r : results) {
+        std::cout << std::left << std::setw(30) << r.name << std::right << std::setw(10) << r.cases << std::setw(10) << r.failures << std::setw(12) << r.borderline
+                  << std::scientific << std::setprecision(2) << std::setw(12) << double(r.max_t_error) << std::setw(12) << double(r.max_normal_error)
+                  << std::fixed << std::setprecision(1) << std::setw(10) << r.ns_per_case << std::scientific << std::setprecision(3) << std::setw(14)
+                  << 1e9 / r.ns_per_case;
+        if (r.tests_per_case > 0)
+            std::cout << std::setw(14) << r.tests_per_case * 1e9 / r.ns_per_case;
+        else
+            std::cout << std::setw(14) << "-";
+        std::cout << std::fixed << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+
+    /* COMMAND LINE */
+
+    size_t ray_count = 200000;
+    size_t scatter_count = 1000000;
+    std::uint64_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--rays") == 0 && i + 1 < argc) {
+            ray_count = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--scatters") == 0 && i + 1 < argc) {
+            scatter_count = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--rays <count>] [--scatters <count>] [--seed <seed>]\n";
+            return 1;
+        }
+    }
+
+    simd_isa widest = simd_active_isa;
+    std::vector<check_result> results;
+    std::clog << "Checking kernels (" << (sizeof(real) == sizeof(float) ? "float" : "double") << ", " << ray_count << " rays, widest SIMD: "
+              << simd_isa_name(widest) << ")\n";
+
+    /* INTERSECTION */
+
+    std::vector<ray> rays = make_check_rays(ray_count, seed);
+    std::vector<real> lengths(rays.size());
+    rng length_gen(seed + 1);
+    for (real& length : lengths)
+        length = real(length_gen.next_double(0.01, 20));
+
+    for (auto [scene_name, description] : {std::make_pair("static", random_spheres_description()), std::make_pair("moving", moving_spheres_description())}) {
+        // The reference: one sphere object per sphere in a plain list
+        hittable_list objects;
+        if (!build_scene(description, objects))
+            return 1;
+        std::vector<const sphere*> spheres;
+        sphere_batch batch;
+        for (const auto& object : objects.objects) {
+            if (auto s = dynamic_cast<const sphere*>(object.get())) {
+                spheres.push_back(s);
+                batch.add(*s);
+            }
+        }
+        double sphere_count = double(spheres.size());
+
+        std::clog << "  " << scene_name << " spheres: reference\n";
+        std::vector<hit_answer> reference = reference_hits(spheres, rays);
+        results.push_back(check_closest(scene_name + std::string("/list"), objects, spheres, rays, reference, sphere_count));
+
+        // Every backend this CPU runs, narrowest first; the BVH is rebuilt for each since its
+        // leaves are sized to the SIMD width
+        for (simd_isa isa : {simd_isa::scalar, simd_isa::sse4, simd_isa::avx2, simd_isa::avx512}) {
+            if (!select_simd_isa(isa))
+                continue;
+            std::string suffix = std::string("/") + simd_isa_name(isa);
+            std::clog << "  " << scene_name << " spheres: " << simd_isa_name(isa) << "\n";
+            bvh_node tree(objects);
+            results.push_back(check_closest(scene_name + std::string("/batch") + suffix, batch, spheres, rays, reference, sphere_count));
+            results.push_back(check_closest(scene_name + std::string("/bvh") + suffix, tree, spheres, rays, reference, 0));
+            results.push_back(check_occluded(scene_name + std::string("/batch_occluded") + suffix, batch, spheres, rays, reference, lengths));
+            results.push_back(check_occluded(scene_name + std::string("/bvh_occluded") + suffix, tree, spheres, rays, reference, lengths));
+        }
+        select_simd_isa(widest);
+    }
+
+    /* SHUTTER ENDPOINTS */
+
+    // Two spheres that swap places while the shutter is open, and a grid of spheres that each
+    // travel several of their diameters, so the boxes of the BVH nodes differ widely between
+    // the two ends: every ray aimed at a sphere at time 0 or 1 must hit it in the reference,
+    // and the batch and the BVH must agree with the reference
+    {
+        scene_description description;
+        std::uint32_t red = description.add_material(material_kind::lambertian, 0.8, 0.1, 0.1);
+        description.add_moving_sphere(point3(-2, 0, 0), point3(0, 0, 0), 0.5, red);
+        description.add_moving_sphere(point3(0, 0, 0), point3(-2, 0, 0), 0.5, red);
+        rng motion_gen(seed + 3);
+        for (int i = 0; i < 64; ++i) {
+            point3 start(real(3 * (i % 8)), 0, real(3 + 3 * (i / 8)));
+            description.add_moving_sphere(start, start + real(motion_gen.next_double(2, 6)) * random_unit_vector(motion_gen), 0.5, red);
+        }
+        hittable_list objects;
+        if (!build_scene(description, objects))
+            return 1;
+        std::vector<const sphere*> spheres;
+        sphere_batch batch;
+        for (const auto& object : objects.objects) {
+            if (auto s = dynamic_cast<const sphere*>(object.get())) {
+                spheres.push_back(s);
+                batch.add(*s);
+            }
+        }
+        std::vector<ray> endpoint_rays = make_endpoint_rays(spheres, 100, seed + 4);
+        std::vector<hit_answer> reference = reference_hits(spheres, endpoint_rays);
+        check_result aimed;
+        aimed.name = "endpoints/reference";
+        aimed.cases = endpoint_rays.size();
+        for (const hit_answer& answer : reference)
+            aimed.failures += answer.hit ? 0 : 1;
+        aimed.ns_per_case = time_per_case(endpoint_rays.size(), [&]() { reference = reference_hits(spheres, endpoint_rays); });
+        aimed.tests_per_case = double(spheres.size());
+        results.push_back(aimed);
+        for (simd_isa isa : {simd_isa::scalar, simd_isa::sse4, simd_isa::avx2, simd_isa::avx512}) {
+            if (!select_simd_isa(isa))
+                continue;
+            std::string suffix = std::string("/") + simd_isa_name(isa);
+            bvh_node tree(objects);
+            results.push_back(check_closest("endpoints/batch" + suffix, batch, spheres, endpoint_rays, reference, double(spheres.size())));
+            results.push_back(check_closest("endpoints/bvh" + suffix, tree, spheres, endpoint_rays, reference, 0));
+        }
+        select_simd_isa(widest);
+    }
+
+    /* SCATTER */
+
+    std::vector<scatter_case> cases = make_scatter_cases(scatter_count, seed + 2);
+    lambertian diffuse(color(0.5, 0.5, 0.5));
+    metal shiny(color(0.7, 0.6, 0.5), 0.3);
+    dielectric glass(1.5);
+    results.push_back(check_scatter("scatter/lambertian", diffuse, cases));
+    results.push_back(check_scatter("scatter/metal", shiny, cases));
+    results.push_back(check_scatter("scatter/dielectric", glass, cases));
+
+    /* RENDERERS */
+
+    // The default frame, smaller: with depth of field, then with roulette, then lit by a
+    // lamp under a dim sky so next-event estimation and emitters are on the wavefront's path
+    {
+        scene_description description = random_spheres_description();
+        description.camera.image_width = 160;
+        description.camera.samples_per_pixel = 8;
+        for (bool lit : {false, true}) {
+            if (lit) {
+                description.camera.sky_brightness = 0.1f;
+                description.add_sphere(point3(0, 6, 0), 1.5, description.add_material(material_kind::diffuse_light, 8, 8, 8));
+            }
+            light_list lights;
+            shared_ptr<bvh_node> tree = build_scene_tree(description, &lights);
+            if (!tree)
+                return 1;
+            camera view;
+            apply_camera_settings(description.camera, view);
+            view.lights = &lights;
+            view.thread_count = 1; // Timings per thread
+            if (lit) {
+                results.push_back(check_wavefront("wavefront/lit", view, *tree));
+            } else {
+                results.push_back(check_wavefront("wavefront/default", view, *tree));
+                view.roulette_depth = 3;
+                results.push_back(check_wavefront("wavefront/roulette", view, *tree));
+
+                // A camera of its own: the framebuffer a camera keeps would hide pixels the
+                // budgeted render leaves out
+                camera budgeted;
+                apply_camera_settings(description.camera, budgeted);
+                budgeted.lights = &lights;
+                budgeted.thread_count = 1;
+                results.push_back(check_tiny_budget("adaptive/tiny_budget", budgeted, *tree));
+            }
+        }
+    }
+
+    /* REPORT */
+
+    print_results(results);
+    size_t failures = 0;
+    for (const check_result& r : results)
+        failures += r.failures;
+    if (failures > 0) {
+        std::cout << "FAILED: " << failures << " results outside the tolerances\n";
+        return 1;
+    }
+    std::cout << "All kernels agree with the reference.\n";
+    return 0;
+}
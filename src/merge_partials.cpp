@@ -0,0 +1,62 @@
+#include "rtweekend.hpp"
+#include "framebuffer.hpp"
+#include "image_writer.hpp"
+#include "partial_image.hpp"
+#include "tonemap.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+// Combines the partial framebuffers written by `raytracer --partial` into the final image.
+// Row bands are composited and sample ranges of the same pixels averaged, in any mix:
+//
+//     raytracer --partial top.rtpf --rows 0:200
+//     raytracer --partial bottom.rtpf --rows 200:0
+//     merge_partials -o output/image.ppm top.rtpf bottom.rtpf
+//
+// It is also the separate display pass for checkpoints (`raytracer --checkpoint`), which
+// can be tonemapped again with other settings without tracing a single ray:
+//
+//     merge_partials -o bright.png --exposure 2 --tonemap aces state.rtpf
+int main(int argc, char* argv[]) {
+    std::string output_path = "output/image.ppm";
+    tonemap_settings tonemap = {};
+    std::vector<std::string> part_paths;
+    bool usage_error = false;
+    for (int i = 1; i < argc; ++i) {
+        if ((std::strcmp(argv[i], "-o") == 0 || std::strcmp(argv[i], "--output") == 0) && i + 1 < argc)
+            output_path = argv[++i];
+        else if (std::strcmp(argv[i], "--exposure") == 0 && i + 1 < argc)
+            tonemap.exposure = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--gamma") == 0 && i + 1 < argc)
+            tonemap.gamma = std::max(0.1, std::atof(argv[++i]));
+        else if (std::strcmp(argv[i], "--tonemap") == 0 && i + 1 < argc)
+            usage_error |= !parse_tonemap_curve(argv[++i], tonemap.curve);
+        else if (argv[i][0] == '-')
+            usage_error = true;
+        else
+            part_paths.push_back(argv[i]);
+    }
+    if (part_paths.empty() || usage_error) {
+        std::cerr << "Usage: " << argv[0] << " [-o <output.ppm|output.png>] [--exposure <scale>] [--tonemap clamp|reinhard|aces]\n"
+                  << "       [--gamma <gamma>] <part.rtpf>...\n";
+        return 1;
+    }
+
+    // Read every part
+    std::vector<partial_image> parts(part_paths.size());
+    for (size_t i = 0; i < parts.size(); ++i)
+        if (!parts[i].read(part_paths[i]))
+            return 1;
+
+    // Add them up, then tonemap and write the image exactly as the renderer would
+    framebuffer image;
+    if (!merge_partials(parts, image))
+        return 1;
+    if (!make_image_writer(output_path)->write(output_path, image.width, image.height, tonemap_to_rgb8(image, tonemap))) {
+        std::cerr << "Error: Could not write " << output_path << ".\n";
+        return 1;
+    }
+    std::cout << "Merged " << parts.size() << " parts into " << output_path << "\n";
+    return 0;
+}
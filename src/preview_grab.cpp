@@ -0,0 +1,70 @@
+#include "rtweekend.hpp"
+#include "image_writer.hpp"
+#include "preview.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+// Saves the latest snapshot a render publishes with `raytracer --preview-shm`, without
+// slowing the render down (the shared memory is read without locks):
+//
+//     raytracer --preview-shm /raytracer --preview-every 0.5 &
+//     preview_grab -o peek.png /raytracer
+//
+// With --follow it keeps saving every new snapshot until the final image arrives, which
+// makes it a minimal viewer for any program that watches the output file.
+int main(int argc, char* argv[]) {
+    std::string output_path = "output/preview.ppm";
+    std::string shm_name = "";
+    bool follow = false;
+    bool remove = false;
+    bool usage_error = false;
+    for (int i = 1; i < argc; ++i) {
+        if ((std::strcmp(argv[i], "-o") == 0 || std::strcmp(argv[i], "--output") == 0) && i + 1 < argc)
+            output_path = argv[++i];
+        else if (std::strcmp(argv[i], "--follow") == 0)
+            follow = true;
+        else if (std::strcmp(argv[i], "--remove") == 0)
+            remove = true;
+        else if (argv[i][0] == '-' || !shm_name.empty())
+            usage_error = true;
+        else
+            shm_name = argv[i];
+    }
+    if (shm_name.empty() || usage_error) {
+        std::cerr << "Usage: " << argv[0] << " [-o <output.ppm|output.png>] [--follow] [--remove] </shared memory name>\n"
+                  << "--follow saves every new snapshot until the render is final; --remove deletes the shared memory afterwards.\n";
+        return 1;
+    }
+
+    std::vector<unsigned char> rgb;
+    int width = 0, height = 0;
+    std::uint64_t frame = 0, saved_frame = 0;
+    bool finished = false;
+    do {
+        if (!read_preview_shm(shm_name, rgb, width, height, frame, finished))
+            return 1;
+        if (frame == saved_frame) {
+            if (!follow)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+
+        std::string temporary_path = output_path + ".tmp";
+        if (!make_image_writer(output_path)->write(temporary_path, width, height, rgb) || std::rename(temporary_path.c_str(), output_path.c_str()) != 0) {
+            std::cerr << "Error: Could not write " << output_path << ".\n";
+            return 1;
+        }
+        saved_frame = frame;
+        std::clog << "Saved snapshot " << frame << (finished ? " (final)" : "") << " to " << output_path << "\n";
+    } while (follow && !finished);
+
+    if (saved_frame == 0)
+        std::clog << "No snapshot published yet.\n";
+    if (remove)
+        ::shm_unlink(shm_name.c_str());
+    return 0;
+}
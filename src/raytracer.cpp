@@ -1,97 +1,261 @@
 #include "rtweekend.hpp"
+#include "animation.hpp"
+#include "async_writer.hpp"
+#include "bvh.hpp"
 #include "camera.hpp"
 #include "hittable.hpp"
 #include "hittable_list.hpp"
+#include "light.hpp"
 #include "material.hpp"
+#include "scene_file.hpp"
+#include "sampler.hpp"
+#include "scenes.hpp"
 #include "sphere.hpp"
+#include "tonemap.hpp"
 
-int main(void) {
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
-    /* SCENE OBJECTS */
+int main(int argc, char* argv[]) {
+
+    /* COMMAND LINE */
 
-    // Create a list to store all objects (only spheres in our case) in the scene.
-    hittable_list scene_objects = {};
-
-    // Add a large ground sphere to represent the floor. Lambertian is the diffusion distribution method.
-    auto ground_material = make_shared<lambertian>(color(0.2, 0.2, 0.2)); // Diffuse dark gray material
-    scene_objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material)); // Large sphere as ground
-
-    double large_sphere_radius = 1.0;
-    double small_sphere_radius = 0.2;
-    double possbile_interaction_radius = large_sphere_radius + small_sphere_radius;
-
-    // Large glass-like sphere
-    auto glass_material = make_shared<dielectric>(1.5);  
-    scene_objects.add(make_shared<sphere>(point3(0, 1, 0), large_sphere_radius, glass_material));  
-
-    // Large diffuse sphere
-    auto diffuse_material = make_shared<lambertian>(color(0.4, 0.2, 0.1));  
-    scene_objects.add(make_shared<sphere>(point3(-4, 1, 0), large_sphere_radius, diffuse_material));  
-
-    // Large metal sphere
-    auto metal_material = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);  
-    scene_objects.add(make_shared<sphere>(point3(4, 1, 0), large_sphere_radius, metal_material));  
-
-    // Generate small spheres randomly scattered across the ground.
-    for (int x = -11; x < 11; x++) {
-        for (int z = -11; z < 11; z++) {
-            // Randomly choose a material for the current sphere.
-            double random_material_choice = random_double();
-
-            // Generate a random position for the sphere, slightly offset from grid positions.
-            point3 sphere_center(x + 0.9 * random_double(), 0.2, z + 0.9 * random_double());
-
-            // Ensure spheres don't overlap with the large spheres.
-            if ((sphere_center - point3(4, 1, 0)).length() > possbile_interaction_radius && (sphere_center - point3(0, 1, 0)).length() > possbile_interaction_radius && (sphere_center - point3(-4, 1, 0)).length() > possbile_interaction_radius) {
-                shared_ptr<material> sphere_material;
-
-                // Choose a diffuse material (30% probability).
-                if (random_material_choice < 0.3) {
-                    auto albedo = color::random() * color::random(); // Random color for diffuse reflection
-                    sphere_material = make_shared<lambertian>(albedo); // Diffuse material
-                    scene_objects.add(make_shared<sphere>(sphere_center, small_sphere_radius, sphere_material)); // Add sphere
-
-                // Choose a metal material (30% probability).
-                } else if (random_material_choice < 0.6) {
-                    auto albedo = color::random(0.5, 1); // Random metal color with some brightness
-                    double fuzziness = random_double(0, 0.5); // Fuzziness affects the reflection blur
-                    sphere_material = make_shared<metal>(albedo, fuzziness); // Metal material
-                    scene_objects.add(make_shared<sphere>(sphere_center, small_sphere_radius, sphere_material)); // Add sphere
-
-                // Choose a glass-like (dielectric) material (40% probability).
-                } else {
-                    sphere_material = make_shared<dielectric>(1.5); // Refractive index for glass-like material
-                    scene_objects.add(make_shared<sphere>(sphere_center, small_sphere_radius, sphere_material)); // Add sphere
-                }
+    // Parse the optional arguments (see the usage message below).
+    std::string output_path = "output/image.ppm";
+    int roulette_depth = 0;
+    int samples_per_pixel = 0; // 0 keeps the scene's setting
+    std::string scene_path = "";
+    std::string save_scene_path = "";
+    std::string partial_path = "";
+    int row_range[2] = {0, 0}; // [begin, end), end 0: to the last row
+    int sample_range[2] = {0, 0}; // [begin, end), end 0: to samples_per_pixel
+    double shutter[2] = {0, 1}; // Shutter open and close times (see camera::shutter_open)
+    std::string checkpoint_path = "";
+    std::string cache_dir = "";
+    int checkpoint_samples = 0;
+    tonemap_settings tonemap = {};
+    bool denoise = false;
+    sample_pattern sampler = sample_pattern::random;
+    pixel_order traversal = pixel_order::hilbert;
+    std::string features_path = "";
+    std::string preview_path = "";
+    std::string preview_shm = "";
+    double preview_interval = 1.0;
+    double adaptive_threshold = 0;
+    double time_budget = 0;
+    std::uint64_t sample_budget = 0;
+    bool progressive_output = false;
+    bool wavefront = false;
+    bool next_event = true;
+    std::string stats_path = "";
+    std::string animation_path = "";
+    for (int i = 1; i < argc; ++i) {
+        if ((std::strcmp(argv[i], "-o") == 0 || std::strcmp(argv[i], "--output") == 0) && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--roulette") == 0 && i + 1 < argc) {
+            roulette_depth = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--spp") == 0 && i + 1 < argc) {
+            samples_per_pixel = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--adaptive") == 0 && i + 1 < argc) {
+            adaptive_threshold = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--time-budget") == 0 && i + 1 < argc) {
+            time_budget = std::max(0.0, std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            sample_budget = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--progressive") == 0) {
+            progressive_output = true;
+        } else if (std::strcmp(argv[i], "--wavefront") == 0) {
+            wavefront = true;
+        } else if (std::strcmp(argv[i], "--no-nee") == 0) {
+            next_event = false;
+        } else if (std::strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--partial") == 0 && i + 1 < argc) {
+            partial_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--rows") == 0 && i + 1 < argc && std::sscanf(argv[i + 1], "%d:%d", &row_range[0], &row_range[1]) == 2) {
+            ++i;
+        } else if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc && std::sscanf(argv[i + 1], "%d:%d", &sample_range[0], &sample_range[1]) == 2) {
+            ++i;
+        } else if (std::strcmp(argv[i], "--shutter") == 0 && i + 1 < argc && std::sscanf(argv[i + 1], "%lf:%lf", &shutter[0], &shutter[1]) == 2) {
+            ++i;
+        } else if (std::strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpoint_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            checkpoint_samples = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--exposure") == 0 && i + 1 < argc) {
+            tonemap.exposure = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--gamma") == 0 && i + 1 < argc) {
+            tonemap.gamma = std::max(0.1, std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--tonemap") == 0 && i + 1 < argc && parse_tonemap_curve(argv[i + 1], tonemap.curve)) {
+            ++i;
+        } else if (std::strcmp(argv[i], "--sampler") == 0 && i + 1 < argc && parse_sample_pattern(argv[i + 1], sampler)) {
+            ++i;
+        } else if (std::strcmp(argv[i], "--simd") == 0 && i + 1 < argc) {
+            simd_isa isa;
+            if (!parse_simd_isa(argv[++i], isa) || !select_simd_isa(isa)) {
+                std::cerr << "Error: This CPU or build has no " << argv[i] << " kernels.\n";
+                return 1;
             }
+        } else if (std::strcmp(argv[i], "--pixel-order") == 0 && i + 1 < argc && parse_pixel_order(argv[i + 1], traversal)) {
+            ++i;
+        } else if (std::strcmp(argv[i], "--denoise") == 0) {
+            denoise = true;
+        } else if (std::strcmp(argv[i], "--features") == 0 && i + 1 < argc) {
+            features_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--preview") == 0 && i + 1 < argc) {
+            preview_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--preview-shm") == 0 && i + 1 < argc) {
+            preview_shm = argv[++i];
+        } else if (std::strcmp(argv[i], "--preview-every") == 0 && i + 1 < argc) {
+            preview_interval = std::max(0.01, std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--animation") == 0 && i + 1 < argc) {
+            animation_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            scene_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--save-scene") == 0 && i + 1 < argc) {
+            save_scene_path = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [-o <output.ppm|output.png>] [--roulette <depth>] [--spp <samples>] [--wavefront]\n"
+                      << "       [--sampler random|halton|sobol] [--no-nee (light comes only from paths that hit a light)]\n"
+                      << "       [--pixel-order row|morton|hilbert (order pixels and tiles are traced in)]\n"
+                      << "       [--simd avx512|avx2|sse4|scalar (kernels to use instead of the widest the CPU has)]\n"
+                      << "       [--shutter <open>:<close> (motion blur interval of moving spheres within 0:1, default 0:1)]\n"
+                      << "       [--scene <file.txt|file.rtsb>] [--save-scene <file.txt|file.rtsb> (writes the scene and exits)]\n"
+                      << "       [--stats <report.json> (builds with RT_STATS)]\n"
+                      << "       [--adaptive <error threshold> [--budget <total samples>] [--progressive]]\n"
+                      << "       [--time-budget <seconds> (stops sampling in time; --spp is the per-pixel maximum)]\n"
+                      << "       [--partial <part.rtpf> [--rows <begin>:<end>] [--samples <begin>:<end>]]\n"
+                      << "       [--checkpoint <state.rtpf> [--checkpoint-every <samples>]]\n"
+                      << "       [--cache <directory> (reuses and extends earlier renders of the same scene and view)]\n"
+                      << "       [--exposure <scale>] [--tonemap clamp|reinhard|aces] [--gamma <gamma>]\n"
+                      << "       [--denoise] [--features <prefix> (writes <prefix>_albedo/_normal/_depth.pfm)]\n"
+                      << "       [--preview <snapshot.ppm|snapshot.png>] [--preview-shm </name>] [--preview-every <seconds>]\n"
+                      << "       [--animation <keys.txt> (renders every frame; -o frame_####.png numbers the files)]\n"
+                      << "With --adaptive, --spp is the per-pixel maximum. --partial renders part of the frame\n"
+                      << "(end 0: to the end) for build/merge_partials.\n"
+                      << "--checkpoint resumes from and saves to a file of linear sums; merge_partials tonemaps it again.\n"
+                      << "--preview replaces the file with a snapshot of the render every second; --preview-shm publishes\n"
+                      << "the snapshots to shared memory for build/preview_grab.\n";
+            return 1;
+        }
+    }
+
+    /* SCENE OBJECTS */
+
+    // Load the scene file, or describe the random spheres scene (see scenes.hpp).
+    scene_description scene = {};
+    if (scene_path.empty()) {
+        scene = random_spheres_description();
+    } else if (!load_scene(scene_path, scene)) {
+        return 1;
+    }
+
+    // Write the scene instead of rendering it if asked to; the extension picks text or binary.
+    if (!save_scene_path.empty()) {
+        if (!save_scene(save_scene_path, scene)) {
+            std::cerr << "Error: Could not write " << save_scene_path << ".\n";
+            return 1;
         }
+        std::clog << "Scene saved to " << save_scene_path << " (" << scene.spheres.size() << " spheres, " << scene.materials.size() << " materials).\n";
+        return 0;
     }
 
+    // Build the spheres and instances straight into a bounding volume hierarchy, so each ray
+    // only tests nearby spheres and no sphere needs an object of its own, and list the
+    // spheres made of a light material as the light sources.
+    light_list scene_lights = {};
+    shared_ptr<bvh_node> scene_tree = build_scene_tree(scene, &scene_lights);
+    if (!scene_tree)
+        return 1;
+    hittable_list scene_objects(scene_tree);
+
     /* CAMERA CONFIG */
 
-    // Configure the camera.
+    // Configure the camera: the scene's view, then the command line settings.
     camera scene_camera;
+    apply_camera_settings(scene.camera, scene_camera);
+    if (samples_per_pixel > 0)
+        scene_camera.samples_per_pixel = samples_per_pixel; // Samples per pixel for anti-aliasing (the scene's by default).
+    scene_camera.roulette_depth = roulette_depth; // Bounces before Russian roulette may end a path (0: off).
+    scene_camera.lights = &scene_lights; // Light sources sampled at every diffuse hit.
+    scene_camera.next_event = next_event; // Sample the lights directly (on unless --no-nee).
+    scene_camera.shutter_open = shutter[0]; // Moving spheres are blurred over the time the shutter is open.
+    scene_camera.shutter_close = shutter[1];
+
+    // Configure parallel rendering.
+    scene_camera.thread_count = 0; // Render threads (0 uses every hardware thread).
+    scene_camera.tile_size = 16; // Tiles of 16x16 pixels are handed out to the threads.
+    scene_camera.traversal = traversal; // Pixels and tiles follow a Hilbert curve unless asked otherwise.
+    scene_camera.seed = 0; // Seed for the per-sample random streams.
+    scene_camera.sampler = sampler; // Pixel and lens sample pattern (independent random points by default).
+    scene_camera.wavefront = wavefront; // Batch paths per tile and shade them by material kind.
+    scene_camera.stats_path = stats_path; // Where builds with RT_STATS write their counters.
+
+    // Configure adaptive sampling (off unless a threshold was given).
+    scene_camera.adaptive_threshold = adaptive_threshold; // Target on-screen error per pixel.
+    scene_camera.time_budget = time_budget; // Seconds of sampling before the image is written (0: no limit).
+    scene_camera.sample_budget = sample_budget; // Total sample cap (0: none).
+    scene_camera.progressive_output = progressive_output; // Write the partial image after every pass.
+
+    // Configure distributed rendering (off unless a partial framebuffer was asked for).
+    scene_camera.partial_path = partial_path; // Write the linear sums of this part of the frame here.
+    scene_camera.row_begin = row_range[0]; // Rows of the frame this process renders.
+    scene_camera.row_end = row_range[1];
+    scene_camera.sample_begin = sample_range[0]; // Sample indices of every pixel this process traces.
+    scene_camera.sample_end = sample_range[1];
 
-    // Set basic camera parameters.
-    scene_camera.aspect_ratio = 16.0 / 9.0; // Aspect ratio for widescreen rendering.
-    scene_camera.image_width = 720; // Image width in pixels.
-    scene_camera.samples_per_pixel = 10; // Samples per pixel for anti-aliasing.
-    scene_camera.max_depth = 25; // Maximum recursion depth for reflections/refractions.
+    // Configure checkpointing (off unless a checkpoint file was given).
+    scene_camera.checkpoint_path = checkpoint_path; // Resume from and save the linear sums here.
+    scene_camera.checkpoint_samples = checkpoint_samples; // Samples per pixel between saves (0: at the end).
 
-    // Set the camera's field of view and orientation.
-    scene_camera.vertical_fov = 20; // Vertical field of view in degrees.
-    scene_camera.camera_position = point3(13, 2, 3); // Camera position.
-    scene_camera.focus_point = point3(0, 0, 0); // Target point the camera is looking at.
-    scene_camera.up_direction = vec3(0, 1, 0); // Up direction for the camera (aligned with y-axis).
+    // Configure the render cache (off unless a directory was given).
+    scene_camera.cache_dir = cache_dir; // Linear sums of earlier renders, keyed by scene, view and sample settings.
+    scene_camera.scene_key = scene.content_key(); // What the scene holds, for the cache keys.
 
-    // Configure depth of field by setting focus and aperture.
-    scene_camera.lens_aperture = 0.2; // Aperture size affecting depth of field.
-    scene_camera.focus_distance = 10.0; // Distance at which the camera is focused.
+    // Set where the image goes; the extension picks the format (binary PPM or PNG).
+    scene_camera.output_path = output_path;
+    scene_camera.tonemap = tonemap; // Exposure, highlight curve and gamma of the 8-bit image.
+    scene_camera.denoise = denoise; // Filter the noise out of the finished image.
+    scene_camera.features_path = features_path; // Where to write the denoiser's guide buffers ("" : nowhere).
+
+    // Configure the live preview (off unless a file or shared-memory name was given).
+    scene_camera.preview_path = preview_path; // Snapshot file, replaced atomically.
+    scene_camera.preview_shm = preview_shm; // Shared memory double buffer for viewers.
+    scene_camera.preview_interval = preview_interval; // Seconds between snapshots.
 
     /* RENDER SCENE */
 
     // Render the scene using the configured camera and objects.
-    scene_camera.render(scene_objects);
+    // A failed render exits with status 1, so scripts and render farms see it.
+    if (animation_path.empty())
+        return scene_camera.render(scene_objects) ? 0 : 1;
 
-    return 0;
+    // Batch mode: one render per frame of the animation (see animation.hpp). The scene, its
+    // BVH, the camera's workers and framebuffer are reused by every frame, and each image is
+    // encoded and written in the background while the next frame renders.
+    if (!partial_path.empty() || !checkpoint_path.empty()) {
+        std::cerr << "Error: Animations cannot be rendered as partial or checkpointed frames.\n";
+        return 1;
+    }
+    camera_animation animation = {};
+    if (!load_animation(animation_path, animation))
+        return 1;
+    async_image_writer frame_writer;
+    scene_camera.image_queue = &frame_writer;
+    for (int frame = 0; frame < animation.frame_count; ++frame) {
+        camera_keyframe pose = animation.pose_at(frame);
+        scene_camera.camera_position = pose.position;
+        scene_camera.focus_point = pose.focus_point;
+        scene_camera.vertical_fov = pose.vertical_fov;
+        scene_camera.output_path = frame_output_path(output_path, frame);
+        std::clog << "Frame " << frame + 1 << " of " << animation.frame_count << "\n";
+        if (!scene_camera.render(scene_objects)) {
+            frame_writer.finish(); // Writes the frames already rendered
+            return 1;
+        }
+    }
+    return frame_writer.finish() ? 0 : 1;
 }